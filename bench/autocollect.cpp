@@ -0,0 +1,114 @@
+// Times the containment pass behind Document::AutoCollect on generated documents. Builds headless so it can run
+// without the Windows SDK, see build-bench.ps1.
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bounds.hpp"
+#include "containment.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+
+SysAllocator global_allocator;
+
+float RandomFloat(float min, float max) {
+    return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+// Lays out parts in rows like a cut sheet. Each part is an outline with a few holes inside of it and the
+// occasional hole has its own detail inside, so every part should end up as exactly one collection.
+size_t GenerateParts(BoundsStore* bounds, size_t shapes) {
+    size_t parts  = 0;
+    float  x      = 0.0f;
+    float  y      = 0.0f;
+    float  row_h  = 0.0f;
+    float  sheet_w = 2000.0f;
+
+    while (bounds->Length() < shapes) {
+        Vec2 size = Vec2(RandomFloat(2.0f, 12.0f), RandomFloat(2.0f, 12.0f));
+        if (x + size.x > sheet_w) {
+            x = 0.0f;
+            y += row_h + 0.25f;
+            row_h = 0.0f;
+        }
+
+        Rect outline = Rect(Vec2(x, y), size);
+        bounds->Push(outline);
+        parts++;
+
+        int holes = rand() % 4;
+        for (int i=0; i<holes && bounds->Length() < shapes; i++) {
+            Vec2 hole_size = Vec2(size.x * 0.2f, size.y * 0.2f);
+            Vec2 hole_pos  = Vec2(x + RandomFloat(0.1f, 0.7f) * size.x, y + RandomFloat(0.1f, 0.7f) * size.y);
+            bounds->Push(Rect(hole_pos, hole_size));
+
+            if (rand() % 4 == 0 && bounds->Length() < shapes) {
+                Vec2 detail_pos = Vec2(hole_pos.x + 0.01f, hole_pos.y + 0.01f);
+                bounds->Push(Rect(detail_pos, Vec2(hole_size.x * 0.5f, hole_size.y * 0.5f)));
+            }
+        }
+
+        x += size.x + 0.25f;
+        row_h = std::max<float>(row_h, size.y);
+    }
+
+    return parts;
+}
+
+// Checks the grid against the straightforward quadratic search for the smallest containing root
+bool CheckAgainstBruteForce(BoundsStore* bounds, DynamicArray<size_t>* containers) {
+    for (size_t i=0; i<bounds->Length(); i++) {
+        Rect bound = bounds->Get(i);
+        size_t expected = i;
+        float  area     = std::numeric_limits<float>::max();
+        for (size_t j=0; j<bounds->Length(); j++) {
+            if ((*containers)[j] != j || j == i) continue;
+
+            Rect root = bounds->Get(j);
+            if (root.Contains(&bound) && root.Area() < area) {
+                expected = j;
+                area     = root.Area();
+            }
+        }
+
+        if ((*containers)[i] != expected) {
+            printf("Mismatch at %zu: got %zu expected %zu\n", i, (*containers)[i], expected);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t sizes[] = { 10000, 100000, 1000000 };
+
+    for (auto shapes : sizes) {
+        srand(7);
+        auto bounds = BoundsStore(shapes);
+        size_t parts = GenerateParts(&bounds, shapes);
+
+        auto containers = DynamicArray<size_t>(shapes);
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        FindContainers(&bounds, &containers);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+
+        size_t roots = 0;
+        for (size_t i=0; i<shapes; i++) {
+            if (containers[i] == i) roots++;
+        }
+
+        printf("%8zu shapes: %.3f seconds, %zu collections (%zu parts)\n", shapes, elapsed.count() * 1e-9, roots, parts);
+
+        if (shapes <= 10000 && !CheckAgainstBruteForce(&bounds, &containers)) {
+            return 1;
+        }
+
+        containers.Free();
+        bounds.Free();
+    }
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+// Times the packers behind PackBins and checks how close they get to a lower bound on the sheets needed. Builds
+// headless so it can run without the Windows SDK, see build-bench.ps1.
+//
+//     packing-bench [--seed N] [--json results.json] [instance files...]
+//
+// Always runs the generated instances, which only depend on the seed, then every instance file given. Instance files
+// hold one bin size and the items, one per line:
+//
+//     # comment
+//     bin WIDTH HEIGHT
+//     WIDTH HEIGHT
+//     ...
+//
+// bench/instances has the ten classic instance classes for 2D bin packing without rotation: Berkey and Wang's
+// classes 1 to 6 and Martello and Vigo's classes 7 to 10, at 20, 50 and 100 items each. They're generated from the
+// published class definitions rather than copied from the original sets, so compare against each other and not
+// against published results. In PowerShell all of them run with
+//
+//     ./packing-bench.exe (Get-ChildItem bench/instances/*.txt)
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bin_packing.hpp"
+#include "ds.hpp"
+#include "files.hpp"
+#include "geometry.hpp"
+
+SysAllocator global_allocator;
+
+float RandomFloat(float min, float max) {
+    return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+// Parts the size of what usually gets cut, mostly small with the odd long strip. A run of identical parts is all one
+// size apart from every hundredth part, like a job with thousands of copies of the same piece
+void GenerateCollections(DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects, size_t count, bool identical, LinearAllocatorPool* allocator) {
+    for (size_t i=0; i<count; i++) {
+        Vec2 size = Vec2(RandomFloat(0.5f, 6.0f), RandomFloat(0.5f, 6.0f));
+        if (rand() % 16 == 0) size.x = RandomFloat(12.0f, 40.0f);
+        if (identical && i % 100) size = Vec2(3.25f, 2.5f);
+
+        rects->Push(RectNamed(Rect(Vec2(0.0f, 0.0f), size), i), allocator);
+    }
+}
+
+// Every rect has to be packed once, inside its bin and clear of the other rects in it
+bool CheckPacking(DynamicArrayEx<Bin, LinearAllocatorPool>* bins, DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects) {
+    size_t ids = 0;
+    for (auto &rect : *rects) {
+        ids = std::max<size_t>(ids, rect.id + 1);
+    }
+
+    auto sizes  = DynamicArray<Vec2>(ids);
+    auto packed = DynamicArray<bool>(ids);
+    sizes.Resize(ids);
+    packed.Resize(ids);
+    for (size_t id=0; id<ids; id++) {
+        packed[id] = true;
+    }
+    for (auto &rect : *rects) {
+        sizes[rect.id]  = rect.rect.size;
+        packed[rect.id] = false;
+    }
+
+    bool ok = true;
+    size_t count = 0;
+    for (auto &bin : *bins) {
+        for (size_t i=0; i<bin.rects.Length() && ok; i++) {
+            Vec2Named a = bin.rects[i];
+            Rect ra = Rect(a.vec2, sizes[a.id]);
+            count++;
+
+            if (packed[a.id] || ra.Left() < 0.0f || ra.Top() < 0.0f || ra.Right() > bin.size.x + kPackingEpsilon || ra.Bottom() > bin.size.y + kPackingEpsilon) {
+                printf("Rect %zu is packed twice, outside of its bin or isn't one of the rects\n", a.id);
+                ok = false;
+            }
+            packed[a.id] = true;
+
+            for (size_t j=i+1; j<bin.rects.Length() && ok; j++) {
+                Vec2Named b = bin.rects[j];
+                Rect rb = Rect(b.vec2, sizes[b.id]);
+
+                bool overlap = ra.Left() + kPackingEpsilon < rb.Right() && rb.Left() + kPackingEpsilon < ra.Right() &&
+                               ra.Top() + kPackingEpsilon < rb.Bottom() && rb.Top() + kPackingEpsilon < ra.Bottom();
+                if (overlap) {
+                    printf("Rects %zu and %zu overlap\n", a.id, b.id);
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    if (ok && count != rects->Length()) {
+        printf("Only %zu of %zu rects were packed\n", count, rects->Length());
+        ok = false;
+    }
+
+    sizes.Free();
+    packed.Free();
+    return ok;
+}
+
+// Budget for the PackBinsSearch run, which goes last
+constexpr float kSearchSeconds = 2.0f;
+
+// Rects of each kind of edit made before the incremental repack
+constexpr size_t kEditedRects = 5;
+
+constexpr unsigned int kDefaultSeed = 7;
+
+class PackerRun {
+    public:
+    const char     *name;
+    PackingOptions options;
+    PackerRun(const char *name, Packer packer, FreeAreaFit fit, bool grid_groups) : name(name), options(PackingOptions(packer, fit, PackingOrder::Height)) {
+        this->options.grid_groups = grid_groups;
+    };
+};
+
+static PackerRun runs[] = {
+    PackerRun("guillotine",          Packer::Guillotine, FreeAreaFit::BestShortSide, true),
+    PackerRun("maxrects short side", Packer::MaxRects,   FreeAreaFit::BestShortSide, true),
+    PackerRun("maxrects area",       Packer::MaxRects,   FreeAreaFit::BestArea,      true),
+    PackerRun("maxrects no grids",   Packer::MaxRects,   FreeAreaFit::BestShortSide, false),
+};
+
+constexpr size_t kRunCount = sizeof(runs) / sizeof(runs[0]);
+
+class PackingInstance {
+    public:
+    char                                           name[256];
+    DynamicArrayEx<Vec2Many, LinearAllocatorPool>  bins;
+    DynamicArrayEx<RectNamed, LinearAllocatorPool> rects;
+    PackingInstance(const char *name, LinearAllocatorPool *allocator) :
+        bins(DynamicArrayEx<Vec2Many, LinearAllocatorPool>(1, allocator)),
+        rects(DynamicArrayEx<RectNamed, LinearAllocatorPool>(16, allocator)) {
+        snprintf(this->name, sizeof(this->name), "%s", name);
+    };
+};
+
+bool LoadInstance(char *file, PackingInstance *instance, LinearAllocatorPool *allocator) {
+    size_t length;
+    char *data = ReadWholeFile(file, &length);
+    if (!data) {
+        printf("Couldn't read the instance %s\n", file);
+        return false;
+    }
+
+    bool ok = true;
+    size_t line_number = 0;
+    for (char *line=strtok(data, "\n"); line && ok; line=strtok(NULL, "\n")) {
+        line_number++;
+        while (*line == ' ' || *line == '\t') line++;
+        if (!*line || *line == '#' || *line == '\r') continue;
+
+        float width, height;
+        if (!strncmp(line, "bin", 3)) {
+            ok = sscanf(line + 3, "%f %f", &width, &height) == 2 && !instance->bins.Length();
+            if (ok) instance->bins.Push(Vec2Many(Vec2(width, height), kInfinity), allocator);
+        } else {
+            ok = sscanf(line, "%f %f", &width, &height) == 2;
+            if (ok) instance->rects.Push(RectNamed(Rect(Vec2(0.0f, 0.0f), Vec2(width, height)), instance->rects.Length()), allocator);
+        }
+
+        if (!ok) printf("Line %zu of the instance %s isn't a bin or an item\n", line_number, file);
+    }
+
+    if (ok && !instance->bins.Length()) {
+        printf("The instance %s doesn't have a bin\n", file);
+        ok = false;
+    }
+
+    global_allocator.Free(data);
+    return ok;
+}
+
+size_t LowerBound(PackingInstance *instance, LinearAllocatorPool *allocator) {
+    return PackingLowerBound(&instance->bins, &instance->rects, allocator).bins;
+}
+
+// Writes results as a JSON array of objects, one per packer per instance
+class PackingReport {
+    public:
+    FILE   *json;
+    size_t records;
+    PackingReport(FILE *json) : json(json), records(0) {};
+
+    void Record(const char *instance, size_t items, const char *packer, double seconds, size_t sheets, size_t lower_bound, float utilization) {
+        // An empty instance has a bound of 0 sheets and nothing to be over it by
+        double gap = lower_bound ? ((double)sheets - lower_bound) / lower_bound : 0.0;
+        printf("  %-20s %8.3f seconds, %6zu sheets, %5.1f%% used, %5.1f%% over the bound\n", packer, seconds, sheets, utilization * 100.0f, gap * 100.0);
+
+        if (!this->json) return;
+
+        fprintf(this->json, "%s\n  {\"instance\": ", this->records ? "," : "");
+        WriteJsonString(this->json, instance);
+        fprintf(this->json, ", \"items\": %zu, \"packer\": \"%s\", \"seconds\": %.6f, \"sheets\": %zu, \"lower_bound\": %zu, \"gap\": %.6f, \"utilization\": %.6f}",
+            items, packer, seconds, sheets, lower_bound, gap, utilization);
+        this->records++;
+    }
+};
+
+float Utilization(DynamicArrayEx<Bin, LinearAllocatorPool>* bins, DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects) {
+    double area = 0.0;
+    for (auto &rect : *rects) {
+        area += (double)rect.rect.size.x * rect.rect.size.y;
+    }
+
+    double bin_area = 0.0;
+    for (auto &bin : *bins) {
+        bin_area += (double)bin.size.x * bin.size.y;
+    }
+
+    return bin_area > 0.0 ? (float)(area / bin_area) : 0.0f;
+}
+
+bool RunInstance(PackingInstance *instance, PackingReport *report, LinearAllocatorPool *allocator) {
+    size_t lower_bound = LowerBound(instance, allocator);
+    printf("%s: %zu items, at least %zu sheets\n", instance->name, instance->rects.Length(), lower_bound);
+
+    for (size_t i=0; i<=kRunCount; i++) {
+        bool search = i == kRunCount;
+
+        bool out_of_space;
+        auto begin = std::chrono::high_resolution_clock::now();
+        auto bins = search ?
+            PackBinsSearch(&instance->bins, &instance->rects, PackingSearchOptions(kSearchSeconds), &out_of_space, allocator) :
+            PackBins(&instance->bins, &instance->rects, runs[i].options, &out_of_space, allocator);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+
+        report->Record(instance->name, instance->rects.Length(), search ? "search" : runs[i].name, elapsed.count() * 1e-9, bins.Length(), lower_bound, Utilization(&bins, &instance->rects));
+
+        if (out_of_space) {
+            printf("%s ran out of bins\n", instance->name);
+            return false;
+        }
+
+        if (!CheckPacking(&bins, &instance->rects)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// A few collections removed, resized and added after the first packing, like an edit made between runs
+bool RunIncremental(PackingInstance *instance, PackingReport *report, LinearAllocatorPool *allocator) {
+    size_t count = instance->rects.Length();
+
+    bool out_of_space;
+    auto packer = IncrementalPacker();
+    auto bins   = packer.Pack(&instance->bins, &instance->rects, 0.0f, &out_of_space, allocator);
+
+    auto edited = PackingInstance(instance->name, allocator);
+    edited.bins  = instance->bins;
+    edited.rects = instance->rects.Clone(allocator);
+    for (size_t i=0; i<kEditedRects; i++) {
+        edited.rects.RemoveIndex(rand() % edited.rects.Length());
+        edited.rects[rand() % edited.rects.Length()].rect.size = Vec2(RandomFloat(0.5f, 6.0f), RandomFloat(0.5f, 6.0f));
+        edited.rects.Push(RectNamed(Rect(Vec2(0.0f, 0.0f), Vec2(RandomFloat(0.5f, 6.0f), RandomFloat(0.5f, 6.0f))), count + i), allocator);
+    }
+
+    auto begin = std::chrono::high_resolution_clock::now();
+    bins = packer.Pack(&edited.bins, &edited.rects, 0.0f, &out_of_space, allocator);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+
+    report->Record(instance->name, edited.rects.Length(), "incremental", elapsed.count() * 1e-9, bins.Length(), LowerBound(&edited, allocator), Utilization(&bins, &edited.rects));
+
+    bool ok = CheckPacking(&bins, &edited.rects);
+    packer.Free();
+    return ok;
+}
+
+class GeneratedCase {
+    public:
+    size_t count;
+    bool   identical;
+    bool   mixed_sheets; // Offers a few smaller sheet sizes as well as the full sheet
+    GeneratedCase(size_t count, bool identical, bool mixed_sheets) : count(count), identical(identical), mixed_sheets(mixed_sheets) {};
+};
+
+int main(int argc, char **argv) {
+    unsigned int seed = kDefaultSeed;
+    char *json_file   = NULL;
+    auto files        = DynamicArray<char*>(16);
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_file = argv[++i];
+        } else {
+            files.Push(argv[i]);
+        }
+    }
+
+    FILE *json = NULL;
+    if (json_file) {
+        json = fopen(json_file, "wb");
+        if (!json) {
+            printf("Couldn't write the results to %s\n", json_file);
+            return 1;
+        }
+        fprintf(json, "{\"seed\": %u, \"results\": [", seed);
+    }
+
+    auto report = PackingReport(json);
+    bool ok     = true;
+
+    GeneratedCase cases[] = {
+        GeneratedCase(10000, false, false),
+        GeneratedCase(100000, false, false),
+        GeneratedCase(20000, true, false),
+        GeneratedCase(2000, false, true),
+    };
+    for (auto &generated : cases) {
+        auto allocator = LinearAllocatorPool(256 * 1024 * 1024);
+
+        // Each instance gets the seed to itself so it comes out the same whichever others run
+        srand(seed);
+
+        char name[64];
+        snprintf(name, sizeof(name), "generated-%s%s%zu", generated.identical ? "identical-" : "", generated.mixed_sheets ? "mixed-" : "", generated.count);
+
+        auto instance = PackingInstance(name, &allocator);
+        instance.bins.Push(Vec2Many(Vec2(48.0f, 24.0f), kInfinity), &allocator);
+        if (generated.mixed_sheets) {
+            instance.bins.Push(Vec2Many(Vec2(48.0f, 12.0f), kInfinity), &allocator);
+            instance.bins.Push(Vec2Many(Vec2(24.0f, 12.0f), kInfinity), &allocator);
+        }
+        GenerateCollections(&instance.rects, generated.count, generated.identical, &allocator);
+
+        ok = ok && RunInstance(&instance, &report, &allocator) && RunIncremental(&instance, &report, &allocator);
+        allocator.FreeAllocator();
+    }
+
+    for (auto &file : files) {
+        if (!ok) break;
+
+        auto allocator = LinearAllocatorPool(1024 * 1024);
+        auto instance  = PackingInstance(file, &allocator);
+
+        ok = LoadInstance(file, &instance, &allocator) && RunInstance(&instance, &report, &allocator);
+        allocator.FreeAllocator();
+    }
+
+    if (json) {
+        fprintf(json, "\n]}\n");
+        fclose(json);
+    }
+
+    files.Free();
+    return ok ? 0 : 1;
+}
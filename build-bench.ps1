@@ -0,0 +1,14 @@
+clang -I ./includes -O3 -mavx2 -DSVIGGY_HEADLESS -o autocollect-bench.exe `
+    bench/autocollect.cpp `
+    src/containment.cpp `
+    src/bounds.cpp
+
+clang -I ./includes -O3 -mavx2 -pthread -DSVIGGY_HEADLESS -o packing-bench.exe `
+    bench/packing.cpp `
+    src/bin_packing.cpp `
+    src/files.cpp `
+    src/free_areas.cpp `
+    src/packing_cache.cpp `
+    src/spatial_index.cpp `
+    src/bounds.cpp `
+    src/trace.cpp
\ No newline at end of file
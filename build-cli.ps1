@@ -0,0 +1,20 @@
+clang -I ./includes -I external -O3 -mavx2 -pthread -DSVIGGY_HEADLESS -o sviggy-cli `
+    src/cli.cpp `
+    src/files.cpp `
+    src/svg.cpp `
+    src/shapes.cpp `
+    src/application.cpp `
+    src/batch.cpp `
+    src/bin_packing.cpp `
+    src/bounds.cpp `
+    src/containment.cpp `
+    src/filter.cpp `
+    src/free_areas.cpp `
+    src/nesting.cpp `
+    src/packing_cache.cpp `
+    src/path.cpp `
+    src/pipeline.cpp `
+    src/spatial_index.cpp `
+    src/trace.cpp `
+    src/transform.cpp `
+    external/pugixml.cpp
\ No newline at end of file
@@ -1,12 +1,23 @@
-clang -I ./includes -I external -O3 -o sviggy-release.exe `
+clang -I ./includes -I external -O3 -mavx2 -DSVIGGY_NO_TRACE -o sviggy-release.exe `
     src/sviggy.cpp `
     src/svg.cpp `
     src/dx_state.cpp `
     src/shapes.cpp `
-    src/vec.cpp `
     src/application.cpp `
+    src/batch.cpp `
     src/bin_packing.cpp `
+    src/bounds.cpp `
+    src/containment.cpp `
+    src/files.cpp `
+    src/filter.cpp `
+    src/free_areas.cpp `
+    src/nesting.cpp `
+    src/packing_cache.cpp `
+    src/path.cpp `
     src/pipeline.cpp `
+    src/spatial_index.cpp `
+    src/trace.cpp `
+    src/transform.cpp `
     external/pugixml.cpp `
     external/imgui_demo.cpp `
     external/imgui_impl_dx11.cpp `
@@ -3,10 +3,21 @@ clang --debug -D DEBUG -DNOMINMAX -I ./includes -I external -o sviggy.exe `
     src/svg.cpp `
     src/dx_state.cpp `
     src/shapes.cpp `
-    src/vec.cpp `
     src/application.cpp `
+    src/batch.cpp `
     src/bin_packing.cpp `
+    src/bounds.cpp `
+    src/containment.cpp `
+    src/files.cpp `
+    src/filter.cpp `
+    src/free_areas.cpp `
+    src/nesting.cpp `
+    src/packing_cache.cpp `
+    src/path.cpp `
     src/pipeline.cpp `
+    src/spatial_index.cpp `
+    src/trace.cpp `
+    src/transform.cpp `
     external/pugixml.cpp `
     external/imgui_demo.cpp `
     external/imgui_impl_dx11.cpp `
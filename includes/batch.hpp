@@ -0,0 +1,45 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "ds.hpp"
+#include "sviggy.hpp"
+
+class PackingCache;
+class PipelineLayout;
+
+// Where one collection of a batch went. It keeps the document and collection it came from so every part on a sheet
+// can be traced back to its job
+class BatchPlacement {
+    public:
+    size_t       document;   // Index of the document in the batch
+    CollectionId collection; // In that document's paths
+    size_t       sheet;
+    Vec2         pos;        // Top left of the collection's bounds, relative to the sheet
+    Vec2         size;
+    BatchPlacement(size_t document, CollectionId collection, size_t sheet, Vec2 pos, Vec2 size) :
+        document(document), collection(collection), sheet(sheet), pos(pos), size(size) {};
+};
+
+// Sheets go down and to the right of each other like a layout's bins, and the collections are moved onto them in the
+// paths they came from, so sheet_offsets[sheet] is where the sheet's top left is in every document
+class BatchLayout {
+    public:
+    DynamicArrayEx<Vec2, LinearAllocatorPool>           sheets;        // Size of every sheet used
+    DynamicArrayEx<Vec2, LinearAllocatorPool>           sheet_offsets;
+    DynamicArrayEx<size_t, LinearAllocatorPool>         sheet_starts;  // Into placements, one more than there are sheets
+    DynamicArrayEx<BatchPlacement, LinearAllocatorPool> placements;    // Grouped by sheet
+    size_t                                              unplaced;      // Collections that didn't fit in any bin
+};
+
+// Packs the collections of every one of the paths together onto shared sheets, so many small jobs fill sheets between
+// them instead of each leaving its own sheet partly empty. Packs like RunLayout, once with the default options or
+// with PackBinsSearch when the layout has search seconds, and through the packing cache when there is one. Bounds are
+// gathered and collections moved a document per thread, so hundreds of documents cost little more than one document
+// with the same number of collections
+BatchLayout RunBatchLayout(Paths **documents, size_t count, PipelineLayout *layout, PackingCache *cache, LinearAllocatorPool *allocator);
+
+// Writes the batch as JSON, one object per sheet with its size and the document, collection and position of every
+// placement on it. names has the name of each document. Returns false if the file couldn't be written
+bool WriteBatchManifest(char *file, BatchLayout *batch, char **names);
+
+#endif
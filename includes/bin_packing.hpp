@@ -1,9 +1,27 @@
 #ifndef BIN_PACKING_H
 #define BIN_PACKING_H
 
+#include <cstring>
+#include <stdint.h>
+
 #include "ds.hpp"
+#include "free_areas.hpp"
+#include "spatial_index.hpp"
 #include "sviggy.hpp"
 
+class PackingCache;
+
+// Free areas thinner than this are dropped instead of being kept around for parts that could never fit them
+constexpr float kPackingEpsilon = 1e-4f;
+
+// Sizes are matched on their exact bits, anything that only nearly matches counts as a different size
+inline uint64_t PackingSizeKey(Vec2 size) {
+    uint32_t width, height;
+    memcpy(&width,  &size.x, sizeof(width));
+    memcpy(&height, &size.y, sizeof(height));
+    return ((uint64_t)width << 32) | height;
+}
+
 class Bin {
     public:
     Vec2 size;
@@ -11,39 +29,253 @@ class Bin {
     Bin(Vec2 size, LinearAllocatorPool *allocator);
 };
 
+enum class Packer {
+    Guillotine, // Splits the free area a rect goes in two, cheaper but leaves more waste
+    MaxRects,
+};
+
+// Order rects are packed in. Every order but Given is largest first, with ties broken by id so the result doesn't
+// depend on the order the rects came in
+enum class PackingOrder {
+    Given,
+    Height,
+    Area,
+    MaxSide,
+    Perimeter,
+};
+
+class PackingOptions {
+    public:
+    Packer       packer;
+    FreeAreaFit  fit;
+    PackingOrder order;
+    bool         grid_groups; // Place groups of identical rects as grids instead of one at a time
+    PackingOptions() : packer(Packer::MaxRects), fit(FreeAreaFit::BestShortSide), order(PackingOrder::Height), grid_groups(true) {};
+    PackingOptions(Packer packer, FreeAreaFit fit, PackingOrder order) : packer(packer), fit(fit), order(order), grid_groups(true) {};
+};
+
+// Packs the rects into as few of the available bins as it can. Each packed rect keeps its id and gets the position
+// of its top left corner in the bin. The rects themselves are left in the order they were given. When the bins run
+// out before every rect is packed out_of_space is set and the bins packed so far are returned
 DynamicArrayEx<Bin, LinearAllocatorPool> PackBins(
         DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
         DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        bool *out_of_space,
         LinearAllocatorPool *allocator
 );
 
-struct AvailableArea {
-    Rect* area;
-    size_t bin_id;
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBins(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+);
+
+// How long PackBinsSearch can take and how many threads it can take it on. Zero threads means one per core
+class PackingSearchOptions {
+    public:
+    float  seconds;
+    size_t threads;
+    PackingSearchOptions(float seconds) : seconds(seconds), threads(0) {};
 };
 
-// Returns NULL for AvailableArea.aera if none of the available areas can fit the shape
-AvailableArea FindNextAvailableArea(
-    DynamicArrayEx<Bin,      LinearAllocatorPool>* bins,
-    DynamicArrayEx<size_t,   LinearAllocatorPool>* used_bins_count,
-    DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
-    DynamicArrayEx<DynamicArrayEx<Rect, LinearAllocatorPool>, LinearAllocatorPool>* available_areas,
-    Vec2 size,
-    LinearAllocatorPool *allocator
+// Packs the rects with every combination of order and packer it can get through before the deadline, spread over a
+// pool of threads, and returns the packing that needs the fewest bins. Ties go to the smallest total bin area and
+// then to whichever combination comes first. The default PackingOptions always run to completion so there's a
+// packing to return even if the deadline is too short for anything else, which means a search can run past the
+// deadline by about one PackBins.
+//
+// The search stops as soon as a packing meets PackingLowerBound. With more than one kind of bin whatever time is left
+// goes to choosing how many bins of each kind to use: combinations of bin counts that can't beat the best packing so
+// far or can't pass the bounds are skipped, and the rest are packed going down from the best packing's bin count,
+// least area first within each count. out_of_space is set like PackBins when even the best packing left rects out.
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsSearch(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingSearchOptions search,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+);
+
+// Lower bounds on what any packing of every rect into the available bins needs: at least bins bins, and at least
+// bin_area of bin area between that many bins
+class PackingBound {
+    public:
+    size_t bins;
+    float  bin_area;
+    PackingBound(size_t bins, float bin_area) : bins(bins), bin_area(bin_area) {};
+};
+
+// Works out the bound from the area of the rects, which kinds of bin each one fits in and which ones are too big to
+// share a bin, without packing anything. It's the fewest bins out of every combination of bin counts that passes
+// those checks, see BinSelection in bin_packing.cpp for what they are
+PackingBound PackingLowerBound(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        LinearAllocatorPool *allocator
 );
 
-void Place(
-    DynamicArrayEx<Bin, LinearAllocatorPool>* bins,
-    DynamicArrayEx<DynamicArrayEx<Rect, LinearAllocatorPool>, LinearAllocatorPool>* available_areas,
-    RectNamed* rect,
-    AvailableArea area,
-    LinearAllocatorPool* allocator
+void SortForPacking(DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects, PackingOrder order);
+
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsGuillotine(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        FreeAreaFit fit,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+);
+
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsMaxRects(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        FreeAreaFit fit,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
 );
 
+// The free areas of every bin in a packing, indexed two ways. A FreeAreaIndex over every bin finds the best fit by
+// size and a SpatialIndex per bin finds the areas around a position, so neither has to look at every free area.
+class BinFreeAreas {
+    public:
+    FreeAreaIndex              sizes;
+    DynamicArray<SpatialIndex> positions; // One per bin. Items are ids in sizes
+    BinFreeAreas(size_t estimated_areas);
+
+    void Free();
+
+    // Adds an empty bin with a single free area covering it and returns the bin's id
+    size_t AddBin(Vec2 size);
+
+    // Makes the whole bin one free area again
+    void ResetBin(size_t bin, Vec2 size);
+
+    size_t Add(Rect rect, size_t bin);
+    void Remove(size_t area);
+
+    FreeArea* Get(size_t area) {
+        return this->sizes.Get(area);
+    }
+
+    // Returns the free area the size fits best in or kNullArea
+    size_t FindBest(Vec2 size, FreeAreaFit fit) {
+        return this->sizes.FindBest(size, fit);
+    }
+
+    // Appends the ids of the free areas in the bin that intersect or touch rect
+    void QueryIntersecting(size_t bin, Rect rect, DynamicArray<size_t>* out) {
+        this->positions[bin].QueryIntersecting(rect, out);
+    }
+};
+
+// The guillotine packer cuts the free area a rect is placed in into two, one on the right and one below, and never
+// looks at the rect again. Freed areas that line up with a neighbour along a whole edge are merged back together so
+// the space isn't left in slivers that are too narrow for anything.
+class GuillotinePacker {
+    public:
+    BinFreeAreas         areas;
+    DynamicArray<size_t> neighbours; // Scratch for queries
+    FreeAreaFit          fit;
+    GuillotinePacker(FreeAreaFit fit, size_t estimated_rects);
+
+    void Free();
+
+    // Places a rect of size at the top left of the free area and splits what's left of the area
+    void Place(size_t area, Vec2 size);
+
+    // Adds the area after merging it with any neighbours it makes a rectangle with
+    void AddMerged(Rect rect, size_t bin);
+};
+
+// MaxRects keeps every maximal free rectangle of each bin instead of committing to one split, so the space next to
+// a placed rect stays available in both directions. Placing a rect splits every free area it overlaps into the
+// parts around it and drops any part that another free area already contains.
+class MaxRectsPacker {
+    public:
+    BinFreeAreas         areas;
+    DynamicArray<size_t> overlapping; // Scratch for queries
+    DynamicArray<Rect>   splits;      // Scratch for the parts of split areas
+    FreeAreaFit          fit;
+    MaxRectsPacker(FreeAreaFit fit, size_t estimated_rects);
+
+    void Free();
+
+    // Places a rect of size at the top left of the free area and updates the free areas around it
+    void Place(size_t area, Vec2 size);
+
+    // Takes rect out of the free areas of the bin wherever it is, whether or not it lines up with a free area
+    void Occupy(size_t bin, Rect rect);
+};
+
+// Where IncrementalPacker put a rect
+class PackedRect {
+    public:
+    size_t   bin;
+    Rect     rect;
+    uint64_t seen; // Last IncrementalPacker::Pack the rect was part of
+    PackedRect(size_t bin, Rect rect, uint64_t seen) : bin(bin), rect(rect), seen(seen) {};
+};
+
+// A full repack happens once the utilization of an incremental one falls below this fraction of what the last full
+// repack got
+constexpr float kRepackUtilization = 0.97f;
+
+// IncrementalPacker keeps a MaxRects packing around between runs so a packing that only changed a little doesn't
+// have to be redone from scratch. Rects are matched to the last packing by id. Rects with the same id and size stay
+// exactly where they were. Bins that lost a rect, whether it was removed or resized, get their free areas rebuilt
+// from the rects still in them. Then the new and resized rects are placed wherever they fit best, in any bin.
+// Bins that were never touched cost nothing beyond checking their rects are still there.
+//
+// Leaving everything else in place wastes more space over time than packing from scratch, so a full repack happens
+// when the utilization drops below kRepackUtilization of what the last full repack got. A full repack also happens
+// on the first run, when the available bins change, when more than half of the rects changed, and when a changed
+// rect doesn't fit anywhere.
+class IncrementalPacker {
+    public:
+    MaxRectsPacker             packer;
+    PackingOptions             options;
+    DynamicArray<Vec2Many>     available_bins;  // What the packing was made for
+    DynamicArray<size_t>       used_bins_count; // Bins used of each kind in available_bins
+    DynamicArray<Vec2>         bin_sizes;
+    HashMap<size_t, PackedRect> placements;     // By rect id
+    uint64_t                   generation;
+    float                      full_utilization; // Utilization right after the last full repack
+    bool                       packed;
+    PackingCache*              cache; // Where full repacks look for a packing first, see PackBinsCached. Can be NULL
+    IncrementalPacker();
+
+    void Free();
+
+    // Packs the rects like PackBins and returns the bins that aren't empty. search_seconds is passed on to
+    // PackBinsSearch for full repacks, 0 packs with the default options
+    DynamicArrayEx<Bin, LinearAllocatorPool> Pack(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        float search_seconds,
+        bool* out_of_space,
+        LinearAllocatorPool* allocator
+    );
+
+    // Replaces the kept packing with bins, which have to hold exactly the rects
+    void Reset(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<Bin, LinearAllocatorPool>* bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects
+    );
+
+    // Opens a bin that fits size and returns its id, or kNullArea when there's none left that can
+    size_t OpenBin(Vec2 size);
+
+    DynamicArrayEx<Bin, LinearAllocatorPool> Bins(LinearAllocatorPool* allocator, float *utilization);
+};
+
 struct RectPair {
     Rect a, b;
 };
 
+// Both split a rect with size taken out of its top left corner into what's below and what's to the right of it.
+// SplitVertical gives the right side the full height and SplitHorizontal gives the bottom the full width
 RectPair SplitVertical(Rect *rect, Vec2 size);
+RectPair SplitHorizontal(Rect *rect, Vec2 size);
 
 #endif
\ No newline at end of file
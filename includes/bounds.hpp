@@ -0,0 +1,63 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include "ds.hpp"
+#include "geometry.hpp"
+
+constexpr size_t kBoundsNotFound = std::numeric_limits<size_t>::max();
+
+// BoundsStore keeps axis aligned bounds as four separate float columns instead of an array of Rects. Keeping
+// each edge contiguous lets the kernels below test 4 (SSE) or 8 (AVX2) bounds against a rect per instruction.
+// Entries are kept in the same order as the arrays in Paths so an index into one is an index into the other.
+class BoundsStore {
+    public:
+    DynamicArray<float> minx;
+    DynamicArray<float> miny;
+    DynamicArray<float> maxx;
+    DynamicArray<float> maxy;
+    BoundsStore(size_t capacity);
+
+    // Constructor for clone
+    BoundsStore(DynamicArray<float> minx, DynamicArray<float> miny, DynamicArray<float> maxx, DynamicArray<float> maxy) :
+        minx(minx),
+        miny(miny),
+        maxx(maxx),
+        maxy(maxy) {};
+
+    void Free();
+
+    void Push(Rect rect);
+    void Put(Rect rect, size_t index);
+    Rect Get(size_t index);
+
+    // Moves the last entry into index, the same way DynamicArray::RemoveIndex does
+    void RemoveIndex(size_t index);
+
+    size_t Length();
+    void Clear();
+
+    // Sets the length of every column. New entries are uninitialized and have to be Put before being read
+    void Resize(size_t length);
+
+    BoundsStore Clone();
+};
+
+// Batch kernels. The Find* kernels push the index of every matching entry into out in ascending order.
+
+// Finds every bound that is fully inside of area
+void FindBoundsContainedBy(BoundsStore* store, Rect area, DynamicArray<size_t>* out);
+
+// Finds every bound that overlaps area
+void FindBoundsIntersecting(BoundsStore* store, Rect area, DynamicArray<size_t>* out);
+
+// Finds every bound that contains point once the bound has been grown by tolerance on every side
+void FindBoundsContainingPoint(BoundsStore* store, Vec2 point, float tolerance, DynamicArray<size_t>* out);
+
+// Returns the index of the first bound at or after from that fully contains rect or kBoundsNotFound
+size_t FindFirstBoundsContaining(BoundsStore* store, size_t from, Rect rect);
+
+// Union reductions. Both expect at least one bound to reduce over
+Rect UnionBounds(BoundsStore* store, size_t* indices, size_t count);
+Rect UnionBoundsRange(BoundsStore* store, size_t start, size_t count);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CONTAINMENT_H
+#define CONTAINMENT_H
+
+#include "bounds.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+
+constexpr size_t kNoContainmentEntry = std::numeric_limits<size_t>::max();
+
+// The most cells the containment grid will use no matter how many bounds there are. Keeps the head array to a
+// few megabytes for very large documents at the cost of slightly longer cell lists.
+constexpr size_t kMaxContainmentCells = 1 << 20;
+
+// A root registered in a grid cell. The bound is copied in so walking a cell doesn't have to jump around the store
+class ContainmentEntry {
+    public:
+    float minx, miny, maxx, maxy;
+    size_t root;
+    size_t next; // Next entry in the same cell or kNoContainmentEntry
+};
+
+// ContainmentGrid buckets the roots found so far by the cells of a uniform grid laid over all of the bounds. A root
+// is linked into every cell it overlaps, so every root that contains a point is in the list of the point's cell.
+class ContainmentGrid {
+    public:
+    DynamicArray<size_t>           cell_heads; // First entry of each cell or kNoContainmentEntry
+    DynamicArray<ContainmentEntry> entries;
+    float  originx, originy;
+    float  inverse_cell_width, inverse_cell_height;
+    size_t columns, rows;
+    ContainmentGrid(Rect area, size_t estimated_items);
+
+    void Free();
+
+    size_t Column(float x);
+    size_t Row(float y);
+
+    void Insert(size_t root, Rect bound);
+
+    // Returns the smallest registered root containing bound or kBoundsNotFound
+    size_t FindSmallestContaining(Rect bound);
+};
+
+// For every entry in bounds finds the entry that should collect it and writes it to the same index in containers.
+//
+// The bounds are swept in SortRectPositionXY order so anything containing a bound comes before it. A bound that isn't
+// contained by one of the roots found so far becomes a root itself and collects itself. Every other bound is
+// collected by the smallest root containing it. Runs in O(n log n) for the sort plus the size of the grid cells hit.
+void FindContainers(BoundsStore* bounds, DynamicArray<size_t>* containers);
+
+#endif
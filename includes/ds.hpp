@@ -2,7 +2,10 @@
 #define DS_H
 
 #include <functional>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <cstring>
 
 // TODO: Create documentation explaining how the allocators / data structures were built and how they should be used
 // avoiding this for now because I'm not sure what's going to stick for them. I don't the implementation right now.
@@ -30,6 +33,20 @@ class SysAllocator {
 // Needs to be defined in one of the cpp files
 extern SysAllocator global_allocator;
 
+// FNV-1a over the raw bytes of data, chained on from hash so several pieces can go into one key. Hashes start
+// from kHashBytesSeed
+constexpr uint64_t kHashBytesSeed = 14695981039346656037ull;
+
+inline uint64_t HashBytes(uint64_t hash, void *data, size_t size) {
+    unsigned char *bytes = (unsigned char *)data;
+    for (size_t i=0; i<size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
 class LinearAllocator {
     public:
         void *start;
@@ -63,7 +80,7 @@ class LinearAllocator {
 
         template <typename T>
         T* Realloc(void *data, size_t old_capacity, size_t new_capacity) {
-            T* new_loc = this->Alloc(new_capacity);
+            T* new_loc = this->template Alloc<T>(new_capacity);
             if (new_loc) {
                 memcpy(new_loc, data, sizeof(T) * old_capacity);
             }
@@ -237,7 +254,7 @@ class DynamicArrayEx {
     void ReleaseAll() {
         for (auto i=0; i<this->length; i++) {
             T* elem = this->GetPtr(i);
-            (*elem)->Release();
+            if (*elem) (*elem)->Release();
         }
     }
 
@@ -289,7 +306,7 @@ class DynamicArray {
     }
 
     void Resize(size_t new_length) {
-        this->array.Resize(new_length &global_allocator);
+        this->array.Resize(new_length, &global_allocator);
     }
 
     void Push(T elem) {
@@ -0,0 +1,38 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Reads the whole file into a null terminated buffer from the global allocator that the caller frees. length is
+// set to the size of the file without the terminator. Returns NULL when the file can't be read
+char* ReadWholeFile(char *file, size_t *length);
+
+// Size of the file in bytes or 0 when it can't be opened
+size_t FileSize(char *file);
+
+// A whole file mapped read only into memory. Pages are only read in when they're touched so mapping a file costs
+// about the same however big it is
+class MappedFile {
+    public:
+    void   *data;
+    size_t length;
+    void   *handle; // The file mapping on Windows, unused elsewhere
+    MappedFile() : data(NULL), length(0), handle(NULL) {};
+
+    void Free();
+};
+
+// Returns false when the file can't be opened or is empty
+bool MapFile(char *file, MappedFile *mapped);
+
+// Writes the data to a file next to file and renames it over file, so anyone reading the file sees either the old
+// contents or all of the new ones. On Windows a file that's already there is kept instead. Returns false when any of
+// it fails
+bool WriteWholeFileAtomically(char *file, void *data, size_t length);
+
+// Writes s as a quoted JSON string. Quotes and backslashes, which file paths on Windows are full of, are escaped and
+// control characters are dropped
+void WriteJsonString(FILE *f, const char *s);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "bounds.hpp"
+#include "ds.hpp"
+
+// Filter expressions pick shapes out by their tags, bounds and collection, for example
+//
+//     Bound and not Engrave and width > 2in
+//     (Cut or "Score Lines") and collection 12
+//     area >= 4 and left < 10mm
+//
+// expression := term ("or" term)*
+// term       := factor ("and" factor)*
+// factor     := "not" factor | "(" expression ")" | comparison | "collection" number | tag
+// comparison := field ("<" | "<=" | ">" | ">=" | "==" | "!=") number ("in" | "mm")?
+// field      := "left" | "top" | "right" | "bottom" | "width" | "height" | "area"
+// tag        := name | '"' any text '"'
+//
+// Keywords and fields match in any case, so a tag with the same name as one has to be quoted. Numbers without a
+// unit are inches, the document units. Area is in square inches, or square millimeters with mm. Tags are looked up
+// by name in the document the filter runs on, so the same program works on every document and tags the document
+// doesn't have match nothing.
+
+// Shapes are evaluated this many at a time so every mask on the stack stays in L1
+constexpr size_t kFilterBlock = 256;
+
+// Most masks an expression can need on the stack at once. Deeper expressions are rejected by CompileFilter
+constexpr size_t kMaxFilterDepth = 32;
+
+enum class FilterOpType {
+    Tag,
+    Collection,
+    Compare,
+    And,
+    Or,
+    Not,
+};
+
+enum class FilterField {
+    Left,
+    Top,
+    Right,
+    Bottom,
+    Width,
+    Height,
+    Area,
+};
+
+enum class FilterCompare {
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Equal,
+    NotEqual,
+};
+
+class FilterOp {
+    public:
+    FilterOpType  type;
+    FilterField   field;   // Only for Compare
+    FilterCompare compare; // Only for Compare
+    float         value;   // Only for Compare, in document units
+    size_t        id;      // Only for Collection
+    char*         name;    // Only for Tag, kept in the allocator the program was compiled with
+    FilterOp(FilterOpType type) : type(type), field(FilterField::Left), compare(FilterCompare::Less), value(0.0f), id(0), name(NULL) {};
+};
+
+// A compiled filter expression. The ops are in postfix order and each one works on a whole block of shapes at
+// a time: leaves push a mask for the block and And / Or / Not combine the masks on top of the stack. That way
+// each op is a tight loop over one column no matter how complicated the expression is.
+//
+// Tag and collection leaves read from leaf masks the caller builds before evaluating, one mask over every shape
+// for each of them in the order they appear in ops. leaves is how many of those there are.
+class FilterProgram {
+    public:
+    DynamicArrayEx<FilterOp, LinearAllocatorPool> ops;
+    size_t depth;  // Most masks on the stack at once
+    size_t leaves; // Tag and Collection ops
+
+    // Writes whether each entry of bounds passes the filter to keep. leaf_masks holds leaves masks of
+    // bounds->Length() bytes back to back. Blocks are evaluated in parallel
+    void Evaluate(BoundsStore* bounds, unsigned char* leaf_masks, bool* keep);
+};
+
+// Compiles source into program with the ops and tag names allocated from allocator. Prints where the expression
+// went wrong and returns false when it can't be compiled.
+bool CompileFilter(char* source, LinearAllocatorPool* allocator, FilterProgram* program);
+
+#endif
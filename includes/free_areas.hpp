@@ -0,0 +1,72 @@
+#ifndef FREE_AREAS_H
+#define FREE_AREAS_H
+
+#include <stdint.h>
+
+#include "ds.hpp"
+#include "geometry.hpp"
+
+constexpr size_t kNullArea = std::numeric_limits<size_t>::max();
+
+// Sizes are bucketed into classes that are a quarter of a doubling wide, from 2^-16 to 2^16 inches on each axis
+constexpr size_t kFreeAreaClassesPerDoubling = 4;
+constexpr size_t kFreeAreaClasses            = 128;
+constexpr size_t kFreeAreaMaskWords          = kFreeAreaClasses / 64;
+
+// Most entries that can hold the size looked at in one bucket during a search. Buckets of nearly identical areas can
+// get long, e.g. the strips left next to a row of identical parts, and any of them is about as good as the others.
+// Entries too small for the size don't count so a bucket that mostly can't hold it still finds the ones that can
+constexpr size_t kFreeAreaProbe = 32;
+
+// How a search ranks the areas that can hold a size
+enum class FreeAreaFit {
+    BestShortSide, // Smallest leftover along the tighter side, the usual MaxRects default
+    BestArea,      // Smallest area
+};
+
+class FreeArea {
+    public:
+    Rect   rect;
+    size_t bin;
+    size_t leaf;   // Free for the packer to use, e.g. for the area's leaf in a spatial index
+    size_t bucket; // kNullArea while the slot is unused
+    size_t prev, next;
+    FreeArea(Rect rect, size_t bin) : rect(rect), bin(bin), leaf(kNullArea), bucket(kNullArea), prev(kNullArea), next(kNullArea) {};
+};
+
+// FreeAreaIndex holds the free areas of every bin in a packing bucketed by the size class of their width and
+// height. A search only visits the buckets big enough for the size in order of how good the best area in them
+// could be, and stops once no bucket left can beat what it has, so it costs about the same no matter how many
+// areas there are. Empty buckets are skipped with a bitmask per width class.
+//
+// Ids stay the same for as long as the area is in the index and are reused after it's removed.
+class FreeAreaIndex {
+    public:
+    DynamicArray<FreeArea> areas;
+    DynamicArray<size_t>   free_slots;
+    DynamicArray<size_t>   heads; // First area of each bucket, kFreeAreaClasses height classes per width class
+    DynamicArray<uint64_t> masks; // Bit per non-empty height class, kFreeAreaMaskWords words per width class
+    size_t                 length;
+    FreeAreaIndex(size_t estimated_areas);
+
+    void Free();
+    void Clear();
+
+    size_t Insert(Rect rect, size_t bin);
+    void Remove(size_t id);
+
+    FreeArea* Get(size_t id) {
+        return &this->areas[id];
+    }
+
+    size_t Length() {
+        return this->length;
+    }
+
+    // Returns the id of the best area that can hold size or kNullArea when none can. Ties go to the lowest bin
+    size_t FindBest(Vec2 size, FreeAreaFit fit);
+};
+
+size_t FreeAreaClass(float size);
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+// Defining SVIGGY_HEADLESS leaves out the Direct2D conversions so the geometry code and everything built
+// only on top of it (bounds, containment, path flattening, packing) can be compiled without the Windows SDK.
+#ifndef SVIGGY_HEADLESS
+#include <d2d1.h>
+#endif
+
+// The basic geometry types are defined inline here instead of out of line in a cpp file. They're used in
+// the inner loops of selection, collection and packing so the compiler needs to be able to see through them.
+
+class Vec2 {
+    public:
+    float x,y;
+    Vec2(float x, float y) : x(x), y(y) {};
+
+    static Vec2 Min() {
+        return Vec2(std::numeric_limits<float>::min(), std::numeric_limits<float>::min());
+    }
+
+    static Vec2 Max() {
+        return Vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    }
+
+    #ifndef SVIGGY_HEADLESS
+    Vec2(D2D1_POINT_2F p) : x(p.x), y(p.y) {};
+
+    D2D1_POINT_2F D2Point() {
+        return D2D1::Point2F(this->x, this->y);
+    }
+
+    D2D1_SIZE_F Size() {
+        return D2D1::SizeF(this->x, this->y);
+    }
+    #endif
+
+    bool Fits(Vec2 other) {
+        // TODO: better floating point comaprison
+        return this->x >= other.x && this->y >= other.y;
+    }
+
+    Vec2 operator+(Vec2 &b) {
+        return Vec2(this->x + b.x, this->y + b.y);
+    }
+
+    Vec2& operator+=(Vec2 &b) {
+        this->x += b.x;
+        this->y += b.y;
+
+        return *this;
+    }
+
+    Vec2 operator-(Vec2 &b) {
+        return Vec2(this->x - b.x, this->y - b.y);
+    }
+
+    Vec2& operator-=(Vec2 &b) {
+        this->x -= b.x;
+        this->y -= b.y;
+
+        return *this;
+    }
+
+    Vec2 operator-() {
+        return Vec2(-this->x, -this->y);
+    }
+
+    Vec2 operator/(float b) {
+        return Vec2(this->x / b, this->y / b);
+    }
+};
+
+class Vec2Many {
+    public:
+    Vec2 vec2;
+    float quantity; // float is a quantity so we can represent infinity
+    Vec2Many(Vec2 vec2, float quantity) : vec2(vec2), quantity(quantity) {};
+};
+
+class Vec2Named {
+    public:
+    Vec2 vec2;
+    size_t id;
+    Vec2Named(Vec2 vec2, size_t id) : vec2(vec2), id(id) {};
+};
+
+class Rect {
+    public:
+    Vec2 pos, size;
+    Rect(Vec2 pos, Vec2 size) : pos(pos), size(size) {};
+
+    #ifndef SVIGGY_HEADLESS
+    Rect(D2D1_RECT_F* rect) :
+        pos(Vec2(rect->left, rect->top)),
+        size(Vec2(rect->right - rect->left, rect->bottom - rect->top)) {};
+    #endif
+
+    // Creates a rect from its edges instead of its position and size
+    static Rect FromEdges(float left, float top, float right, float bottom) {
+        return Rect(Vec2(left, top), Vec2(right - left, bottom - top));
+    }
+
+    float Left() {
+        return this->pos.x;
+    }
+
+    float Top() {
+        return this->pos.y;
+    }
+
+    float Right() {
+        return this->pos.x + this->size.x;
+    }
+
+    float Bottom() {
+        return this->pos.y + this->size.y;
+    }
+
+    float Width() {
+        return this->size.x;
+    }
+
+    float Height() {
+        return this->size.y;
+    }
+
+    Vec2 Center() {
+        return Vec2(this->pos.x + (this->size.x / 2.0f), this->pos.y + (this->size.y / 2.0f));
+    }
+
+    bool Contains(Rect *other) {
+        return this->Left()   <= other->Left()  &&
+               this->Top()    <= other->Top()   &&
+               this->Right()  >= other->Right() &&
+               this->Bottom() >= other->Bottom();
+    }
+
+    Rect Union(Rect* other) {
+        float left   = std::min<float>(this->Left(),   other->Left());
+        float top    = std::min<float>(this->Top(),    other->Top());
+        float right  = std::max<float>(this->Right(),  other->Right());
+        float bottom = std::max<float>(this->Bottom(), other->Bottom());
+
+        return Rect::FromEdges(left, top, right, bottom);
+    }
+
+    float Area() {
+        return this->size.x * this->size.y;
+    }
+
+    #ifndef SVIGGY_HEADLESS
+    D2D1_RECT_F D2Rect() {
+        return D2D1::RectF(this->Left(), this->Top(), this->Right(), this->Bottom());
+    }
+    #endif
+};
+
+// Mat3x2 is a 2D affine transformation laid out the same as D2D1_MATRIX_3X2_F (row vectors, translation in the
+// last row) so the two convert without shuffling. It exists so transformed geometry can be worked with in the
+// headless code.
+class Mat3x2 {
+    public:
+    float m11, m12;
+    float m21, m22;
+    float dx,  dy;
+    Mat3x2() : m11(1.0f), m12(0.0f), m21(0.0f), m22(1.0f), dx(0.0f), dy(0.0f) {};
+    Mat3x2(float m11, float m12, float m21, float m22, float dx, float dy) :
+        m11(m11), m12(m12), m21(m21), m22(m22), dx(dx), dy(dy) {};
+
+    static Mat3x2 Translation(Vec2 offset) {
+        return Mat3x2(1.0f, 0.0f, 0.0f, 1.0f, offset.x, offset.y);
+    }
+
+    static Mat3x2 Scale(Vec2 scale, Vec2 center) {
+        return Mat3x2(scale.x, 0.0f, 0.0f, scale.y, center.x - scale.x * center.x, center.y - scale.y * center.y);
+    }
+
+    // Same convention as D2D, degrees clockwise on screen (y points down)
+    static Mat3x2 Rotation(float degrees, Vec2 center) {
+        float radians = degrees * 3.14159265358979323846f / 180.0f;
+        float c = cosf(radians);
+        float s = sinf(radians);
+
+        return Mat3x2(c, s, -s, c, center.x - center.x * c + center.y * s, center.y - center.x * s - center.y * c);
+    }
+
+    // Applies this matrix and then other, the same order as D2D's operator*
+    Mat3x2 operator*(Mat3x2 other) {
+        return Mat3x2(
+            this->m11 * other.m11 + this->m12 * other.m21,
+            this->m11 * other.m12 + this->m12 * other.m22,
+            this->m21 * other.m11 + this->m22 * other.m21,
+            this->m21 * other.m12 + this->m22 * other.m22,
+            this->dx  * other.m11 + this->dy  * other.m21 + other.dx,
+            this->dx  * other.m12 + this->dy  * other.m22 + other.dy
+        );
+    }
+
+    Vec2 Apply(Vec2 p) {
+        return Vec2(p.x * this->m11 + p.y * this->m21 + this->dx, p.x * this->m12 + p.y * this->m22 + this->dy);
+    }
+
+    bool operator==(Mat3x2 other) {
+        return this->m11 == other.m11 && this->m12 == other.m12 && this->m21 == other.m21 &&
+               this->m22 == other.m22 && this->dx  == other.dx  && this->dy  == other.dy;
+    }
+
+    bool IsTranslation() {
+        return this->m11 == 1.0f && this->m12 == 0.0f && this->m21 == 0.0f && this->m22 == 1.0f;
+    }
+
+    // The largest amount the matrix stretches a length by. Used to carry a tolerance from one side of the
+    // transformation to the other. This is an upper bound rather than the exact singular value.
+    float MaxScale() {
+        return sqrtf(std::max<float>(
+            this->m11 * this->m11 + this->m12 * this->m12,
+            this->m21 * this->m21 + this->m22 * this->m22
+        ));
+    }
+
+    #ifndef SVIGGY_HEADLESS
+    Mat3x2(D2D1_MATRIX_3X2_F m) : m11(m._11), m12(m._12), m21(m._21), m22(m._22), dx(m._31), dy(m._32) {};
+
+    D2D1_MATRIX_3X2_F D2Matrix() {
+        return D2D1::Matrix3x2F(this->m11, this->m12, this->m21, this->m22, this->dx, this->dy);
+    }
+    #endif
+};
+
+class RectNamed {
+    public:
+    Rect rect;
+    size_t id;
+    RectNamed(Rect rect, size_t id) : rect(rect), id(id) {};
+
+    float Left() {
+        return this->rect.Left();
+    }
+
+    float Top() {
+        return this->rect.Top();
+    }
+
+    float Right() {
+        return this->rect.Right();
+    }
+
+    float Bottom() {
+        return this->rect.Bottom();
+    }
+};
+
+// Sorts the rect by its position in the x direction and then the y direction.
+// If two rects are in the same position then the larger rect will end up first.
+// This ensures that a rect containing another one will appear first
+template <typename T>
+bool SortRectPositionXY(T& a, T& b) {
+    if (a.Left() != b.Left()) {
+        return a.Left() < b.Left();
+    }
+
+    if (a.Top() != b.Top()) {
+        return a.Top() < b.Top();
+    }
+
+    if (a.Right() != b.Right()) {
+        return a.Right() > b.Right();
+    }
+
+    return a.Bottom() > b.Bottom();
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LANES_H
+#define LANES_H
+
+// The batch kernels are written against a handful of lane helpers so the same loop compiles to AVX2 when the
+// build enables it (-mavx2), SSE on every other x64 build and plain scalar code everywhere else. LANES_SIMD is
+// only defined when one of the vector paths is available, so kernels keep a scalar tail loop for whatever
+// doesn't fill a full set of lanes and for the builds without it.
+//
+// MinLanes / MaxLanes return their second argument when either is NaN, kernels rely on that to clamp NaNs away.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LANES_SIMD
+
+typedef __m256 Lanes;
+constexpr size_t kLanes = 8;
+
+static inline Lanes LoadLanes(float *p)              { return _mm256_loadu_ps(p); }
+static inline Lanes SplatLanes(float x)              { return _mm256_set1_ps(x); }
+static inline Lanes AddLanes(Lanes a, Lanes b)       { return _mm256_add_ps(a, b); }
+static inline Lanes SubLanes(Lanes a, Lanes b)       { return _mm256_sub_ps(a, b); }
+static inline Lanes MulLanes(Lanes a, Lanes b)       { return _mm256_mul_ps(a, b); }
+static inline Lanes DivLanes(Lanes a, Lanes b)       { return _mm256_div_ps(a, b); }
+static inline Lanes SqrtLanes(Lanes a)               { return _mm256_sqrt_ps(a); }
+static inline Lanes LessLanes(Lanes a, Lanes b)      { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Lanes LessEqualLanes(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline Lanes AndLanes(Lanes a, Lanes b)       { return _mm256_and_ps(a, b); }
+static inline Lanes MinLanes(Lanes a, Lanes b)       { return _mm256_min_ps(a, b); }
+static inline Lanes MaxLanes(Lanes a, Lanes b)       { return _mm256_max_ps(a, b); }
+static inline int   MaskLanes(Lanes a)               { return _mm256_movemask_ps(a); }
+static inline void  StoreLanes(float *p, Lanes a)    { _mm256_storeu_ps(p, a); }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LANES_SIMD
+
+typedef __m128 Lanes;
+constexpr size_t kLanes = 4;
+
+static inline Lanes LoadLanes(float *p)              { return _mm_loadu_ps(p); }
+static inline Lanes SplatLanes(float x)              { return _mm_set1_ps(x); }
+static inline Lanes AddLanes(Lanes a, Lanes b)       { return _mm_add_ps(a, b); }
+static inline Lanes SubLanes(Lanes a, Lanes b)       { return _mm_sub_ps(a, b); }
+static inline Lanes MulLanes(Lanes a, Lanes b)       { return _mm_mul_ps(a, b); }
+static inline Lanes DivLanes(Lanes a, Lanes b)       { return _mm_div_ps(a, b); }
+static inline Lanes SqrtLanes(Lanes a)               { return _mm_sqrt_ps(a); }
+static inline Lanes LessLanes(Lanes a, Lanes b)      { return _mm_cmplt_ps(a, b); }
+static inline Lanes LessEqualLanes(Lanes a, Lanes b) { return _mm_cmple_ps(a, b); }
+static inline Lanes AndLanes(Lanes a, Lanes b)       { return _mm_and_ps(a, b); }
+static inline Lanes MinLanes(Lanes a, Lanes b)       { return _mm_min_ps(a, b); }
+static inline Lanes MaxLanes(Lanes a, Lanes b)       { return _mm_max_ps(a, b); }
+static inline int   MaskLanes(Lanes a)               { return _mm_movemask_ps(a); }
+static inline void  StoreLanes(float *p, Lanes a)    { _mm_storeu_ps(p, a); }
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef NESTING_H
+#define NESTING_H
+
+#include <stdint.h>
+
+#include "ds.hpp"
+#include "geometry.hpp"
+#include "path.hpp"
+
+// Outlines are flattened this close to their curves, in inches. Parts can overlap by up to this much where a curve
+// bulges out between two flattened points
+constexpr float kNestingTolerance = 0.002f;
+
+// Closed outlines with more points than this use their convex hull instead of being split into convex pieces, since
+// the split takes time quadratic in the points
+constexpr size_t kNestingMaxSplitPoints = 256;
+
+// A point only counts as inside a no-fit polygon once it's this far in, so parts placed against each other still fit
+// when the math rounds a little the wrong way
+constexpr float kNestingTouch = 1e-5f;
+
+constexpr size_t kNestingQuarterTurns = 4;
+
+// Bin of a part that didn't fit in any of the available bins
+constexpr size_t kNestUnplaced = std::numeric_limits<size_t>::max();
+
+// A set of convex polygons, each counterclockwise with its points from starts[piece] up to starts[piece + 1]
+class ConvexPieces {
+    public:
+    DynamicArray<Vec2>   points;
+    DynamicArray<size_t> starts; // One more than there are pieces
+    DynamicArray<Rect>   bounds; // Of each piece
+    Rect                 bound;  // Of every piece together
+    ConvexPieces(size_t estimated_points);
+
+    void Free();
+    void Clear();
+
+    size_t Length() {
+        return this->starts.Length() - 1;
+    }
+
+    Vec2* Piece(size_t piece, size_t *count) {
+        *count = this->starts[piece + 1] - this->starts[piece];
+        return &this->points[this->starts[piece]];
+    }
+
+    // Points have to be convex and counterclockwise already
+    void Push(Vec2 *points, size_t count);
+
+    // Whether point is more than kNestingTouch inside any of the pieces
+    bool ContainsStrictly(Vec2 point);
+};
+
+// A part is the outlines of a collection as convex pieces in the part's own coordinates, with the top left of its
+// bounds at the origin. Together the pieces cover every outline. Outlines that already lie inside a piece of a
+// bigger outline, like holes and engraving, don't add any pieces of their own.
+class NestPart {
+    public:
+    ConvexPieces pieces;
+    Vec2         size;
+    float        area;  // Sum of the areas of the pieces, which is what parts are ordered by
+    uint64_t     shape; // Hash of the pieces. Parts with the same shape share their no-fit polygons
+    NestPart(ConvexPieces pieces, Vec2 size, float area, uint64_t shape) : pieces(pieces), size(size), area(area), shape(shape) {};
+
+    void Free();
+};
+
+// Builds the part for the outlines, which are the flattened paths of a collection. bound is the collection's bound
+NestPart BuildNestPart(SegmentStore *outlines, Rect bound);
+
+// Where the parts of a NestParts went. A part turned by rotation quarter turns has its bounds' top left at pos in the
+// bin, see NestRotation
+class NestPlacement {
+    public:
+    size_t bin;
+    size_t rotation;
+    Vec2   pos;
+    NestPlacement(size_t bin, size_t rotation, Vec2 pos) : bin(bin), rotation(rotation), pos(pos) {};
+};
+
+// Turns a part of size by quarter_turns clockwise quarter turns and moves it back so the top left of its bounds is
+// at the origin again
+Mat3x2 NestRotation(size_t quarter_turns, Vec2 size);
+
+// The no-fit polygon of a pair of parts is every offset of the second part from the first where the two overlap, so
+// placing a part only needs a point test against the no-fit polygons of the parts already in the bin. They're kept
+// as the convex pieces the Minkowski sums of the convex pieces of the parts come out as, instead of being merged
+// into one polygon. NestCache keeps them by the shapes of both parts and how far each one is turned, so identical
+// parts share them and a rerun doesn't have to make them again.
+class NestCache {
+    public:
+    HashMap<uint64_t, size_t> shapes; // Index of every part shape seen so far
+    HashMap<uint64_t, size_t> index;  // Into nfps by the shape indexes and rotations of the pair
+    DynamicArray<ConvexPieces> nfps;
+    NestCache();
+
+    void Free();
+
+    size_t ShapeIndex(uint64_t shape);
+};
+
+class NestOptions {
+    public:
+    float  seconds;   // How long placing parts one by one can take, the rest are packed by their bounds
+    size_t rotations; // 1 keeps parts as they are, 2 also tries them upside down and 4 tries every quarter turn
+    NestOptions(float seconds, size_t rotations) : seconds(seconds), rotations(rotations) {};
+};
+
+// Places the parts, largest first, at the top left most spot of the first bin where they fit without overlapping
+// any part already placed, trying every allowed rotation. No-fit polygons that aren't in the cache yet are made on
+// every core. Once options.seconds have passed the parts that are left are packed by their bounds with PackBins
+// into bins of their own so the run still ends close to the deadline. Returns the size of every bin used and puts
+// a placement for each part in placements
+DynamicArrayEx<Vec2, LinearAllocatorPool> NestParts(
+        NestCache *cache,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool> *available_bins,
+        DynamicArray<NestPart> *parts,
+        NestOptions options,
+        DynamicArrayEx<NestPlacement, LinearAllocatorPool> *placements,
+        LinearAllocatorPool *allocator
+);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PACKING_CACHE_H
+#define PACKING_CACHE_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "bin_packing.hpp"
+#include "ds.hpp"
+
+constexpr size_t kMaxPackingCachePath = 4096;
+
+// Goes up whenever the entries change layout or the packers would pack the same input differently, so entries
+// written by an older build are ignored
+constexpr uint32_t kPackingCacheVersion = 2;
+
+// PackingCache keeps packings on disk in a directory, one file per packing named after its key, so every thread,
+// process and later run pointed at the same directory shares them. Entries are mapped rather than read.
+//
+// The key only depends on the multiset of rect sizes, the available bins and the options. Which ids the rects have
+// and the order they come in don't matter, so the same parts in another document hit the same entry, and on a hit
+// the stored placements are handed out to the current rects of each size. Entries hold everything the key is made
+// from and it's all compared, so a hash collision is a miss rather than a wrong packing. Entries that couldn't be
+// written only show up in write_failures, the packing is still returned.
+class PackingCache {
+    public:
+    char                directory[kMaxPackingCachePath];
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+    std::atomic<size_t> write_failures;
+    PackingCache(const char *directory);
+
+    // Path of the entry for key. Returns false when it doesn't fit in kMaxPackingCachePath
+    bool EntryPath(uint64_t key, char *path);
+};
+
+// Packs like PackBins, or like PackBinsSearch when search_seconds is more than 0, but reuses the packing the cache
+// has for the same sizes and stores it when there isn't one. cache can be NULL to always pack. Packings in the Given
+// order depend on the order of the rects so they're never cached. out_of_space is set like PackBins, for cached
+// packings too
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsCached(
+        PackingCache *cache,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        float search_seconds,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+);
+
+#endif
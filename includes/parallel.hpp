@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <thread>
+
+// The most threads a single ParallelFor will use no matter how many cores there are
+constexpr size_t kMaxParallelThreads = 64;
+
+// Below this many items per chunk it isn't worth paying for a thread
+constexpr size_t kDefaultParallelChunk = 4096;
+
+// How many chunks ParallelFor splits count items into. There's one chunk per hardware thread unless that would make
+// the chunks smaller than min_chunk, so small inputs run in a single chunk on the calling thread.
+inline size_t ParallelChunkCount(size_t count, size_t min_chunk) {
+    size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, kMaxParallelThreads);
+
+    size_t chunks = std::max<size_t>(1, count / std::max<size_t>(1, min_chunk));
+    return std::min<size_t>(threads, chunks);
+}
+
+// Start of a chunk of count items split into chunks pieces. The end of a chunk is the start of the next one
+inline size_t ParallelChunkStart(size_t count, size_t chunks, size_t chunk) {
+    return count * chunk / chunks;
+}
+
+// Splits [0, count) into ParallelChunkCount chunks and calls fn(chunk, start, end) for each of them, one thread per
+// chunk with the calling thread taking the first. Returns once every chunk is done. Chunks are numbered in order so
+// callers can keep per chunk results in an array and combine them afterwards, e.g. for a prefix sum.
+template <typename F>
+void ParallelFor(size_t count, size_t min_chunk, F fn) {
+    size_t chunks = ParallelChunkCount(count, min_chunk);
+
+    std::thread threads[kMaxParallelThreads];
+    for (size_t chunk=1; chunk<chunks; chunk++) {
+        threads[chunk] = std::thread(fn, chunk, ParallelChunkStart(count, chunks, chunk), ParallelChunkStart(count, chunks, chunk + 1));
+    }
+
+    fn((size_t)0, (size_t)0, ParallelChunkStart(count, chunks, 1));
+
+    for (size_t chunk=1; chunk<chunks; chunk++) {
+        threads[chunk].join();
+    }
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include "ds.hpp"
+#include "geometry.hpp"
+
+// Alongside the D2D geometry, PathBuilder records every path as a stream of floats so the path can be worked
+// with on the CPU. Each command is its letter followed by its arguments:
+//
+//   M x y
+//   L x y
+//   C c1x c1y c2x c2y x y
+//   A x y rx ry rotation direction    always the large arc, same as PathBuilder::Arc
+//   Z                                 closes the figure back to the last M
+constexpr float kPathCommandMove   = (float) 'M';
+constexpr float kPathCommandCubic  = (float) 'C';
+constexpr float kPathCommandLine   = (float) 'L';
+constexpr float kPathCommandArc    = (float) 'A';
+constexpr float kPathCommandClose  = (float) 'Z';
+
+constexpr float kClockwise = 1.0f;
+constexpr float kCounterClockwise = 0.0f;
+
+// Max distance between a flattened segment and the curve it replaces, in screen pixels. Matches D2D's default
+constexpr float kFlattenTolerance = 0.25f;
+
+// Cubics are gathered into batches this big before PathBounds solves for their extrema
+constexpr size_t kCubicBatchSize = 64;
+
+// Keeps a single huge or badly scaled curve from producing an unbounded number of segments
+constexpr size_t kMaxCurveSegments = 1024;
+
+// Zoomed out shapes are drawn from flattened polylines instead of the full geometry. Each level of detail
+// flattens with a tolerance kLodLevelStep times coarser than the level before it, starting at
+// kLodFinestTolerance which is in document units (inches)
+constexpr size_t kLodLevels          = 4;
+constexpr float  kLodFinestTolerance = 0.005f;
+constexpr float  kLodLevelStep       = 4.0f;
+constexpr size_t kNoLod              = kLodLevels;
+
+// SegmentStore holds line segments as four float columns, the same way BoundsStore holds bounds, so the
+// distance kernel can work on a batch of segments per instruction.
+class SegmentStore {
+    public:
+    DynamicArray<float> x0;
+    DynamicArray<float> y0;
+    DynamicArray<float> x1;
+    DynamicArray<float> y1;
+    SegmentStore(size_t capacity);
+
+    void Free();
+
+    void Push(Vec2 from, Vec2 to);
+    size_t Length();
+    void Clear();
+};
+
+// Appends the segments approximating the path to out. Every point is put through transform and the result is
+// within tolerance of the transformed path, so the tolerance is in the units the transform maps to.
+void FlattenPath(DynamicArray<float>* commands, Mat3x2 transform, float tolerance, SegmentStore* out);
+
+// Returns the exact bounds of the transformed path. Cubics and arcs contribute their extrema rather than their
+// control points so curved shapes aren't padded out
+Rect PathBounds(DynamicArray<float>* commands, Mat3x2 transform);
+
+float LodTolerance(size_t level);
+
+// Returns the coarsest level whose tolerance is no more than tolerance, or kNoLod when even the finest level
+// is too coarse and the full geometry should be drawn instead
+size_t LodLevel(float tolerance);
+
+// Returns the squared distance from point to the closest segment or infinity when there are none
+float SegmentsDistanceSquared(SegmentStore* segments, Vec2 point);
+
+#endif
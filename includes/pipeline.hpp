@@ -1,13 +1,40 @@
+#include "filter.hpp"
 #include "sviggy.hpp"
 
+#include <stdint.h>
+
+class IncrementalPacker;
+class NestCache;
+class PackingCache;
+
 enum class PipelineActionType {
     Filter,
     Layout,
+    Collect,
+    Nest,
+};
+
+class PipelineLayout {
+    public:
+    DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins;
+    float                                          search_seconds; // 0 packs once, see PackBinsSearch otherwise
+};
+
+// Defaults for the nest stage when the spec leaves them out
+constexpr float  kDefaultNestSeconds   = 5.0f;
+constexpr size_t kDefaultNestRotations = 4;
+
+class PipelineNest {
+    public:
+    DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins;
+    float                                          seconds;   // See NestOptions
+    size_t                                         rotations;
 };
 
 union PipelineActionValue {
-    DynamicArrayEx<TagId, LinearAllocatorPool>    filter_tags;
-    DynamicArrayEx<Vec2Many, LinearAllocatorPool> layout_bins;
+    FilterProgram  filter;
+    PipelineLayout layout;
+    PipelineNest   nest;
 };
 
 class PipelineAction {
@@ -16,20 +43,103 @@ class PipelineAction {
     PipelineActionValue value;
     PipelineAction(PipelineActionType type, PipelineActionValue value) : type(type), value(value) {};
 
-    static PipelineAction Filter(DynamicArrayEx<TagId, LinearAllocatorPool> tags);
+    static PipelineAction Filter(FilterProgram filter);
     static PipelineAction Layout(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins);
+
+    // Spends up to search_seconds trying other packings on every core and keeps the one with the fewest bins
+    static PipelineAction Layout(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float search_seconds);
+
+    // Recollects the shapes with Paths::AutoCollect
+    static PipelineAction Collect();
+
+    // Lays collections out by their outlines instead of their bounds, see NestParts
+    static PipelineAction Nest(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float seconds, size_t rotations);
+
+    // Hash of the type and parameters, combined with the key of whatever the action runs on
+    uint64_t Key(uint64_t input_key);
 };
 
+// Keys are HashBytes over the raw bytes of the parameters, chained through the key of the input
+constexpr uint64_t kPipelineHashSeed = kHashBytesSeed;
+
+// Input of a stage that reads straight from the document instead of another stage
+constexpr size_t kPipelineSource = std::numeric_limits<size_t>::max();
+
+// Room for the parameters of the actions. They live as long as the pipeline so stages can be rerun
+constexpr size_t kPipelineParamsPoolSize = 4096;
+
+// A stage runs one action on the output of its input stage and keeps the result around. The key is a hash of
+// everything the output depends on, so as long as the key computed for a run matches the stored one the
+// output can be reused as is.
+class PipelineStage {
+    public:
+    PipelineAction     action;
+    size_t             input; // Index of the stage feeding this one or kPipelineSource
+    uint64_t           key;
+    bool               computed;
+    Paths              output;
+    size_t             unplaced; // Collections the last run of a layout stage couldn't fit, see RunLayout
+    IncrementalPacker* packer; // Packing kept between runs of a layout stage, made the first time it runs
+    NestCache*         nfps;   // No-fit polygons kept between runs of a nest stage, made the first time it runs
+    PipelineStage(PipelineAction action, size_t input);
+
+    void Free();
+};
+
+// PipelineActions is a DAG of stages where every stage reads from one earlier stage or the document. Run only
+// recomputes the stages whose key changed, which is any stage whose parameters were edited plus everything
+// downstream of it, or everything when the document itself changed. The last stage is what gets shown.
 class PipelineActions {
     public:
-    DynamicArrayEx<PipelineAction, LinearAllocatorPool> actions;
-    PipelineActions() {};
+    LinearAllocatorPool         allocator; // Holds the action parameters
+    DynamicArray<PipelineStage> stages;
+    uint64_t                    shown_key;     // Key of the output last copied into the document's pipeline shapes
+    PackingCache*               packing_cache; // Shared with other pipelines, layouts reuse packings from it. Can be NULL
+    PipelineActions();
+
+    void Free();
 
-    void Run(Document* input_doc, DXState* dx, LinearAllocatorPool* allocator);
+    // Adds a stage reading from the stage before it, or from the document for the first stage
+    size_t Push(PipelineAction action);
+    size_t Push(PipelineAction action, size_t input);
+
+    // Replaces the parameters of a stage. Nothing is recomputed until the next Run
+    void SetFilter(size_t stage, FilterProgram filter);
+    void SetLayout(size_t stage, DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float search_seconds);
+
+    void Run(Document* input_doc, LinearAllocatorPool* allocator);
+
+    // Only runs and shows up to the first stage_count stages. Stages only read from earlier ones so they never need
+    // the stages after them
+    void Run(Document* input_doc, LinearAllocatorPool* allocator, size_t stage_count);
 };
 
-void RunFilter(Document* input_doc, DXState* dx, LinearAllocatorPool* allocator, DynamicArrayEx<TagId, LinearAllocatorPool>* tags);
-void RunLayout(Document* input_doc, DXState* dx, LinearAllocatorPool* allocator, DynamicArrayEx<Vec2Many, LinearAllocatorPool>* bins);
+// Adds the stages written in spec to pipeline, one stage per line:
+//
+//     # comments and blank lines are skipped
+//     collect
+//     filter Bound and not Engrave
+//     layout 48x24 24x12*3
+//     layout 48x24 search 2
+//     nest 48x24 rotations 2 seconds 10
+//
+// Filters look their tags up in the document they run on, see filter.hpp. Layout bins are WIDTHxHEIGHT in inches with an
+// optional *QUANTITY, and bins without a quantity can be used as many times as needed. A layout can end with
+// search SECONDS to spend that long looking for a packing with fewer bins. Nest takes the same bins followed by
+// rotations 1, 2 or 4 and seconds SECONDS in any order, which default to kDefaultNestRotations and
+// kDefaultNestSeconds. Prints the first line that can't be read and returns false.
+bool BuildPipelineFromSpec(char *spec, PipelineActions *pipeline);
+
+// Returns a new Paths with only the paths that pass the filter. Tag names are looked up in tag_ids, the index of the
+// TagGod of the document the paths came from
+Paths RunFilter(Paths* paths, FilterProgram* filter, HashMap<String, size_t>* tag_ids);
+
+// Packer can be NULL to pack from scratch every time and cache can be NULL to always pack. Returns how many
+// collections didn't fit in the bins, those stay where they were
+size_t RunLayout(Paths* paths, LinearAllocatorPool* allocator, PipelineLayout* layout, IncrementalPacker* packer, PackingCache* cache);
+
+// Nests every collection by the outlines of its shapes. cache holds the no-fit polygons and can't be NULL
+void RunNest(Paths* paths, LinearAllocatorPool* allocator, PipelineNest* nest, NestCache* cache);
 
 struct CollectionBounds {
     DynamicArrayEx<RectNamed, LinearAllocatorPool> array;
@@ -37,6 +147,6 @@ struct CollectionBounds {
 };
 
 CollectionBounds GetCollectionBounds(
-    Document *doc,
+    Paths *paths,
     LinearAllocatorPool *allocator
 );
\ No newline at end of file
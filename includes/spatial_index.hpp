@@ -0,0 +1,77 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include "bounds.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+
+constexpr size_t kNullNode = std::numeric_limits<size_t>::max();
+
+class SpatialNode {
+    public:
+    float minx, miny, maxx, maxy;
+    size_t parent;
+    size_t left, right; // Both are kNullNode for leaves
+    size_t item; // Only set for leaves. The index of the bound the leaf was created for
+    size_t height; // 0 for leaves, one more than the taller child otherwise
+
+    bool IsLeaf() {
+        return this->left == kNullNode;
+    }
+};
+
+// SpatialIndex is a bounding volume hierarchy over a set of bounds. Each bound gets a leaf and every internal
+// node holds the union of its two children, so queries only walk the branches that can overlap the query area.
+//
+// The tree is bulk loaded with Build which orders the leaves using sort tile recursive (STR) packing so that
+// neighbouring leaves end up under the same parents. After that it's kept up to date with Insert, Remove and
+// Update which only touch the path from the leaf to the root, rotating nodes on the way back up like Box2D's dynamic
+// tree so inserting and removing over and over doesn't turn the tree into a long chain.
+//
+// Leaf ids don't change once created, even through Update, so callers can hold on to them.
+class SpatialIndex {
+    public:
+    DynamicArray<SpatialNode> nodes;
+    DynamicArray<size_t>      free_nodes; // Nodes that were removed and can be handed out again
+    size_t                    root;
+    bool                      built; // Set once Build has run. Insert / Remove / Update are only valid after
+    SpatialIndex(size_t estimated_items);
+
+    // Constructor for clone
+    SpatialIndex(DynamicArray<SpatialNode> nodes, DynamicArray<size_t> free_nodes, size_t root, bool built) :
+        nodes(nodes),
+        free_nodes(free_nodes),
+        root(root),
+        built(built) {};
+
+    void Free();
+
+    // Throws away the current tree and bulk loads a leaf for every entry in bounds. leaves gets set to
+    // the leaf id for each entry, so leaves[i] is the leaf for bounds entry i
+    void Build(BoundsStore* bounds, DynamicArray<size_t>* leaves);
+
+    // Returns the id of the new leaf
+    size_t Insert(size_t item, Rect bound);
+    void Remove(size_t leaf);
+    void Update(size_t leaf, Rect bound);
+
+    // Changes which item a leaf points at. Used when the item moves to a different index
+    void SetItem(size_t leaf, size_t item);
+
+    // The queries push the item of every matching leaf into out. Order is not guaranteed
+    void QueryIntersecting(Rect area, DynamicArray<size_t>* out);
+    void QueryContainedBy(Rect area, DynamicArray<size_t>* out);
+    void QueryPoint(Vec2 point, float tolerance, DynamicArray<size_t>* out);
+
+    SpatialIndex Clone();
+
+    // Internal helpers for maintaining the tree
+    size_t AllocNode();
+    void FreeNode(size_t node);
+    void InsertLeaf(size_t leaf);
+    void DetachLeaf(size_t leaf);
+    void Refit(size_t node);
+    size_t Balance(size_t node);
+};
+
+#endif
@@ -6,6 +6,8 @@
 #include "ds.hpp"
 #include "sviggy.hpp"
 
+class BatchLayout;
+
 class ViewPort {
     public:
     float uupix, uupiy;
@@ -18,7 +20,9 @@ ShapeData ParseTagLine(pugi::xml_node_iterator node, ViewPort *viewport, DXState
 ShapeData ParseTagPath(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx);
 ShapeData ParseTagPolygon(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx);
 ShapeData ParseTagRect(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx);
+#ifndef SVIGGY_HEADLESS
 Text ParseTagText(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx);
+#endif
 
 // Generic Parsing Methods
 bool IsAlphabetical(char c);
@@ -32,7 +36,21 @@ char* SkipChar(char *str, char ch);
 float RoundFloatingInput(float x);
 
 void AddNodesToDocument(ViewPort *viewport, pugi::xml_object_range<pugi::xml_node_iterator> nodes, Document *doc, DXState *dx);
-void LoadSVGFile(char *file, Document *doc, DXState *dx);
+void AssignClassTags(pugi::xml_node_iterator node, Document *doc, PathId id);
+
+// Prints why and returns false when the file can't be loaded. dx can be null in headless builds
+bool LoadSVGFile(char *file, Document *doc, DXState *dx);
+
+// Same as LoadSVGFile for an svg that's already in memory. name is only used in messages
+bool LoadSVGBuffer(char *data, size_t length, char *name, Document *doc, DXState *dx);
+
+// Writes every path with its transformation, in document units
+String PathData(DynamicArray<float> *commands);
+bool WriteSVGFile(char *file, Paths *paths);
+
+// Writes one sheet of a batch the size of the sheet, with every collection placed on it in a group that names the
+// document and collection it came from. documents are the paths the batch moved the collections in
+bool WriteSVGSheet(char *file, BatchLayout *batch, size_t sheet, Paths **documents, char **names);
 
 // Parsing Path Command Methods
 void ParsePathCmdMove(PathBuilder *builder, ViewPort *viewport, char **path, Vec2 *pos, bool relative);
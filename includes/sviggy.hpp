@@ -1,18 +1,33 @@
 #ifndef SVIGGY_H
 #define SVIGGY_H
 
+#ifndef SVIGGY_HEADLESS
 #include <d3d11.h>
 #include <dxgi.h>
 #include <dwrite.h>
 #include <d2d1.h>
 #include <d2d1_1.h>
 #include <d2d1_2.h>
+#else
+// Headless builds keep the same classes with the Direct2D interfaces left opaque. Pointers to them are always
+// null and everything that would create or release them is compiled out
+struct ID2D1Geometry;
+struct ID2D1GeometryRealization;
+struct ID2D1GeometrySink;
+struct ID2D1PathGeometry;
+struct ID2D1TransformedGeometry;
+#endif
 #include <string>
 #include <unordered_map>
 
 #include <system_error>
 
+#include "bounds.hpp"
 #include "ds.hpp"
+#include "geometry.hpp"
+#include "path.hpp"
+#include "spatial_index.hpp"
+#include "transform.hpp"
 
 #define RETURN_FAIL(hr) if(FAILED(hr)) return hr
 // Subtract 1 from array size to avoid the null terminating character for b
@@ -26,106 +41,13 @@ constexpr float kScaleDelta = 0.15;
 constexpr float kTranslationDelta = 1;
 constexpr float kHairline = 0.03;
 
+// How far away from a shape's bounds a click can be, in screen pixels, and still be tested against the shape
+constexpr float kSelectionTolerance = 1.0f;
+
 // forward declarations
 class DXState;
 
-class Vec2 {
-    public:
-    float x,y;
-    Vec2(float x, float y);
-    Vec2(D2D1_POINT_2F p);
-
-    static Vec2 Min();
-    static Vec2 Max();
-
-    D2D1_POINT_2F D2Point();
-    D2D1_SIZE_F Size();
-    bool Fits(Vec2 other);
-
-    Vec2 operator+(Vec2 &b);
-    Vec2& operator+=(Vec2 &b);
-    Vec2 operator-(Vec2 &b);
-    Vec2& operator-=(Vec2 &b);
-
-    Vec2 operator-();
-    Vec2 operator/(float b);
-};
-
-class Vec2Many {
-    public:
-    Vec2 vec2;
-    float quantity; // float is a quantity so we can represent infinity
-    Vec2Many(Vec2 vec2, float quantity);
-};
-
-class Vec2Named {
-    public:
-    Vec2 vec2;
-    size_t id;
-    Vec2Named(Vec2 vec2, size_t id);
-};
-
-class Rect {
-    public:
-    Vec2 pos, size;
-    Rect(Vec2 pos, Vec2 size);
-    Rect(D2D1_RECT_F* rect);
-
-    float Left();
-    float Top();
-    float Right();
-    float Bottom();
-
-    float Width();
-    float Height();
-
-    bool Contains(Rect *other);
-
-    Rect Union(Rect* other);
-    D2D1_RECT_F D2Rect();
-};
-
-class RectNamed {
-    public:
-    Rect rect;
-    size_t id;
-    RectNamed(Rect rect, size_t id);
-
-    float Left();
-    float Top();
-    float Right();
-    float Bottom();
-};
-
-// Sorts the rect by its position in the x direction and then the y direction.
-// If two rects are in the same position then the larger rect will end up first.
-// This ensures that a rect containing another one will appear first
-template <typename T>
-bool SortRectPositionXY(T& a, T& b) {
-    if (a.Left() != b.Left()) {
-        return a.Left() < b.Left();
-    }
-
-    if (a.Top() != b.Top()) {
-        return a.Top() < b.Top();
-    }
-
-    if (a.Right() != b.Right()) {
-        return a.Right() > b.Right();
-    }
-
-    return a.Bottom() > b.Bottom();
-}
-
-class Transformation {
-    public:
-    Vec2 translation;
-    Vec2 scale;
-    float rotation;
-    Transformation();
-    D2D1::Matrix3x2F Matrix(Vec2 center);
-};
-
+#ifndef SVIGGY_HEADLESS
 class Text {
     public:
     Vec2 pos;
@@ -140,14 +62,7 @@ class Text {
     float X();
     float Y();
 };
-
-constexpr float kPathCommandMove   = (float) 'M';
-constexpr float kPathCommandCubic  = (float) 'C';
-constexpr float kPathCommandLine   = (float) 'L';
-constexpr float kPathCommandArc    = (float) 'A';
-
-constexpr float kClockwise = 1.0f;
-constexpr float kCounterClockwise = 0.0f;
+#endif
 
 typedef size_t PathId;
 typedef size_t CollectionId;
@@ -155,17 +70,26 @@ typedef size_t TagId;
 
 class ShapeData {
     public:
-    Transformation transform;
     ID2D1Geometry* geometry;
-    ShapeData(ID2D1Geometry* geometry);
+    DynamicArray<float> commands; // The same path as geometry recorded as commands, see path.hpp
+    ShapeData(ID2D1Geometry* geometry, DynamicArray<float> commands);
+};
 
-    D2D1_MATRIX_3X2_F TransformMatrix();
+// The stroked realizations of a shape at each level of detail, see LodLevel in path.hpp. A level is built from
+// the flattened path the first time the shape is drawn at it and dropped whenever the transformation changes
+class LodSet {
+    public:
+    ID2D1GeometryRealization* levels[kLodLevels];
+    LodSet();
+
+    void Release();
 };
 
 class PathBuilder {
     public:
     ID2D1GeometrySink *geometry_sink;
     ID2D1PathGeometry *geometry;
+    DynamicArray<float> commands;
     bool has_open_figure;
     PathBuilder(DXState *dx);
 
@@ -176,7 +100,7 @@ class PathBuilder {
     void Move(Vec2 to);
     void Line(Vec2 to);
     void Cubic(Vec2 c1, Vec2 c2, Vec2 end);
-    void Arc(Vec2 end, Vec2 size, float rot, D2D1_SWEEP_DIRECTION direction);
+    void Arc(Vec2 end, Vec2 size, float rot, float direction); // direction is kClockwise or kCounterClockwise
     void Close();
     ShapeData BuildPath(DXState *dx);
 };
@@ -236,6 +160,11 @@ class Collections {
 
     void SetCollection(PathId shape_id, CollectionId collection_id);
 
+    // Reset and AddToCollection are for rebuilding every collection at once. Reset drops all of the
+    // collections and AddToCollection puts a shape that currently has no collection into one.
+    void Reset();
+    void AddToCollection(PathId shape_id, CollectionId collection_id);
+
     void RemovePath(PathId id);
 
     Collections Clone();
@@ -244,20 +173,40 @@ class Collections {
 class Paths {
     public:
     DynamicArray<ShapeData>                 shapes;
-    DynamicArray<ID2D1TransformedGeometry*> transformed_geometries; // Entries can be null before being rendered
-    DynamicArray<ID2D1GeometryRealization*> low_fidelities; // Entries can be null before being rendered. Entries are always null for pipeline shapes
+    DynamicArray<ID2D1TransformedGeometry*> transformed_geometries; // Null until first drawn at full detail and again whenever the transform changes
+    DynamicArray<LodSet>                    lods; // Levels are null until they're first drawn and again whenever the transform changes
+    BoundsStore                             original_bounds; // Bounds of the untransformed geometry, computed once when the path is added
+    DynamicArray<Vec2>                      centers; // Center of the untransformed geometry that transformations are applied around
+    MatrixStore                             transforms; // The full transformation of each path, everything else about the transform is derived from it
+    BoundsStore                             bounds; // Bounds of the transformed geometry. Only valid when the matching bounds_dirty entry is false
+    DynamicArray<bool>                      bounds_dirty; // Set when the transform changes so the bounds get recomputed on the next read
+    DynamicArray<PathId>                    dirty_bounds; // Every path marked in bounds_dirty so UpdateBounds doesn't have to scan for them
+    SpatialIndex                            spatial_index; // Tree over the transformed bounds. Leaf items are indexes into the above arrays
+    DynamicArray<size_t>                    spatial_leaves; // Leaf in the spatial index for each path. Only valid once the index has been built
     HashMap<PathId, size_t>                 index; // maps path id to index in one of the above arrays
     DynamicArray<PathId>                    reverse_index; // maps an index in one of the above arrays to a path id
     Collections                             collections;
     Tags                                    tags;
     PathId                                  next_id;
+
+    // Bumped by every change to the paths so anything derived from them (like the pipeline stages) can tell when
+    // it's out of date. Changes made directly to collections or tags have to bump it themselves
+    size_t revision = 0;
     Paths(size_t estimated_cap);
 
     // Constructor for cloning
     Paths(
         DynamicArray<ShapeData> shapes,
         DynamicArray<ID2D1TransformedGeometry*> transformed_geometries,
-        DynamicArray<ID2D1GeometryRealization*> low_fidelities,
+        DynamicArray<LodSet> lods,
+        BoundsStore original_bounds,
+        DynamicArray<Vec2> centers,
+        MatrixStore transforms,
+        BoundsStore bounds,
+        DynamicArray<bool> bounds_dirty,
+        DynamicArray<PathId> dirty_bounds,
+        SpatialIndex spatial_index,
+        DynamicArray<size_t> spatial_leaves,
         HashMap<PathId, size_t> index,
         DynamicArray<PathId> reverse_index,
         Collections collections,
@@ -265,7 +214,15 @@ class Paths {
         PathId next_id
     ) : shapes(shapes),
         transformed_geometries(transformed_geometries),
-        low_fidelities(low_fidelities),
+        lods(lods),
+        original_bounds(original_bounds),
+        centers(centers),
+        transforms(transforms),
+        bounds(bounds),
+        bounds_dirty(bounds_dirty),
+        dirty_bounds(dirty_bounds),
+        spatial_index(spatial_index),
+        spatial_leaves(spatial_leaves),
         index(index),
         reverse_index(reverse_index),
         collections(collections),
@@ -283,20 +240,61 @@ class Paths {
 
     size_t Length();
 
-    void RealizeGeometry(DXState *dx, PathId id);
-    void RealizeHighFidelityGeometry(DXState *dx, PathId id);
+    // Realizations are made when a shape is drawn, so only shapes that end up on screen ever pay for them.
+    // Changing a transform releases the shape's realizations and the next draw makes them again
+    #ifndef SVIGGY_HEADLESS
+    ID2D1TransformedGeometry* RealizedGeometry(DXState *dx, size_t index);
+    #endif
+    void ReleaseRealizations(size_t index);
 
-    void RealizeAllGeometry(DXState *dx);
-    void RealizeAllHighFidelityGeometry(DXState *dx);
+    // Takes over the realizations of from's shapes that are also in these paths with the same geometry and
+    // transform, so a new copy of mostly the same shapes doesn't have to realize them all again
+    void AdoptRealizations(Paths *from);
 
     ShapeData* GetShapeData(PathId id);
     ID2D1TransformedGeometry** GetTransformedGeometry(PathId id);
-    ID2D1GeometryRealization** GetLowFidelity(PathId id);
+    Mat3x2 GetTransformMatrix(PathId id);
+
+    // The transformation as parameters around the path's center, for editing
+    Transformation GetTransform(PathId id);
+
     Rect GetBounds(PathId id);
+    Rect GetBoundsAtIndex(size_t index);
+
+    // Recomputes every dirty bound. Needs to be called before running any of the batch kernels on the bounds store
+    void UpdateBounds();
 
+    // The spatial index gets bulk loaded the first time it's queried, or by calling BuildSpatialIndex
+    // directly after adding a batch of paths. After that it's updated along with the paths, except by ApplyMatrix
+    // which leaves it to be bulk loaded again by the next query.
+    void BuildSpatialIndex();
+    void UpdateSpatialIndex();
+
+    // The queries push the index of every matching path into out
+    void QueryIntersecting(Rect area, DynamicArray<size_t>* out);
+    void QueryContainedBy(Rect area, DynamicArray<size_t>* out);
+    void QueryPoint(Vec2 point, float tolerance, DynamicArray<size_t>* out);
+
+    // All transform changes should go through these so the cached bounds stay up to date
     void SetTransform(PathId id, Transformation transform);
+    void SetTransformMatrix(PathId id, Mat3x2 matrix);
+
+    // Composes matrix onto the current transformation of every path in ids. Translations move the cached
+    // bounds along with the paths instead of recomputing them, and the spatial index is bulk loaded again by the
+    // next query
+    void ApplyMatrix(PathId* ids, size_t count, Mat3x2 matrix);
+
+    void MarkBoundsDirty(size_t index);
 
     Paths Clone();
+
+    // Builds a new Paths holding only the paths whose entry in keep is set, in their current order. The flat
+    // arrays are copied in parallel and the spatial index is left to be bulk loaded when it's first needed.
+    // Like Clone the new Paths shares the path geometry and has no realizations of its own
+    Paths Compact(bool* keep);
+
+    // Puts every path into the collection of the smallest path whose bounds contain it, see FindContainers
+    void AutoCollect();
 };
 
 enum class ShapeType {
@@ -322,10 +320,13 @@ class View {
     Vec2 GetDocumentPosition(Vec2 screen_pos);
     Vec2 MousePos();
     void ScrollZoom(bool in);
+    Rect VisibleArea(Vec2 screen_size);
+    #ifndef SVIGGY_HEADLESS
     D2D1::Matrix3x2F ScaleMatrix();
     D2D1::Matrix3x2F TranslationMatrix();
     D2D1::Matrix3x2F DocumentToScreenMat();
     D2D1::Matrix3x2F ScreenToDocumentMat();
+    #endif
 };
 
 class Shape {
@@ -337,10 +338,16 @@ class Shape {
 
 // Forward declarion for the Document
 class Application;
+class BatchLayout;
+class PackingCache;
+class PipelineActions;
+class PipelineLayout;
 
 class Document {
     public:
+    #ifndef SVIGGY_HEADLESS
     DynamicArray<Text> texts;
+    #endif
     Paths paths;
     DynamicArray<ActiveShape> active_shapes;
 
@@ -351,6 +358,10 @@ class Document {
     // it doesn't make sense to do the expensive low fidelity realizations
     Paths pipeline_shapes;
 
+    // Made the first time the pipeline runs on the document. Its filters are compiled against this document's
+    // tags and it's kept between runs so rerunning only recomputes the stages that changed
+    PipelineActions* pipeline;
+
     View view;
     size_t next_id = 0;
     size_t next_collection = 0;
@@ -358,7 +369,7 @@ class Document {
 
     void Free();
 
-    void AddNewPath(ShapeData p);
+    PathId AddNewPath(ShapeData p);
     void AssignTag(PathId id, String tag);
 
     void SelectShape(Vec2 screen_pos);
@@ -385,6 +396,10 @@ class Application {
     Document* ActiveDoc();
     View* ActiveView();
     void ActivateDoc(size_t index);
+
+    // Packs the collections of every open document together onto shared sheets, see RunBatchLayout. Each
+    // document's pipeline shapes are replaced with its paths moved onto the sheets. cache can be NULL
+    BatchLayout LayoutDocuments(PipelineLayout *layout, PackingCache *cache, LinearAllocatorPool *allocator);
 };
 
 class UIState {
@@ -397,6 +412,7 @@ class UIState {
 };
 
 
+#ifndef SVIGGY_HEADLESS
 class DXState {
     public:
     // Device Independent Direct2D resources
@@ -436,8 +452,10 @@ class DXState {
     HRESULT Resize(UINT width, UINT height);
     HRESULT Render(Document *doc,  UIState *ui);
     void RenderPaths(Document *doc);
-    void RenderPathsLowFidelity(Paths *paths);
-    void RenderPathsHighFidelity(Paths *paths);
+    void RenderPathsAtScale(Paths *paths, View *view);
+    void RenderPathsLod(Paths *paths, DynamicArray<size_t>* visible, size_t level);
+    void RenderPathsHighFidelity(Paths *paths, DynamicArray<size_t>* visible);
+    void FindVisiblePaths(Paths *paths, View *view, DynamicArray<size_t>* visible);
     void RenderText(Document *doc);
     void RenderPipeline(Document *doc);
     void RenderGridLines();
@@ -454,10 +472,8 @@ void CreateGuiContext();
 void TeardownGui();
 void ExitOnFailure(HRESULT hr);
 
-Vec2 GeometryCenter(ID2D1Geometry* geometry);
-Transformation GetTranslationTo(Vec2 to, Rect* from);
-Rect GetBounds(ID2D1TransformedGeometry* geo);
-void CreateHighFidelityRealization(ShapeData* shape, ID2D1TransformedGeometry** transformed_geometry, DXState *dx);
-void CreateGeometryRealizations(ShapeData* shape, ID2D1TransformedGeometry** transformed_geometry, ID2D1GeometryRealization** low_fidelity, DXState *dx);
+void CreateTransformedGeometry(ShapeData* shape, Mat3x2 transform, ID2D1TransformedGeometry** transformed_geometry, DXState *dx);
+void CreateLodRealization(ShapeData* shape, Mat3x2 transform, size_t level, ID2D1GeometryRealization** realization, SegmentStore* scratch, DXState *dx);
+#endif
 
 #endif
\ No newline at end of file
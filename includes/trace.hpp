@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Scoped timing zones for profiling. Put TRACE_ZONE("name") or TRACE_FUNCTION() at the top of a scope and the
+// time until the end of the scope is recorded on the current thread. WriteTraceFile dumps everything recorded so
+// far as Chrome trace JSON, which opens in Perfetto or chrome://tracing.
+//
+// Building with SVIGGY_NO_TRACE compiles the zones out entirely, which is what build-release.ps1 does.
+//
+// Names are kept as pointers, so they have to be string literals or otherwise live for the whole program.
+
+// Events each thread keeps. Once a thread has recorded more than this the oldest events are overwritten
+constexpr size_t kTraceBufferEvents = 1 << 16;
+
+class TraceEvent {
+    public:
+    const char *name;
+    uint64_t   start;    // Nanoseconds since the first zone in the program
+    uint64_t   duration; // Nanoseconds
+};
+
+// A single producer ring of events. Only the thread that owns the buffer writes to it so recording doesn't take any
+// locks. head is the number of events ever written and is published after the event itself, so a reader that loads
+// head sees every event before it fully written.
+class TraceBuffer {
+    public:
+    TraceEvent            events[kTraceBufferEvents];
+    std::atomic<uint64_t> head;
+    size_t                id; // Shows up as the thread id in the trace
+    TraceBuffer(size_t id) : head(0), id(id) {};
+
+    void Push(const char *name, uint64_t start, uint64_t duration);
+};
+
+uint64_t TraceNow();
+
+// The buffer of the current thread, made the first time the thread records anything. Threads that exit hand their
+// buffer to the next thread that starts recording, so short lived worker threads don't each cost a new buffer
+TraceBuffer* ThreadTraceBuffer();
+
+// Writes every buffer as Chrome trace JSON. Zones can keep being recorded while this runs, events that are
+// overwritten while they're being copied are left out. Returns false when the file can't be written
+bool WriteTraceFile(char *file);
+
+class TraceZone {
+    public:
+    const char *name;
+    uint64_t   start;
+    TraceZone(const char *name) : name(name), start(TraceNow()) {};
+    ~TraceZone() {
+        uint64_t end = TraceNow();
+        ThreadTraceBuffer()->Push(this->name, this->start, end - this->start);
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef SVIGGY_NO_TRACE
+#define TRACE_ZONE(name)
+#else
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+#endif
+
+#define TRACE_FUNCTION() TRACE_ZONE(__func__)
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "ds.hpp"
+#include "geometry.hpp"
+
+// Transformation is the editable form of a transform: a scale and rotation around the shape's center followed
+// by a translation. Paths store the composed matrix instead, Transformation is only for building one from
+// parameters and for showing a matrix as parameters again.
+class Transformation {
+    public:
+    Vec2 translation;
+    Vec2 scale;
+    float rotation; // degrees
+    Transformation();
+
+    Mat3x2 Matrix(Vec2 center);
+
+    // Splits a matrix built around center back into its parameters. Matrices with skew (a rotation composed
+    // with a non uniform scale applied after it) don't have an exact split and lose the skew.
+    static Transformation FromMatrix(Mat3x2 matrix, Vec2 center);
+};
+
+// MatrixStore keeps affine matrices as six float columns, the same layout BoundsStore uses for bounds, so a
+// matrix can be composed onto many of them per instruction. Entries are in the same order as the arrays in Paths.
+class MatrixStore {
+    public:
+    DynamicArray<float> m11;
+    DynamicArray<float> m12;
+    DynamicArray<float> m21;
+    DynamicArray<float> m22;
+    DynamicArray<float> dx;
+    DynamicArray<float> dy;
+    MatrixStore(size_t capacity);
+
+    // Constructor for clone
+    MatrixStore(DynamicArray<float> m11, DynamicArray<float> m12, DynamicArray<float> m21, DynamicArray<float> m22, DynamicArray<float> dx, DynamicArray<float> dy) :
+        m11(m11),
+        m12(m12),
+        m21(m21),
+        m22(m22),
+        dx(dx),
+        dy(dy) {};
+
+    void Free();
+
+    void Push(Mat3x2 matrix);
+    void Put(Mat3x2 matrix, size_t index);
+    Mat3x2 Get(size_t index);
+    void RemoveIndex(size_t index);
+    size_t Length();
+    void Clear();
+
+    // Sets the length of every column. New entries are uninitialized and have to be Put before being read
+    void Resize(size_t length);
+
+    MatrixStore Clone();
+};
+
+// Both compose matrix onto the end of the stored matrices, so each one becomes stored * matrix. An index that's in
+// indices more than once gets matrix composed that many times
+void ApplyMatrixRange(MatrixStore* store, size_t start, size_t count, Mat3x2 matrix);
+void ApplyMatrixIndexed(MatrixStore* store, size_t* indices, size_t count, Mat3x2 matrix);
+
+#endif
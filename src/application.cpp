@@ -1,13 +1,15 @@
 #include <algorithm>
+#ifndef SVIGGY_HEADLESS
 #include <d2d1.h>
+#endif
 #include <unordered_map>
 
+#include "batch.hpp"
 #include "bin_packing.hpp"
 #include "ds.hpp"
 #include "pipeline.hpp"
 #include "sviggy.hpp"
-
-#include <chrono>
+#include "trace.hpp"
 
 constexpr size_t kDefaultEstimatedShapes = 1000;
 
@@ -39,34 +41,63 @@ void Application::ActivateDoc(size_t index) {
     this->active_doc = index;
 }
 
+BatchLayout Application::LayoutDocuments(PipelineLayout *layout, PackingCache *cache, LinearAllocatorPool *allocator) {
+    auto documents = DynamicArrayEx<Paths*, LinearAllocatorPool>(this->documents.Length(), allocator);
+
+    // Starts from the paths like a pipeline would, keeping the realizations of shapes that end up where they were
+    for (auto &doc : this->documents) {
+        Paths shown = doc.paths.Clone();
+        shown.AdoptRealizations(&doc.pipeline_shapes);
+
+        doc.pipeline_shapes.FreeAndReleaseResources();
+        doc.pipeline_shapes = shown;
+
+        documents.Push(&doc.pipeline_shapes, allocator);
+    }
+
+    return RunBatchLayout(documents.Data(), documents.Length(), layout, cache, allocator);
+}
+
 Document::Document(size_t estimated_shapes) :
     paths(Paths(estimated_shapes)),
 
+    #ifndef SVIGGY_HEADLESS
     texts(DynamicArray<Text>(10)),
+    #endif
 
     active_shapes(DynamicArray<ActiveShape>(5)),
 
-    pipeline_shapes(Paths(estimated_shapes)) {};
+    pipeline_shapes(Paths(estimated_shapes)),
+    pipeline(NULL) {};
 
 void Document::Free() {
+    #ifndef SVIGGY_HEADLESS
     this->texts.FreeAll();
+    #endif
 
     this->paths.FreeAndReleaseResources();
     this->pipeline_shapes.Free();
 
+    if (this->pipeline) {
+        this->pipeline->Free();
+        delete this->pipeline;
+    }
+
     this->active_shapes.Free();
 }
 
-void Document::AddNewPath(ShapeData p) {
+PathId Document::AddNewPath(ShapeData p) {
     PathId id = this->paths.AddPath(p);
 
     this->paths.collections.CreateCollectionForShape(id);
+    return id;
 }
 
 void Document::AssignTag(PathId id, String tag) {
     TagId tag_id = this->tag_god.GetTagId(tag);
 
     this->paths.tags.AssignTag(id, tag_id);
+    this->paths.revision++;
 }
 
 void Document::SelectShapes(Vec2 mousedown, Vec2 mouseup) {
@@ -84,34 +115,50 @@ void Document::SelectShapes(Vec2 mousedown, Vec2 mouseup) {
 
     Rect selection = Rect(start, size);
 
-    for (auto i=0; i<this->paths.Length(); i++) {
-        Rect shape_bound = GetBounds(this->paths.transformed_geometries[i]);
-        if (selection.Contains(&shape_bound)) {
-            PathId path_id = this->paths.reverse_index[i];
-            this->active_shapes.Push(ActiveShape(path_id));
-        }
+    auto selected = DynamicArray<size_t>(10);
+    this->paths.QueryContainedBy(selection, &selected);
+
+    // The spatial index doesn't return the shapes in any particular order so sort them
+    // to keep the selection in document order
+    std::sort(selected.Data(), selected.End());
+
+    for (auto& index : selected) {
+        PathId path_id = this->paths.reverse_index[index];
+        this->active_shapes.Push(ActiveShape(path_id));
     }
+
+    selected.Free();
 }
 
 void Document::SelectShape(Vec2 screen_pos) {
     this->active_shapes.Clear();
 
-    D2D1_POINT_2F point = screen_pos.D2Point();
+    // A click hits a shape when it lands on the shape's hairline stroke. Only the shapes whose bounds are
+    // within that distance of the click are flattened and tested
+    Vec2 doc_pos         = this->view.GetDocumentPosition(screen_pos);
+    float pixel          = 1.0f / (this->view.scale * kPixelsPerInch);
+    float hit_distance   = std::max<float>(kSelectionTolerance * pixel, kHairline * 0.5f);
+    float flat_tolerance = kFlattenTolerance * pixel;
 
-    D2D1::Matrix3x2F doc_to_screen = this->view.DocumentToScreenMat();
+    auto candidates = DynamicArray<size_t>(10);
+    this->paths.QueryPoint(doc_pos, hit_distance, &candidates);
+    std::sort(candidates.Data(), candidates.End());
 
-    for (auto i=0; i<this->paths.Length(); i++) {
-        ID2D1TransformedGeometry* geo = this->paths.transformed_geometries[i];
-        BOOL contains_point;
+    auto segments = SegmentStore(64);
+    for (auto& i : candidates) {
+        ShapeData* shape = &this->paths.shapes[i];
 
-        HRESULT hr = geo->StrokeContainsPoint(point, kHairline, NULL, &doc_to_screen, &contains_point);
-        ExitOnFailure(hr);
+        segments.Clear();
+        FlattenPath(&shape->commands, this->paths.transforms.Get(i), flat_tolerance, &segments);
 
-        if (contains_point) {
+        if (SegmentsDistanceSquared(&segments, doc_pos) <= hit_distance * hit_distance) {
             size_t path_id = this->paths.reverse_index[i];
             this->active_shapes.Push(ActiveShape(path_id));
         }
     }
+
+    segments.Free();
+    candidates.Free();
 }
 
 void Document::TranslateView(Vec2 amount) {
@@ -135,60 +182,20 @@ void Document::CollectActiveShapes() {
     for (auto& shape : this->active_shapes) {
         this->paths.collections.SetCollection(shape.id, collection);
     }
+
+    this->paths.revision++;
 }
 
 void Document::AutoCollect() {
-    auto begin = std::chrono::high_resolution_clock::now();
-
-    size_t memory_estimation = this->paths.Length() * 2 * sizeof(RectNamed);
-    LinearAllocatorPool allocator = LinearAllocatorPool(memory_estimation);
-
-    auto shape_bounds = DynamicArrayEx<RectNamed, LinearAllocatorPool>(this->paths.Length(), &allocator);
-    for (auto i=0; i<this->paths.Length(); i++) {
-        size_t shape_id               = this->paths.reverse_index[i];
-        ID2D1TransformedGeometry* geo = this->paths.transformed_geometries[i];
-
-        Rect bounds = GetBounds(geo);
-        shape_bounds.Push(RectNamed(bounds, shape_id), &allocator);
-    }
-
-    std::sort(shape_bounds.Data(), shape_bounds.End(), SortRectPositionXY<RectNamed>);
-
-    auto new_collections = DynamicArrayEx<RectNamed, LinearAllocatorPool>(this->paths.Length(), &allocator);
-    auto search_from = 0;
-    for (auto &shape : shape_bounds) {
-        bool found_fit = false;
-        for (auto j=search_from; j<new_collections.Length(); j++) {
-            RectNamed* collection = &new_collections[j];
-            if (collection->rect.Contains(&shape.rect)) {
-                this->paths.collections.SetCollection(shape.id, collection->id);
-                found_fit = true;
-                break;
-            }
-
-            // Since the shapes are sorted, the collection will not be able to hold any of the
-            // the shapes that follow if shape.left is greater than the collection right so we
-            // advance search_from
-            if (shape.Left() > collection->Right()) {
-                search_from = j;
-            }
-        }
-
-        if (!found_fit) {
-            size_t next_collection = this->paths.collections.NextId();
-            this->paths.collections.SetCollection(shape.id, next_collection);
-            new_collections.Push(RectNamed(shape.rect, next_collection), &allocator);
-        }
-    }
-
-    auto end = std::chrono::high_resolution_clock::now();
-    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
-    printf("Auto collect ran in %.3f seconds.\n", elapsed.count() * 1e-9);
+    TRACE_FUNCTION();
+    this->paths.AutoCollect();
 }
 
 View::View() : start(Vec2(0.0f, 0.0f)), mouse_pos_screen(Vec2(0.0f, 0.0f)), show_pipeline(false) {};
 Vec2 View::GetDocumentPosition(Vec2 screen_pos) {
-    return this->ScreenToDocumentMat().TransformPoint(screen_pos.D2Point());
+    // The inverse of DocumentToScreenMat, written out so it doesn't need Direct2D
+    float pixels_per_unit = this->scale * kPixelsPerInch;
+    return Vec2(screen_pos.x / pixels_per_unit + this->start.x, screen_pos.y / pixels_per_unit + this->start.y);
 }
 
 Vec2 View::MousePos() {
@@ -208,6 +215,7 @@ void View::ScrollZoom(bool in) {
     this->start += mouse_change;
 }
 
+#ifndef SVIGGY_HEADLESS
 D2D1::Matrix3x2F View::ScaleMatrix() {
     return D2D1::Matrix3x2F::Scale(
         this->scale * kPixelsPerInch,
@@ -226,12 +234,23 @@ D2D1::Matrix3x2F View::DocumentToScreenMat() {
 
     return translation_matrix * scale_matrix;
 }
+#endif
+
+// Returns the area of the document that's visible in a screen of the given size
+Rect View::VisibleArea(Vec2 screen_size) {
+    Vec2 top_left     = this->GetDocumentPosition(Vec2(0.0f, 0.0f));
+    Vec2 bottom_right = this->GetDocumentPosition(screen_size);
+
+    return Rect::FromEdges(top_left.x, top_left.y, bottom_right.x, bottom_right.y);
+}
 
+#ifndef SVIGGY_HEADLESS
 D2D1::Matrix3x2F View::ScreenToDocumentMat() {
     D2D1::Matrix3x2F mat = this->DocumentToScreenMat();
     mat.Invert();
     return mat;
 }
+#endif
 
 // Default tag capacity is pretty arbitrary at this point
 constexpr size_t kDefaultTagCapacity = 1000;
@@ -242,7 +261,7 @@ TagGod::TagGod() :
 // Gets the id for a tag or creates a new tag id for it if it is not currently
 // in its index
 TagId TagGod::GetTagId(String tag) {
-    TagId* id = &this->index[tag];
+    TagId* id = this->index.GetPtr(tag);
     if (id) {
         return *id;
     }
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <stdio.h>
+
+#include "batch.hpp"
+#include "bin_packing.hpp"
+#include "ds.hpp"
+#include "files.hpp"
+#include "packing_cache.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "sviggy.hpp"
+#include "trace.hpp"
+
+// Smallest pool a document's collection bounds are gathered in
+constexpr size_t kMinBatchPoolSize = 4096;
+
+constexpr size_t kBatchUnplaced = std::numeric_limits<size_t>::max();
+
+BatchLayout RunBatchLayout(Paths **documents, size_t count, PipelineLayout *layout, PackingCache *cache, LinearAllocatorPool *allocator) {
+    TRACE_FUNCTION();
+
+    // Every collection is an entry and each document's entries come one after the other, so a document only ever
+    // touches its own range and the id a rect is packed with is its entry
+    auto starts = DynamicArrayEx<size_t, LinearAllocatorPool>(count + 1, allocator);
+    size_t total = 0;
+    for (size_t document=0; document<count; document++) {
+        starts.Push(total, allocator);
+        total += documents[document]->collections.reverse_collections_index.Length();
+    }
+    starts.Push(total, allocator);
+
+    auto rects       = DynamicArrayEx<RectNamed, LinearAllocatorPool>(total, allocator);
+    auto collections = DynamicArrayEx<CollectionId, LinearAllocatorPool>(total, allocator);
+    rects.Resize(total, allocator);
+    collections.Resize(total, allocator);
+
+    // Allocators can't be shared between threads so each document's bounds are gathered in a pool of its own and
+    // copied out
+    ParallelFor(count, 1, [&](size_t chunk, size_t start, size_t end) {
+        TRACE_ZONE("Batch Collection Bounds");
+
+        for (size_t document=start; document<end; document++) {
+            Paths *paths = documents[document];
+            auto pool    = LinearAllocatorPool(std::max<size_t>(kMinBatchPoolSize, paths->Length() * 100));
+            auto bounds  = GetCollectionBounds(paths, &pool);
+
+            for (size_t i=0; i<bounds.array.Length(); i++) {
+                size_t entry = starts[document] + i;
+                rects[entry]       = RectNamed(bounds.array[i].rect, entry);
+                collections[entry] = bounds.array[i].id;
+            }
+
+            pool.FreeAllocator();
+        }
+    });
+
+    // Whatever didn't fit is counted in unplaced below
+    bool out_of_space;
+    auto bins = PackBinsCached(cache, &layout->bins, &rects, PackingOptions(), layout->search_seconds, &out_of_space, allocator);
+
+    BatchLayout batch = {
+        DynamicArrayEx<Vec2, LinearAllocatorPool>(bins.Length(), allocator),
+        DynamicArrayEx<Vec2, LinearAllocatorPool>(bins.Length(), allocator),
+        DynamicArrayEx<size_t, LinearAllocatorPool>(bins.Length() + 1, allocator),
+        DynamicArrayEx<BatchPlacement, LinearAllocatorPool>(total, allocator),
+        0,
+    };
+
+    auto placement_of = DynamicArrayEx<size_t, LinearAllocatorPool>(total, allocator);
+    placement_of.Resize(total, allocator);
+    std::fill(placement_of.Data(), placement_of.End(), kBatchUnplaced);
+
+    // Entries are in document order so the document of each packed rect is found by searching the starts
+    Vec2 sheet_offset = Vec2(0.0f, 0.0f);
+    for (size_t sheet=0; sheet<bins.Length(); sheet++) {
+        Bin *bin = &bins[sheet];
+        batch.sheets.Push(bin->size, allocator);
+        batch.sheet_offsets.Push(sheet_offset, allocator);
+        batch.sheet_starts.Push(batch.placements.Length(), allocator);
+
+        for (auto &packed : bin->rects) {
+            size_t document = std::upper_bound(starts.Data(), starts.End(), packed.id) - starts.Data() - 1;
+
+            placement_of[packed.id] = batch.placements.Length();
+            batch.placements.Push(BatchPlacement(document, collections[packed.id], sheet, packed.vec2, rects[packed.id].rect.size), allocator);
+        }
+
+        sheet_offset += bin->size;
+    }
+    batch.sheet_starts.Push(batch.placements.Length(), allocator);
+    batch.unplaced = total - batch.placements.Length();
+
+    ParallelFor(count, 1, [&](size_t chunk, size_t start, size_t end) {
+        TRACE_ZONE("Batch Move Collections");
+
+        for (size_t document=start; document<end; document++) {
+            Paths *paths = documents[document];
+
+            for (size_t entry=starts[document]; entry<starts[document + 1]; entry++) {
+                if (placement_of[entry] == kBatchUnplaced) continue;
+
+                BatchPlacement *placement = &batch.placements[placement_of[entry]];
+                DynamicArray<PathId>* collection = &paths->collections.reverse_collections_index[placement->collection];
+
+                // Every shape in the collection moves by the same amount, like RunLayout
+                Rect bound   = rects[entry].rect;
+                Vec2 desired = Vec2(batch.sheet_offsets[placement->sheet].x + placement->pos.x, batch.sheet_offsets[placement->sheet].y + placement->pos.y);
+                Vec2 offset  = Vec2(desired.x - bound.Left(), desired.y - bound.Top());
+
+                paths->ApplyMatrix(collection->Data(), collection->Length(), Mat3x2::Translation(offset));
+            }
+        }
+    });
+
+    return batch;
+}
+
+bool WriteBatchManifest(char *file, BatchLayout *batch, char **names) {
+    FILE *f = fopen(file, "wb");
+    if (!f) return false;
+
+    fprintf(f, "{\"unplaced\": %zu, \"sheets\": [", batch->unplaced);
+    for (size_t sheet=0; sheet<batch->sheets.Length(); sheet++) {
+        Vec2 size = batch->sheets[sheet];
+        fprintf(f, "%s\n  {\"width\": %.7g, \"height\": %.7g, \"placements\": [", sheet ? "," : "", size.x, size.y);
+
+        for (size_t i=batch->sheet_starts[sheet]; i<batch->sheet_starts[sheet + 1]; i++) {
+            BatchPlacement *placement = &batch->placements[i];
+
+            fprintf(f, "%s\n    {\"document\": ", i > batch->sheet_starts[sheet] ? "," : "");
+            WriteJsonString(f, names[placement->document]);
+            fprintf(f, ", \"collection\": %zu, \"x\": %.7g, \"y\": %.7g, \"width\": %.7g, \"height\": %.7g}",
+                placement->collection, placement->pos.x, placement->pos.y, placement->size.x, placement->size.y);
+        }
+
+        fprintf(f, "\n  ]}");
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = !ferror(f);
+    fclose(f);
+
+    return ok;
+}
@@ -1,107 +1,1052 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <math.h>
+#include <mutex>
+#include <thread>
+
 #include "bin_packing.hpp"
 #include "ds.hpp"
+#include "packing_cache.hpp"
+#include "parallel.hpp"
 #include "sviggy.hpp"
+#include "trace.hpp"
 
 Bin::Bin(Vec2 size, LinearAllocatorPool *allocator) : size(size), rects(DynamicArrayEx<Vec2Named, LinearAllocatorPool>(20, allocator)) {};
 
 DynamicArrayEx<Bin, LinearAllocatorPool> PackBins(
         DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
         DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        bool *out_of_space,
         LinearAllocatorPool *allocator
 ) {
-    // Keeps track of which bins have been used. Each entry in this corresponds to an entry
-    // at the same index in available_bins
-    auto used_bins_count = DynamicArrayEx<size_t, LinearAllocatorPool>(available_bins->Length(), allocator);
+    return PackBins(available_bins, rects, PackingOptions(), out_of_space, allocator);
+}
+
+using PackingClock = std::chrono::steady_clock;
+
+// How many rects get packed between checks of the deadline
+constexpr size_t kPackingDeadlineStride = 1024;
+
+// Rects that are exactly the same size are only placed as a grid once there are at least this many of them
+constexpr size_t kPackingGridMinGroup = 8;
+
+// Groups rects of exactly the same size. members holds the index of every rect in the group from starts[group] up to
+// starts[group + 1], in the order the rects came in
+class PackingGroups {
+    public:
+    DynamicArrayEx<size_t, LinearAllocatorPool> group_of; // Group of each rect
+    DynamicArrayEx<size_t, LinearAllocatorPool> starts;
+    DynamicArrayEx<size_t, LinearAllocatorPool> members;
+
+    PackingGroups(DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects, LinearAllocatorPool* allocator) :
+        group_of(DynamicArrayEx<size_t, LinearAllocatorPool>(rects->Length(), allocator)),
+        starts(DynamicArrayEx<size_t, LinearAllocatorPool>(16, allocator)),
+        members(DynamicArrayEx<size_t, LinearAllocatorPool>(rects->Length(), allocator)) {
+
+        size_t length = rects->Length();
+        this->group_of.Resize(length, allocator);
+        this->members.Resize(length, allocator);
+        for (size_t i=0; i<length; i++) {
+            this->members[i] = i;
+        }
+
+        // Sorting by size puts every group in one run, and breaking ties by index keeps each run in input order
+        std::sort(this->members.Data(), this->members.End(), [rects](size_t a, size_t b) {
+            uint64_t key_a = PackingSizeKey(rects->GetPtr(a)->rect.size);
+            uint64_t key_b = PackingSizeKey(rects->GetPtr(b)->rect.size);
+            if (key_a != key_b) return key_a < key_b;
+
+            return a < b;
+        });
+
+        for (size_t i=0; i<length; i++) {
+            size_t rect = this->members[i];
+            bool new_group = i == 0 || PackingSizeKey(rects->GetPtr(rect)->rect.size) != PackingSizeKey(rects->GetPtr(this->members[i - 1])->rect.size);
+            if (new_group) this->starts.Push(i, allocator);
+
+            this->group_of[rect] = this->starts.Length() - 1;
+        }
+        this->starts.Push(length, allocator);
+    }
+
+    size_t Count(size_t group) {
+        return this->starts[group + 1] - this->starts[group];
+    }
+};
+
+// One run of a packer over a list of rects, see PackBinsWith
+template <typename P>
+class PackingRun {
+    public:
+    P*                                            packer;
+    DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins;
+    DynamicArrayEx<size_t, LinearAllocatorPool>    used_bins_count; // Bins used of each kind in available_bins
+    DynamicArrayEx<Bin, LinearAllocatorPool>       bins;            // Added to the packer as they're opened so the ids match
+    LinearAllocatorPool*                           allocator;
+
+    PackingRun(P* packer, DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins, LinearAllocatorPool* allocator) :
+        packer(packer),
+        available_bins(available_bins),
+        used_bins_count(DynamicArrayEx<size_t, LinearAllocatorPool>(available_bins->Length(), allocator)),
+        bins(DynamicArrayEx<Bin, LinearAllocatorPool>(10, allocator)),
+        allocator(allocator) {
+
+        for (auto i=0; i<available_bins->Length(); i++) {
+            this->used_bins_count.Push(0, allocator);
+        }
+    }
+
+    // Returns the free area the size fits best in, opening the first kind of bin that's left and big enough when
+    // none of the open bins have room. Returns kNullArea once there's nothing left that can hold it
+    size_t FindArea(Vec2 size) {
+        size_t area = this->packer->areas.FindBest(size, this->packer->fit);
+        if (area != kNullArea) return area;
+
+        for (auto i=0; i<this->available_bins->Length(); i++) {
+            Vec2Many* possible_bin = this->available_bins->GetPtr(i);
+            size_t*   used         = this->used_bins_count.GetPtr(i);
+
+            if (*used >= possible_bin->quantity || !possible_bin->vec2.Fits(size)) continue;
+
+            (*used)++;
+            this->bins.Push(Bin(possible_bin->vec2, this->allocator), this->allocator);
+            this->packer->areas.AddBin(possible_bin->vec2);
+
+            return this->packer->areas.FindBest(size, this->packer->fit);
+        }
+
+        return kNullArea;
+    }
+
+    bool PlaceOne(RectNamed* rect) {
+        size_t area = this->FindArea(rect->rect.size);
+        if (area == kNullArea) return false;
+
+        FreeArea* free_area = this->packer->areas.Get(area);
+        this->bins[free_area->bin].rects.Push(Vec2Named(free_area->rect.pos, rect->id), this->allocator);
+        this->packer->Place(area, rect->rect.size);
+        return true;
+    }
+
+    // Places rects that are all size as grids. Each grid fills as much of the free area it goes in as there are rects
+    // left and is handed to the packer as a single rect, so the packer only sees a handful of placements no matter
+    // how big the group is. Whatever doesn't make up a full row becomes a one row grid of its own
+    bool PlaceGroup(Vec2 size, RectNamed** group, size_t count) {
+        size_t placed = 0;
+        while (placed < count) {
+            size_t area = this->FindArea(size);
+            if (area == kNullArea) return false;
+
+            FreeArea* free_area = this->packer->areas.Get(area);
+            Rect free = free_area->rect;
+            Bin* bin  = &this->bins[free_area->bin];
+
+            // The area fits at least one so there's always at least one row and column
+            size_t left    = count - placed;
+            size_t columns = std::max<size_t>(1, (size_t)((free.size.x + kPackingEpsilon) / size.x));
+            size_t rows    = std::max<size_t>(1, (size_t)((free.size.y + kPackingEpsilon) / size.y));
+
+            if (left >= columns) {
+                rows = std::min<size_t>(rows, left / columns);
+            } else {
+                columns = left;
+                rows    = 1;
+            }
+
+            for (size_t row=0; row<rows; row++) {
+                for (size_t column=0; column<columns; column++) {
+                    Vec2 position = Vec2(free.pos.x + column * size.x, free.pos.y + row * size.y);
+                    bin->rects.Push(Vec2Named(position, group[placed++]->id), this->allocator);
+                }
+            }
+
+            this->packer->Place(area, Vec2(columns * size.x, rows * size.y));
+        }
+
+        return true;
+    }
+};
+
+// Packs the rects in order into the free area each fits best in. Works with any packer that keeps its free areas in a
+// BinFreeAreas. With grid_groups the first rect of a big enough group of identical rects places the whole group as
+// grids, see PackingRun::PlaceGroup. Stops early once the deadline passes or a rect doesn't fit in any bin that's
+// left, in which case some of the rects won't be in any bin and out_of_space says which it was
+template <typename P>
+static DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsWith(
+        P* packer,
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        bool grid_groups,
+        PackingClock::time_point deadline,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    *out_of_space = false;
+
+    auto run    = PackingRun<P>(packer, available_bins, allocator);
+    auto groups = PackingGroups(rects, allocator);
+
+    auto group_placed = DynamicArrayEx<bool, LinearAllocatorPool>(groups.starts.Length(), allocator);
+    group_placed.Resize(groups.starts.Length(), allocator);
+    memset(group_placed.Data(), 0, group_placed.Length() * sizeof(bool));
+
+    auto group_rects = DynamicArrayEx<RectNamed*, LinearAllocatorPool>(16, allocator);
+
+    size_t packed = 0;
+    size_t next_deadline_check = kPackingDeadlineStride;
+    for (size_t i=0; i<rects->Length(); i++) {
+        if (packed >= next_deadline_check) {
+            if (PackingClock::now() >= deadline) break;
+            next_deadline_check = packed + kPackingDeadlineStride;
+        }
+
+        RectNamed* rect = rects->GetPtr(i);
+        size_t group    = groups.group_of[i];
+        size_t count    = groups.Count(group);
+        Vec2 size       = rect->rect.size;
 
-    // Each entry in bins has an entry in available_areas at the same index that represents the available areas for the bin
-    auto bins            = DynamicArrayEx<Bin, LinearAllocatorPool>(10, allocator);
-    auto available_areas = DynamicArrayEx<DynamicArrayEx<Rect, LinearAllocatorPool>, LinearAllocatorPool>(10, allocator);
+        bool as_grid = grid_groups && count >= kPackingGridMinGroup && size.x > kPackingEpsilon && size.y > kPackingEpsilon;
 
-    for (auto& rect : *rects) {
-        AvailableArea next_area = FindNextAvailableArea(&bins, &used_bins_count, available_bins, &available_areas, rect.rect.size, allocator);
-        if (!next_area.area) {
-            // TODO: we should return the fact that there was an error
-            printf("We ran out of space :( returning early for now\n");
-            return bins;
+        bool ok = true;
+        if (as_grid) {
+            if (group_placed[group]) continue;
+            group_placed[group] = true;
+
+            group_rects.Clear();
+            for (size_t member=groups.starts[group]; member<groups.starts[group + 1]; member++) {
+                group_rects.Push(rects->GetPtr(groups.members[member]), allocator);
+            }
+
+            ok = run.PlaceGroup(size, group_rects.Data(), count);
+            packed += count;
+        } else {
+            ok = run.PlaceOne(rect);
+            packed++;
         }
 
-        Place(&bins, &available_areas, &rect, next_area, allocator);
+        if (!ok) {
+            *out_of_space = true;
+            break;
+        }
     }
 
-    // TODO: shrink bins
+    return run.bins;
+}
+
+static DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsUntil(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingOptions options,
+        PackingClock::time_point deadline,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    auto ordered = *rects;
+    if (options.order != PackingOrder::Given) {
+        ordered = rects->Clone(allocator);
+        SortForPacking(&ordered, options.order);
+    }
+
+    DynamicArrayEx<Bin, LinearAllocatorPool> bins;
+    switch (options.packer) {
+        case Packer::Guillotine: {
+            auto packer = GuillotinePacker(options.fit, ordered.Length());
+            bins = PackBinsWith(&packer, available_bins, &ordered, options.grid_groups, deadline, out_of_space, allocator);
+            packer.Free();
+            break;
+        }
+
+        case Packer::MaxRects: {
+            auto packer = MaxRectsPacker(options.fit, ordered.Length());
+            bins = PackBinsWith(&packer, available_bins, &ordered, options.grid_groups, deadline, out_of_space, allocator);
+            packer.Free();
+            break;
+        }
+    }
 
     return bins;
 }
 
-AvailableArea FindNextAvailableArea(
-    DynamicArrayEx<Bin,      LinearAllocatorPool>* bins,
-    DynamicArrayEx<size_t,   LinearAllocatorPool>* used_bins_count,
-    DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
-    DynamicArrayEx<DynamicArrayEx<Rect, LinearAllocatorPool>, LinearAllocatorPool>* available_areas,
-    Vec2 size,
-    LinearAllocatorPool *allocator
+static DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsToCompletion(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingOptions options,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
 ) {
-    AvailableArea available_area = { };
-    for (auto bin_id=0; bin_id<available_areas->Length(); bin_id++) {
-        auto bin_areas = available_areas->GetPtr(bin_id);
+    return PackBinsUntil(available_bins, rects, options, PackingClock::time_point::max(), out_of_space, allocator);
+}
 
-        for (auto area_id=0; area_id<bin_areas->Length(); area_id++) {
-            Rect* possible_fit = bin_areas->GetPtr(area_id);
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBins(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingOptions options,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+    return PackBinsToCompletion(available_bins, rects, options, out_of_space, allocator);
+}
 
-            if (possible_fit->size.Fits(size)) {
-                available_area.area   = possible_fit;
-                available_area.bin_id = bin_id;
-                break;
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsGuillotine(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        FreeAreaFit fit,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    auto options = PackingOptions(Packer::Guillotine, fit, PackingOrder::Given);
+    return PackBinsToCompletion(available_bins, rects, options, out_of_space, allocator);
+}
+
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsMaxRects(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        FreeAreaFit fit,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    auto options = PackingOptions(Packer::MaxRects, fit, PackingOrder::Given);
+    return PackBinsToCompletion(available_bins, rects, options, out_of_space, allocator);
+}
+
+static float PackingOrderKey(Rect *rect, PackingOrder order) {
+    switch (order) {
+        case PackingOrder::Given:     return 0.0f;
+        case PackingOrder::Height:    return rect->size.y;
+        case PackingOrder::Area:      return rect->Area();
+        case PackingOrder::MaxSide:   return std::max<float>(rect->size.x, rect->size.y);
+        case PackingOrder::Perimeter: return rect->size.x + rect->size.y;
+    }
+
+    return 0.0f;
+}
+
+void SortForPacking(DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects, PackingOrder order) {
+    if (order == PackingOrder::Given) return;
+
+    std::sort(rects->Data(), rects->End(), [order](RectNamed& a, RectNamed& b) {
+        float key_a = PackingOrderKey(&a.rect, order);
+        float key_b = PackingOrderKey(&b.rect, order);
+        if (key_a != key_b) return key_a > key_b;
+
+        return a.id < b.id;
+    });
+}
+
+// Combinations tried by PackBinsSearch, best guesses first since the ones at the end are the likeliest to be cut off
+// by the deadline. The first has to be the default options
+static const PackingOptions kPackingSearchCandidates[] = {
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestShortSide, PackingOrder::Height),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestShortSide, PackingOrder::Area),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestArea,      PackingOrder::Height),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestArea,      PackingOrder::Area),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestShortSide, PackingOrder::MaxSide),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestShortSide, PackingOrder::Perimeter),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestArea,      PackingOrder::MaxSide),
+    PackingOptions(Packer::MaxRects,   FreeAreaFit::BestArea,      PackingOrder::Perimeter),
+    PackingOptions(Packer::Guillotine, FreeAreaFit::BestShortSide, PackingOrder::Height),
+    PackingOptions(Packer::Guillotine, FreeAreaFit::BestShortSide, PackingOrder::Area),
+    PackingOptions(Packer::Guillotine, FreeAreaFit::BestShortSide, PackingOrder::MaxSide),
+    PackingOptions(Packer::Guillotine, FreeAreaFit::BestShortSide, PackingOrder::Perimeter),
+};
+
+constexpr size_t kPackingSearchCandidateCount = sizeof(kPackingSearchCandidates) / sizeof(kPackingSearchCandidates[0]);
+
+// One packing tried by PackBinsSearch. Each lives in its own allocator since the pools aren't safe to share between
+// threads
+class PackingSearchResult {
+    public:
+    LinearAllocatorPool                      allocator;
+    DynamicArrayEx<Bin, LinearAllocatorPool> bins;
+    bool                                     done;
+    bool                                     out_of_space;
+    size_t                                   packed;
+    float                                    bin_area;
+    PackingSearchResult(size_t allocation_size) :
+        allocator(LinearAllocatorPool(allocation_size)),
+        done(false),
+        out_of_space(false),
+        packed(0),
+        bin_area(0.0f) {};
+
+    void Pack(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingOptions options,
+        PackingClock::time_point deadline
+    ) {
+        this->bins = PackBinsUntil(available_bins, rects, options, deadline, &this->out_of_space, &this->allocator);
+
+        for (auto &bin : this->bins) {
+            this->packed   += bin.rects.Length();
+            this->bin_area += bin.size.x * bin.size.y;
+        }
+    }
+};
+
+// Whether a is a better packing than b, assuming a comes later in the candidate list
+static bool BetterPacking(PackingSearchResult *a, PackingSearchResult *b) {
+    if (a->packed != b->packed) return a->packed > b->packed;
+    if (a->bins.Length() != b->bins.Length()) return a->bins.Length() < b->bins.Length();
+    return a->bin_area < b->bin_area;
+}
+
+// Threads - 1 threads that PackBinsSearch starts once and hands every round of packing to, so bin selection doesn't
+// pay for starting threads for every bin count it tries. Has to stay where it was made since the threads point at it
+class PackingWorkers {
+    public:
+    size_t                  threads;
+    std::thread             pool[kMaxParallelThreads];
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void()>   job;
+    size_t                  generation;
+    size_t                  running;
+    bool                    stopping;
+
+    PackingWorkers(size_t threads) : threads(threads), generation(0), running(0), stopping(false) {
+        for (size_t i=1; i<threads; i++) {
+            this->pool[i] = std::thread(&PackingWorkers::Loop, this);
+        }
+    };
+
+    // Runs worker on the calling thread and on every pool thread, and returns once they're all done
+    void Run(std::function<void()> worker) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->job     = worker;
+            this->running = this->threads - 1;
+            this->generation++;
+        }
+        this->wake.notify_all();
+
+        worker();
+
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->finished.wait(guard, [&]() { return this->running == 0; });
+    }
+
+    void Free() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->wake.notify_all();
+
+        for (size_t i=1; i<this->threads; i++) {
+            this->pool[i].join();
+        }
+    }
+
+    void Loop() {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> guard(this->lock);
+        while (true) {
+            this->wake.wait(guard, [&]() { return this->stopping || this->generation != seen; });
+            if (this->stopping) return;
+            seen = this->generation;
+
+            guard.unlock();
+            this->job();
+            guard.lock();
+
+            if (--this->running == 0) this->finished.notify_one();
+        }
+    }
+};
+
+// Bin selection only picks between up to this many kinds of bins so its tables can have an entry for every subset
+// of the kinds
+constexpr size_t kPackingMaxSelectedKinds = 8;
+
+// Most combinations BinSelection hands out for one bin count, and most it looks at while finding them
+constexpr size_t kPackingMaxBinCombinations   = 4096;
+constexpr size_t kPackingMaxCombinationVisits = 1 << 20;
+
+// Areas are summed as doubles from float sizes, so a bound is allowed to miss by this fraction before it rules
+// anything out
+constexpr double kPackingAreaSlack = 1e-6;
+
+// A combination is how many bins of each kind in the available bins to use. BinSelection rules out the ones that
+// can't hold every rect using only the rects' areas and sizes, without placing anything:
+//
+// - Every rect has to fit in at least one kind of bin in the combination.
+// - For every subset of the kinds in the combination, the rects that only fit in those kinds can't have more area
+//   than the bins of those kinds. With every kind in the combination that's the usual continuous bound, and with a
+//   single kind it's the bound for the rects only that kind can hold.
+// - Rects that are over half of every kind of bin they fit in on both sides can't share a bin, so there have to be
+//   at least as many bins as there are of them.
+class BinSelection {
+    public:
+    size_t                                         kinds; // 0 when there are too many to select between
+    DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins;
+    DynamicArrayEx<double, LinearAllocatorPool>    area_within;  // Area of the rects that only fit in a subset of the kinds, by subset
+    DynamicArrayEx<size_t, LinearAllocatorPool>    count_within; // How many rects only fit in a subset of the kinds, by subset
+    DynamicArrayEx<size_t, LinearAllocatorPool>    alone;        // Rects that can't share a bin when only a subset of the kinds is used, by subset
+    double                                         total_area;
+    double                                         largest_bin;  // Area of the biggest kind of bin there are any of
+    size_t                                         visits;
+
+    BinSelection(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        LinearAllocatorPool* allocator
+    );
+
+    double Area(size_t *counts) {
+        double area = 0.0;
+        for (size_t kind=0; kind<this->kinds; kind++) {
+            Vec2 size = this->available_bins->GetPtr(kind)->vec2;
+            area += (double)counts[kind] * size.x * size.y;
+        }
+
+        return area;
+    }
+
+    bool Feasible(size_t *counts);
+
+    // Fills combinations with the counts of every combination of exactly bins bins that passes the bounds and has
+    // less area than max_area, kinds counts per combination, sorted by area. Returns how many there are
+    size_t Combinations(size_t bins, double max_area, DynamicArrayEx<size_t, LinearAllocatorPool>* combinations, LinearAllocatorPool* allocator);
+
+    void Enumerate(size_t kind, size_t left, size_t *counts, double max_area, DynamicArrayEx<size_t, LinearAllocatorPool>* combinations, LinearAllocatorPool* allocator);
+
+    PackingBound Bound(LinearAllocatorPool* allocator);
+};
+
+BinSelection::BinSelection(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        LinearAllocatorPool* allocator
+) :
+    kinds(available_bins->Length() <= kPackingMaxSelectedKinds ? available_bins->Length() : 0),
+    available_bins(available_bins),
+    area_within(DynamicArrayEx<double, LinearAllocatorPool>(1, allocator)),
+    count_within(DynamicArrayEx<size_t, LinearAllocatorPool>(1, allocator)),
+    alone(DynamicArrayEx<size_t, LinearAllocatorPool>(1, allocator)),
+    total_area(0.0),
+    largest_bin(0.0),
+    visits(0) {
+
+    for (auto &rect : *rects) {
+        this->total_area += (double)rect.rect.size.x * rect.rect.size.y;
+    }
+    for (auto &bin : *available_bins) {
+        if (bin.quantity >= 1.0f) this->largest_bin = std::max<double>(this->largest_bin, (double)bin.vec2.x * bin.vec2.y);
+    }
+
+    if (!this->kinds) return;
+
+    size_t subsets = (size_t)1 << this->kinds;
+    this->area_within.Resize(subsets, allocator);
+    this->count_within.Resize(subsets, allocator);
+    this->alone.Resize(subsets, allocator);
+    std::fill(this->area_within.Data(), this->area_within.End(), 0.0);
+    std::fill(this->count_within.Data(), this->count_within.End(), 0);
+    std::fill(this->alone.Data(), this->alone.End(), 0);
+
+    // Each rect is reduced to which kinds it fits in and which of those it's over half of on both sides. There are
+    // only ever a handful of distinct pairs of those, so they're counted up once and the tables built from the counts
+    auto masks = DynamicArrayEx<size_t, LinearAllocatorPool>(rects->Length(), allocator);
+    for (auto &rect : *rects) {
+        Vec2 size   = rect.rect.size;
+        size_t fits = 0;
+        size_t big  = 0;
+        for (size_t kind=0; kind<this->kinds; kind++) {
+            Vec2 bin = available_bins->GetPtr(kind)->vec2;
+            if (!bin.Fits(size)) continue;
+
+            fits |= (size_t)1 << kind;
+            if (size.x > bin.x / 2.0f && size.y > bin.y / 2.0f) big |= (size_t)1 << kind;
+        }
+
+        this->area_within[fits] += (double)size.x * size.y;
+        this->count_within[fits]++;
+        masks.Push(fits << kPackingMaxSelectedKinds | big, allocator);
+    }
+
+    // Sum over subsets, after which each entry covers every rect whose kinds are a subset of the entry's
+    for (size_t kind=0; kind<this->kinds; kind++) {
+        size_t bit = (size_t)1 << kind;
+        for (size_t subset=0; subset<subsets; subset++) {
+            if (!(subset & bit)) continue;
+
+            this->area_within[subset]  += this->area_within[subset ^ bit];
+            this->count_within[subset] += this->count_within[subset ^ bit];
+        }
+    }
+
+    std::sort(masks.Data(), masks.End());
+    size_t kind_mask = subsets - 1;
+    for (size_t start=0; start<masks.Length();) {
+        size_t end = start;
+        while (end < masks.Length() && masks[end] == masks[start]) end++;
+
+        size_t fits = masks[start] >> kPackingMaxSelectedKinds;
+        size_t big  = masks[start] & kind_mask;
+        for (size_t used=1; used<subsets; used++) {
+            size_t usable = fits & used;
+            if (usable && !(usable & ~big)) this->alone[used] += end - start;
+        }
+
+        start = end;
+    }
+}
+
+bool BinSelection::Feasible(size_t *counts) {
+    size_t used = 0;
+    size_t bins = 0;
+    for (size_t kind=0; kind<this->kinds; kind++) {
+        if (!counts[kind]) continue;
+
+        used |= (size_t)1 << kind;
+        bins += counts[kind];
+    }
+
+    size_t unused = (((size_t)1 << this->kinds) - 1) & ~used;
+    if (this->count_within[unused] || bins < this->alone[used]) return false;
+
+    // Walks every non-empty subset of the used kinds
+    for (size_t subset=used; subset; subset=(subset - 1) & used) {
+        double capacity = 0.0;
+        for (size_t kind=0; kind<this->kinds; kind++) {
+            if (!(subset & ((size_t)1 << kind))) continue;
+
+            Vec2 size = this->available_bins->GetPtr(kind)->vec2;
+            capacity += (double)counts[kind] * size.x * size.y;
+        }
+
+        if (capacity < this->area_within[subset | unused] * (1.0 - kPackingAreaSlack)) return false;
+    }
+
+    return true;
+}
+
+void BinSelection::Enumerate(
+        size_t kind,
+        size_t left,
+        size_t *counts,
+        double max_area,
+        DynamicArrayEx<size_t, LinearAllocatorPool>* combinations,
+        LinearAllocatorPool* allocator
+) {
+    if (this->visits >= kPackingMaxCombinationVisits || combinations->Length() >= kPackingMaxBinCombinations * this->kinds) return;
+
+    float quantity = this->available_bins->GetPtr(kind)->quantity;
+    size_t most    = quantity >= (float)left ? left : (size_t)std::max<float>(quantity, 0.0f);
+
+    if (kind + 1 == this->kinds) {
+        if (left > most) return;
+
+        counts[kind] = left;
+        this->visits++;
+        if (this->Area(counts) < max_area * (1.0 - kPackingAreaSlack) && this->Feasible(counts)) {
+            for (size_t i=0; i<this->kinds; i++) {
+                combinations->Push(counts[i], allocator);
             }
         }
+        return;
+    }
+
+    for (size_t count=0; count<=most; count++) {
+        counts[kind] = count;
+        this->Enumerate(kind + 1, left - count, counts, max_area, combinations, allocator);
+    }
+}
+
+size_t BinSelection::Combinations(size_t bins, double max_area, DynamicArrayEx<size_t, LinearAllocatorPool>* combinations, LinearAllocatorPool* allocator) {
+    combinations->Clear();
+    if (!this->kinds) return 0;
+
+    size_t counts[kPackingMaxSelectedKinds];
+    this->Enumerate(0, bins, counts, max_area, combinations, allocator);
+
+    size_t kinds = this->kinds;
+    size_t count = combinations->Length() / kinds;
+
+    auto order = DynamicArrayEx<size_t, LinearAllocatorPool>(count, allocator);
+    for (size_t i=0; i<count; i++) {
+        order.Push(i, allocator);
+    }
+    std::stable_sort(order.Data(), order.End(), [this, combinations, kinds](size_t a, size_t b) {
+        return this->Area(combinations->GetPtr(a * kinds)) < this->Area(combinations->GetPtr(b * kinds));
+    });
+
+    auto sorted = DynamicArrayEx<size_t, LinearAllocatorPool>(count * kinds, allocator);
+    for (auto &i : order) {
+        for (size_t kind=0; kind<kinds; kind++) {
+            sorted.Push((*combinations)[i * kinds + kind], allocator);
+        }
     }
+    *combinations = sorted;
 
-    if (!available_area.area) {
-       for (auto i=0; i<available_bins->Length(); i++) {
-           Vec2Many* possible_bin = available_bins->GetPtr(i);
-           size_t*   used         = used_bins_count->GetPtr(i);
+    return count;
+}
 
-           if (*used >= possible_bin->quantity) continue;
+// The fewest bins of any combination that passes the bounds and the least area of a combination with that many. Bin
+// counts are tried going up from the continuous bound until one of them has a combination
+PackingBound BinSelection::Bound(LinearAllocatorPool* allocator) {
+    size_t bins = this->largest_bin > 0.0 ? (size_t)ceil(this->total_area / this->largest_bin - kPackingAreaSlack) : 0;
+    if (!this->kinds) return PackingBound(bins, (float)this->total_area);
 
-           if (possible_bin->vec2.Fits(size)) {
-               auto new_bin = Bin(possible_bin->vec2, allocator);
-               bins->Push(new_bin, allocator);
-               (*used)++;
+    size_t all = ((size_t)1 << this->kinds) - 1;
+    bins = std::max<size_t>(bins, this->alone[all]);
 
-               auto new_areas = DynamicArrayEx<Rect, LinearAllocatorPool>(10, allocator);
-               available_areas->Push(new_areas, allocator);
+    // No combination can hold a rect that doesn't fit in any kind of bin
+    if (this->count_within[0]) return PackingBound(bins, (float)this->total_area);
 
-               auto new_area = Rect(Vec2(0.0f, 0.0f), new_bin.size);
-               available_areas->LastPtr()->Push(new_area, allocator);
+    // Past the total quantity there are no more combinations to look at, which only matters when every kind runs out
+    float quantity = 0.0f;
+    for (auto &bin : *this->available_bins) {
+        quantity += std::max<float>(bin.quantity, 0.0f);
+    }
 
-               available_area.area   = available_areas->LastPtr()->LastPtr();
-               available_area.bin_id = bins->Length() - 1;
-           }
-       }
+    auto combinations = DynamicArrayEx<size_t, LinearAllocatorPool>(this->kinds * 16, allocator);
+    this->visits = 0;
+    for (size_t at_least=bins; (float)at_least <= quantity && this->visits < kPackingMaxCombinationVisits; at_least++) {
+        if (this->Combinations(at_least, kInfinity, &combinations, allocator)) {
+            return PackingBound(at_least, (float)this->Area(combinations.Data()));
+        }
     }
 
-    return available_area;
+    return PackingBound(bins, (float)this->total_area);
 }
 
-void Place(
-    DynamicArrayEx<Bin, LinearAllocatorPool>* bins,
-    DynamicArrayEx<DynamicArrayEx<Rect, LinearAllocatorPool>, LinearAllocatorPool>* available_areas,
-    RectNamed* rect,
-    AvailableArea area,
-    LinearAllocatorPool* allocator
+PackingBound PackingLowerBound(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        LinearAllocatorPool *allocator
 ) {
-    Bin* bin       = bins->GetPtr(area.bin_id);
-    auto bin_areas = available_areas->GetPtr(area.bin_id);
+    auto selection = BinSelection(available_bins, rects, allocator);
+    return selection.Bound(allocator);
+}
+
+static bool MeetsBound(PackingSearchResult *result, PackingBound *bound, size_t rects) {
+    return result->packed == rects && result->bins.Length() <= bound->bins &&
+        result->bin_area <= bound->bin_area * (1.0 + kPackingAreaSlack);
+}
+
+// Packs with a fixed number of bins of each kind. It starts at as many bins as best with only the combinations that
+// have less area than best, then works down a bin at a time to the lower bound. Every combination that fails the
+// bounds or couldn't beat what's been found so far is skipped without packing anything. Within a bin count the
+// combinations go least area first, so the first one to fit every rect is the best of that count. It stops at the
+// first count below best's where nothing fits, since fewer bins won't fit either in practice, once a packing meets the
+// bound, or at the deadline. Returns NULL when nothing beat best
+static PackingSearchResult* SelectBins(
+        BinSelection *selection,
+        PackingBound *bound,
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingOptions options,
+        PackingSearchResult *best,
+        PackingClock::time_point deadline,
+        PackingWorkers *workers,
+        size_t allocation_size,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    size_t kinds = selection->kinds;
+    auto combinations = DynamicArrayEx<size_t, LinearAllocatorPool>(kinds * 64, allocator);
+    auto attempts     = DynamicArrayEx<PackingSearchResult*, LinearAllocatorPool>(64, allocator);
+
+    PackingSearchResult* found = NULL;
 
+    size_t start = best->bins.Length();
+    selection->visits = 0;
+    for (size_t bins=start; bins>=bound->bins && bins>0 && PackingClock::now() < deadline; bins--) {
+        PackingSearchResult* current = found ? found : best;
+        double max_area = bins < current->bins.Length() ? (double)kInfinity : (double)current->bin_area;
+        size_t count = selection->Combinations(bins, max_area, &combinations, allocator);
 
-    Vec2Named packed_collection = Vec2Named(area.area->pos, rect->id);
-    bin->rects.Push(packed_collection, allocator);
+        attempts.Clear();
+        attempts.Resize(count, allocator);
+        std::fill(attempts.Data(), attempts.End(), (PackingSearchResult*)NULL);
 
-    RectPair new_areas = SplitVertical(area.area, rect->rect.size);
+        // Combinations are taken in order so once one of them fits everything the ones after it can be skipped
+        std::atomic<size_t> next(0);
+        std::atomic<size_t> first_fit(count);
+        workers->Run([&]() {
+            while (true) {
+                size_t i = next.fetch_add(1);
+                if (i >= count || i > first_fit.load() || PackingClock::now() >= deadline) break;
 
-    // TODO: make sure the available areas stay in a sorted order
-    *area.area = new_areas.a;
-    bin_areas->Push(new_areas.b, allocator);
+                PackingSearchResult* attempt = new PackingSearchResult(allocation_size);
+                auto attempt_bins = DynamicArrayEx<Vec2Many, LinearAllocatorPool>(kinds, &attempt->allocator);
+                for (size_t kind=0; kind<kinds; kind++) {
+                    size_t used = combinations[i * kinds + kind];
+                    if (used) attempt_bins.Push(Vec2Many(available_bins->GetPtr(kind)->vec2, (float)used), &attempt->allocator);
+                }
+
+                attempt->Pack(&attempt_bins, rects, options, deadline);
+                attempt->done = true;
+                attempts[i]   = attempt;
+
+                if (attempt->packed == rects->Length()) {
+                    size_t first = first_fit.load();
+                    while (i < first && !first_fit.compare_exchange_weak(first, i));
+                }
+            }
+        });
+
+        PackingSearchResult* fit = NULL;
+        for (size_t i=0; i<count; i++) {
+            if (!attempts[i]) continue;
+
+            if (i == first_fit.load()) {
+                fit = attempts[i];
+                continue;
+            }
+
+            attempts[i]->allocator.FreeAllocator();
+            delete attempts[i];
+        }
+
+        if (fit) {
+            if (found) {
+                found->allocator.FreeAllocator();
+                delete found;
+            }
+            found = fit;
+        }
+
+        if (found && MeetsBound(found, bound, rects->Length())) break;
+        if (!fit && bins < start) break;
+    }
+
+    return found;
+}
+
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsSearch(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        PackingSearchOptions search,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    auto deadline = PackingClock::now() + std::chrono::duration_cast<PackingClock::duration>(std::chrono::duration<float>(search.seconds));
+
+    size_t threads = search.threads ? search.threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, kMaxParallelThreads);
+
+    // Enough for the sorted copy of the rects, the packed rects and the arrays growing into them, so a candidate
+    // doesn't spill over into a second pool
+    size_t allocation_size = std::max<size_t>(1024 * 1024, rects->Length() * (sizeof(RectNamed) + sizeof(Vec2Named)) * 4);
+
+    auto selection = BinSelection(available_bins, rects, allocator);
+    PackingBound bound = selection.Bound(allocator);
+
+    PackingSearchResult* results[kPackingSearchCandidateCount];
+    for (size_t i=0; i<kPackingSearchCandidateCount; i++) {
+        results[i] = new PackingSearchResult(allocation_size);
+    }
+
+    // Nothing can beat a packing that meets the lower bound so once one does no more candidates are started
+    std::atomic<bool>   at_bound(false);
+    std::atomic<size_t> next_candidate(0);
+    PackingWorkers workers(threads);
+    workers.Run([&]() {
+        while (!at_bound.load()) {
+            size_t candidate = next_candidate.fetch_add(1);
+            if (candidate >= kPackingSearchCandidateCount) break;
+
+            // The first candidate is the fallback so only the others are held to the deadline
+            bool fallback = candidate == 0;
+            if (!fallback && PackingClock::now() >= deadline) break;
+
+            PackingSearchResult* result = results[candidate];
+            result->Pack(available_bins, rects, kPackingSearchCandidates[candidate], fallback ? PackingClock::time_point::max() : deadline);
+
+            // Anything still running at the deadline was cut off partway
+            result->done = fallback || PackingClock::now() < deadline;
+            if (result->done && MeetsBound(result, &bound, rects->Length())) at_bound = true;
+        }
+    });
+
+    PackingSearchResult* best = results[0];
+    size_t best_candidate = 0;
+    for (size_t i=0; i<kPackingSearchCandidateCount; i++) {
+        if (!results[i]->done) continue;
+
+        if (BetterPacking(results[i], best)) {
+            best           = results[i];
+            best_candidate = i;
+        }
+    }
+
+    // With more than one kind of bin the packers always open the first kind that fits, which can leave a lot of a
+    // big bin empty where a smaller one would have done
+    PackingSearchResult* selected = NULL;
+    bool complete = best->packed == rects->Length();
+    if (selection.kinds > 1 && complete && !MeetsBound(best, &bound, rects->Length()) && PackingClock::now() < deadline) {
+        selected = SelectBins(&selection, &bound, available_bins, rects, kPackingSearchCandidates[best_candidate], best, deadline, &workers, allocation_size, allocator);
+        if (selected) best = selected;
+    }
+
+    workers.Free();
+
+    *out_of_space = best->out_of_space;
+
+    // Copy the winner out before the candidates' allocators go away
+    auto bins = DynamicArrayEx<Bin, LinearAllocatorPool>(best->bins.Length(), allocator);
+    for (auto &from : best->bins) {
+        Bin bin = Bin(from.size, allocator);
+        for (auto &rect : from.rects) {
+            bin.rects.Push(rect, allocator);
+        }
+        bins.Push(bin, allocator);
+    }
+
+    for (size_t i=0; i<kPackingSearchCandidateCount; i++) {
+        results[i]->allocator.FreeAllocator();
+        delete results[i];
+    }
+
+    if (selected) {
+        selected->allocator.FreeAllocator();
+        delete selected;
+    }
+
+    return bins;
+}
+
+BinFreeAreas::BinFreeAreas(size_t estimated_areas) :
+    sizes(FreeAreaIndex(estimated_areas)),
+    positions(DynamicArray<SpatialIndex>(10)) {};
+
+void BinFreeAreas::Free() {
+    for (auto &bin : this->positions) {
+        bin.Free();
+    }
+
+    this->positions.Free();
+    this->sizes.Free();
+}
+
+size_t BinFreeAreas::AddBin(Vec2 size) {
+    size_t bin = this->positions.Length();
+
+    // The tree starts out empty so there's nothing to bulk load, it only has to be marked as built
+    auto positions  = SpatialIndex(16);
+    positions.built = true;
+    this->positions.Push(positions);
+
+    this->Add(Rect(Vec2(0.0f, 0.0f), size), bin);
+    return bin;
+}
+
+void BinFreeAreas::ResetBin(size_t bin, Vec2 size) {
+    Rect whole = Rect(Vec2(0.0f, 0.0f), size);
+
+    auto found = DynamicArray<size_t>(16);
+    this->QueryIntersecting(bin, whole, &found);
+    for (auto &area : found) {
+        this->Remove(area);
+    }
+    found.Free();
+
+    this->Add(whole, bin);
+}
+
+size_t BinFreeAreas::Add(Rect rect, size_t bin) {
+    size_t area = this->sizes.Insert(rect, bin);
+    this->sizes.Get(area)->leaf = this->positions[bin].Insert(area, rect);
+    return area;
+}
+
+void BinFreeAreas::Remove(size_t area) {
+    FreeArea* free_area = this->sizes.Get(area);
+    this->positions[free_area->bin].Remove(free_area->leaf);
+    this->sizes.Remove(area);
+}
+
+GuillotinePacker::GuillotinePacker(FreeAreaFit fit, size_t estimated_rects) :
+    areas(BinFreeAreas(estimated_rects)),
+    neighbours(DynamicArray<size_t>(16)),
+    fit(fit) {};
+
+void GuillotinePacker::Free() {
+    this->areas.Free();
+    this->neighbours.Free();
+}
+
+static inline bool Near(float a, float b) {
+    return fabsf(a - b) <= kPackingEpsilon;
+}
+
+void GuillotinePacker::AddMerged(Rect rect, size_t bin) {
+    if (rect.size.x <= kPackingEpsilon || rect.size.y <= kPackingEpsilon) return;
+
+    // Every merge makes the area bigger so this stops, and usually after a single pass
+    bool merged = true;
+    while (merged) {
+        merged = false;
+
+        this->neighbours.Clear();
+        this->areas.QueryIntersecting(bin, rect, &this->neighbours);
+
+        for (auto &id : this->neighbours) {
+            Rect other = this->areas.Get(id)->rect;
+
+            bool same_rows    = Near(other.Top(),  rect.Top())  && Near(other.Bottom(), rect.Bottom());
+            bool same_columns = Near(other.Left(), rect.Left()) && Near(other.Right(),  rect.Right());
+
+            bool side_by_side = same_rows    && (Near(other.Right(),  rect.Left()) || Near(rect.Right(),  other.Left()));
+            bool stacked      = same_columns && (Near(other.Bottom(), rect.Top())  || Near(rect.Bottom(), other.Top()));
+            if (!side_by_side && !stacked) continue;
+
+            // The edges that only nearly line up are pulled in rather than out, so rounding can't grow the area
+            // over a placed rect
+            if (side_by_side) {
+                rect = Rect::FromEdges(
+                    std::min<float>(rect.Left(),   other.Left()),
+                    std::max<float>(rect.Top(),    other.Top()),
+                    std::max<float>(rect.Right(),  other.Right()),
+                    std::min<float>(rect.Bottom(), other.Bottom())
+                );
+            } else {
+                rect = Rect::FromEdges(
+                    std::max<float>(rect.Left(),   other.Left()),
+                    std::min<float>(rect.Top(),    other.Top()),
+                    std::min<float>(rect.Right(),  other.Right()),
+                    std::max<float>(rect.Bottom(), other.Bottom())
+                );
+            }
+
+            this->areas.Remove(id);
+            merged = true;
+            break;
+        }
+    }
+
+    this->areas.Add(rect, bin);
+}
+
+void GuillotinePacker::Place(size_t area, Vec2 size) {
+    FreeArea* free_area = this->areas.Get(area);
+    Rect   rect = free_area->rect;
+    size_t bin  = free_area->bin;
+
+    this->areas.Remove(area);
+
+    // Keep whichever split leaves the biggest single area, since that's the one most likely to fit the next rects
+    RectPair vertical   = SplitVertical(&rect, size);
+    RectPair horizontal = SplitHorizontal(&rect, size);
+
+    float vertical_largest   = std::max<float>(vertical.a.Area(),   vertical.b.Area());
+    float horizontal_largest = std::max<float>(horizontal.a.Area(), horizontal.b.Area());
+    RectPair split = vertical_largest >= horizontal_largest ? vertical : horizontal;
+
+    this->AddMerged(split.a, bin);
+    this->AddMerged(split.b, bin);
 }
 
 RectPair SplitVertical(Rect *rect, Vec2 size) {
@@ -123,4 +1068,330 @@ RectPair SplitVertical(Rect *rect, Vec2 size) {
     Rect r2       = Rect(r2_start, r2_size);
 
     return RectPair { r1, r2 };
-}
\ No newline at end of file
+}
+
+RectPair SplitHorizontal(Rect *rect, Vec2 size) {
+    float left = rect->pos.x;
+    float top  = rect->pos.y;
+
+    float inner_right = left + size.x;
+    float inner_bot   = top  + size.y;
+
+    float outer_right = left + rect->size.x;
+    float outer_bot   = top  + rect->size.y;
+
+    Vec2 r1_start = Vec2(left, inner_bot);
+    Vec2 r1_size  = Vec2(outer_right - left, outer_bot - inner_bot);
+    Rect r1       = Rect(r1_start, r1_size);
+
+    Vec2 r2_start = Vec2(inner_right, top);
+    Vec2 r2_size  = Vec2(outer_right - inner_right, inner_bot - top);
+    Rect r2       = Rect(r2_start, r2_size);
+
+    return RectPair { r1, r2 };
+}
+
+MaxRectsPacker::MaxRectsPacker(FreeAreaFit fit, size_t estimated_rects) :
+    areas(BinFreeAreas(estimated_rects * 2)),
+    overlapping(DynamicArray<size_t>(16)),
+    splits(DynamicArray<Rect>(16)),
+    fit(fit) {};
+
+void MaxRectsPacker::Free() {
+    this->areas.Free();
+    this->overlapping.Free();
+    this->splits.Free();
+}
+
+// Whether the rects share more than an edge
+static inline bool Overlaps(Rect a, Rect b) {
+    return a.Left() < b.Right() && b.Left() < a.Right() && a.Top() < b.Bottom() && b.Top() < a.Bottom();
+}
+
+void MaxRectsPacker::Place(size_t area, Vec2 size) {
+    FreeArea* free_area = this->areas.Get(area);
+    this->Occupy(free_area->bin, Rect(free_area->rect.pos, size));
+}
+
+void MaxRectsPacker::Occupy(size_t bin, Rect placed) {
+    this->overlapping.Clear();
+    this->areas.QueryIntersecting(bin, placed, &this->overlapping);
+
+    // Every free area the placement overlaps is replaced by the up to four strips of it that are left on each side
+    this->splits.Clear();
+    for (auto &id : this->overlapping) {
+        Rect free = this->areas.Get(id)->rect;
+        if (!Overlaps(free, placed)) continue;
+
+        this->areas.Remove(id);
+
+        if (placed.Left() - free.Left() > kPackingEpsilon) {
+            this->splits.Push(Rect::FromEdges(free.Left(), free.Top(), placed.Left(), free.Bottom()));
+        }
+        if (free.Right() - placed.Right() > kPackingEpsilon) {
+            this->splits.Push(Rect::FromEdges(placed.Right(), free.Top(), free.Right(), free.Bottom()));
+        }
+        if (placed.Top() - free.Top() > kPackingEpsilon) {
+            this->splits.Push(Rect::FromEdges(free.Left(), free.Top(), free.Right(), placed.Top()));
+        }
+        if (free.Bottom() - placed.Bottom() > kPackingEpsilon) {
+            this->splits.Push(Rect::FromEdges(free.Left(), placed.Bottom(), free.Right(), free.Bottom()));
+        }
+    }
+
+    // The free areas are kept maximal, so a strip is only added when nothing else already covers it. The areas
+    // that were there before can't be inside a strip since each strip is part of an area that didn't contain them
+    for (size_t i=0; i<this->splits.Length(); i++) {
+        Rect split = this->splits[i];
+
+        bool covered = false;
+        for (size_t j=0; j<this->splits.Length() && !covered; j++) {
+            if (i == j) continue;
+
+            // Identical strips only keep the first of them
+            Rect other = this->splits[j];
+            covered = other.Contains(&split) && (j < i || !split.Contains(&other));
+        }
+
+        if (!covered) {
+            this->overlapping.Clear();
+            this->areas.QueryIntersecting(bin, split, &this->overlapping);
+            for (auto &id : this->overlapping) {
+                if (this->areas.Get(id)->rect.Contains(&split)) {
+                    covered = true;
+                    break;
+                }
+            }
+        }
+
+        if (!covered) {
+            this->areas.Add(split, bin);
+        }
+    }
+}
+
+IncrementalPacker::IncrementalPacker() :
+    packer(MaxRectsPacker(FreeAreaFit::BestShortSide, 16)),
+    options(PackingOptions()),
+    available_bins(DynamicArray<Vec2Many>(4)),
+    used_bins_count(DynamicArray<size_t>(4)),
+    bin_sizes(DynamicArray<Vec2>(16)),
+    placements(HashMap<size_t, PackedRect>(64)),
+    generation(0),
+    full_utilization(0.0f),
+    packed(false),
+    cache(NULL) {};
+
+void IncrementalPacker::Free() {
+    this->packer.Free();
+    this->available_bins.Free();
+    this->used_bins_count.Free();
+    this->bin_sizes.Free();
+    this->placements.Free();
+    this->placements.allocator.FreeAllocator();
+}
+
+size_t IncrementalPacker::OpenBin(Vec2 size) {
+    for (size_t i=0; i<this->available_bins.Length(); i++) {
+        Vec2Many* possible_bin = &this->available_bins[i];
+        size_t*   used         = &this->used_bins_count[i];
+
+        if (*used >= possible_bin->quantity || !possible_bin->vec2.Fits(size)) continue;
+
+        (*used)++;
+        this->bin_sizes.Push(possible_bin->vec2);
+        return this->packer.areas.AddBin(possible_bin->vec2);
+    }
+
+    return kNullArea;
+}
+
+DynamicArrayEx<Bin, LinearAllocatorPool> IncrementalPacker::Bins(LinearAllocatorPool* allocator, float *utilization) {
+    auto all = DynamicArrayEx<Bin, LinearAllocatorPool>(this->bin_sizes.Length(), allocator);
+    for (auto &size : this->bin_sizes) {
+        all.Push(Bin(size, allocator), allocator);
+    }
+
+    float used_area = 0.0f;
+    for (auto &entry : this->placements) {
+        all[entry.value.bin].rects.Push(Vec2Named(entry.value.rect.pos, entry.key), allocator);
+        used_area += entry.value.rect.Area();
+    }
+
+    // Bins that lost all of their rects stay open for later runs but aren't part of the layout
+    auto bins = DynamicArrayEx<Bin, LinearAllocatorPool>(all.Length(), allocator);
+    float bin_area = 0.0f;
+    for (auto &bin : all) {
+        if (!bin.rects.Length()) continue;
+
+        bins.Push(bin, allocator);
+        bin_area += bin.size.x * bin.size.y;
+    }
+
+    *utilization = bin_area > 0.0f ? used_area / bin_area : 1.0f;
+    return bins;
+}
+
+void IncrementalPacker::Reset(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<Bin,       LinearAllocatorPool>* bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects
+) {
+    this->packer.Free();
+    this->packer = MaxRectsPacker(this->options.fit, rects->Length());
+
+    this->available_bins.Clear();
+    this->used_bins_count.Clear();
+    for (auto &available_bin : *available_bins) {
+        this->available_bins.Push(available_bin);
+        this->used_bins_count.Push(0);
+    }
+
+    // The map is sized for the rects up front, with room for more, since growing it spills into another pool
+    this->bin_sizes.Clear();
+    this->placements.Free();
+    this->placements.allocator.FreeAllocator();
+    this->placements = HashMap<size_t, PackedRect>(std::max<size_t>(64, rects->Length() * 2));
+
+    // Bins only have the positions so the sizes come from the rects. Anything that didn't get packed is left without
+    // a bin and dropped below, so the next run tries it again
+    for (auto &rect : *rects) {
+        this->placements.Set(rect.id, PackedRect(kNullArea, rect.rect, this->generation));
+    }
+
+    float used_area = 0.0f;
+    float bin_area  = 0.0f;
+    for (auto &bin : *bins) {
+        for (size_t i=0; i<this->available_bins.Length(); i++) {
+            Vec2 size = this->available_bins[i].vec2;
+            if (size.x == bin.size.x && size.y == bin.size.y) {
+                this->used_bins_count[i]++;
+                break;
+            }
+        }
+
+        size_t id = this->packer.areas.AddBin(bin.size);
+        this->bin_sizes.Push(bin.size);
+        bin_area += bin.size.x * bin.size.y;
+
+        for (auto &packed : bin.rects) {
+            PackedRect* placement = this->placements.GetPtr(packed.id);
+            placement->bin      = id;
+            placement->rect.pos = packed.vec2;
+
+            this->packer.Occupy(id, placement->rect);
+            used_area += placement->rect.Area();
+        }
+    }
+
+    auto unpacked = DynamicArray<size_t>(4);
+    for (auto &entry : this->placements) {
+        if (entry.value.bin == kNullArea) unpacked.Push(entry.key);
+    }
+    for (auto &id : unpacked) {
+        this->placements.Remove(id);
+    }
+    unpacked.Free();
+
+    this->full_utilization = bin_area > 0.0f ? used_area / bin_area : 1.0f;
+    this->packed           = true;
+}
+
+DynamicArrayEx<Bin, LinearAllocatorPool> IncrementalPacker::Pack(
+        DynamicArrayEx<Vec2Many,  LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool>* rects,
+        float search_seconds,
+        bool* out_of_space,
+        LinearAllocatorPool* allocator
+) {
+    TRACE_FUNCTION();
+    this->generation++;
+
+    bool full = !this->packed || this->available_bins.Length() != available_bins->Length() ||
+        memcmp(this->available_bins.Data(), available_bins->Data(), available_bins->Length() * sizeof(Vec2Many));
+
+    if (!full) {
+        auto pending = DynamicArrayEx<RectNamed, LinearAllocatorPool>(16, allocator);
+        auto touched = DynamicArrayEx<bool, LinearAllocatorPool>(this->bin_sizes.Length(), allocator);
+        touched.Resize(this->bin_sizes.Length(), allocator);
+        memset(touched.Data(), 0, touched.Length() * sizeof(bool));
+
+        for (auto &rect : *rects) {
+            PackedRect* placement = this->placements.GetPtr(rect.id);
+            bool same_size = placement && placement->rect.size.x == rect.rect.size.x && placement->rect.size.y == rect.rect.size.y;
+            if (same_size) {
+                placement->seen = this->generation;
+                continue;
+            }
+
+            if (placement) {
+                touched[placement->bin] = true;
+                this->placements.Remove(rect.id);
+            }
+            pending.Push(rect, allocator);
+        }
+
+        // Whatever wasn't in rects this time was removed
+        auto removed = DynamicArrayEx<size_t, LinearAllocatorPool>(16, allocator);
+        for (auto &entry : this->placements) {
+            if (entry.value.seen == this->generation) continue;
+
+            touched[entry.value.bin] = true;
+            removed.Push(entry.key, allocator);
+        }
+        for (auto &id : removed) {
+            this->placements.Remove(id);
+        }
+
+        full = pending.Length() * 2 > rects->Length();
+        if (!full) {
+            // The free areas of a touched bin are rebuilt from scratch around the rects that are left in it
+            size_t touched_count = 0;
+            for (size_t bin=0; bin<touched.Length(); bin++) {
+                if (!touched[bin]) continue;
+
+                this->packer.areas.ResetBin(bin, this->bin_sizes[bin]);
+                touched_count++;
+            }
+
+            if (touched_count) {
+                for (auto &entry : this->placements) {
+                    if (touched[entry.value.bin]) this->packer.Occupy(entry.value.bin, entry.value.rect);
+                }
+            }
+
+            SortForPacking(&pending, this->options.order);
+            for (auto &rect : pending) {
+                Vec2 size   = rect.rect.size;
+                size_t area = this->packer.areas.FindBest(size, this->packer.fit);
+                if (area == kNullArea && this->OpenBin(size) != kNullArea) {
+                    area = this->packer.areas.FindBest(size, this->packer.fit);
+                }
+
+                if (area == kNullArea) {
+                    full = true;
+                    break;
+                }
+
+                FreeArea* free_area = this->packer.areas.Get(area);
+                this->placements.Set(rect.id, PackedRect(free_area->bin, Rect(free_area->rect.pos, size), this->generation));
+                this->packer.Place(area, size);
+            }
+
+            if (!full) {
+                float utilization;
+                auto bins = this->Bins(allocator, &utilization);
+
+                if (utilization >= this->full_utilization * kRepackUtilization) {
+                    *out_of_space = false;
+                    return bins;
+                }
+            }
+        }
+    }
+
+    auto bins = PackBinsCached(this->cache, available_bins, rects, this->options, search_seconds, out_of_space, allocator);
+
+    this->Reset(available_bins, &bins, rects);
+    return bins;
+}
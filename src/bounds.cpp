@@ -0,0 +1,265 @@
+#include "bounds.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+#include "lanes.hpp"
+
+BoundsStore::BoundsStore(size_t capacity) :
+    minx(DynamicArray<float>(capacity)),
+    miny(DynamicArray<float>(capacity)),
+    maxx(DynamicArray<float>(capacity)),
+    maxy(DynamicArray<float>(capacity)) {};
+
+void BoundsStore::Free() {
+    this->minx.Free();
+    this->miny.Free();
+    this->maxx.Free();
+    this->maxy.Free();
+}
+
+void BoundsStore::Push(Rect rect) {
+    this->minx.Push(rect.Left());
+    this->miny.Push(rect.Top());
+    this->maxx.Push(rect.Right());
+    this->maxy.Push(rect.Bottom());
+}
+
+void BoundsStore::Put(Rect rect, size_t index) {
+    this->minx.Put(rect.Left(),   index);
+    this->miny.Put(rect.Top(),    index);
+    this->maxx.Put(rect.Right(),  index);
+    this->maxy.Put(rect.Bottom(), index);
+}
+
+Rect BoundsStore::Get(size_t index) {
+    return Rect::FromEdges(this->minx[index], this->miny[index], this->maxx[index], this->maxy[index]);
+}
+
+void BoundsStore::RemoveIndex(size_t index) {
+    this->minx.RemoveIndex(index);
+    this->miny.RemoveIndex(index);
+    this->maxx.RemoveIndex(index);
+    this->maxy.RemoveIndex(index);
+}
+
+size_t BoundsStore::Length() {
+    // All of the columns are the same length so arbitrarily pick one of them
+    return this->minx.Length();
+}
+
+void BoundsStore::Clear() {
+    this->minx.Clear();
+    this->miny.Clear();
+    this->maxx.Clear();
+    this->maxy.Clear();
+}
+
+void BoundsStore::Resize(size_t length) {
+    this->minx.Resize(length);
+    this->miny.Resize(length);
+    this->maxx.Resize(length);
+    this->maxy.Resize(length);
+}
+
+BoundsStore BoundsStore::Clone() {
+    return BoundsStore(
+        this->minx.Clone(),
+        this->miny.Clone(),
+        this->maxx.Clone(),
+        this->maxy.Clone()
+    );
+}
+
+// Pushes base + i for every bit i set in mask
+static inline void PushMatches(int mask, size_t base, DynamicArray<size_t>* out) {
+    while (mask) {
+        int bit = __builtin_ctz(mask);
+        out->Push(base + bit);
+        mask &= mask - 1;
+    }
+}
+
+void FindBoundsContainedBy(BoundsStore* store, Rect area, DynamicArray<size_t>* out) {
+    float *minx = store->minx.Data();
+    float *miny = store->miny.Data();
+    float *maxx = store->maxx.Data();
+    float *maxy = store->maxy.Data();
+
+    size_t length = store->Length();
+    size_t i      = 0;
+
+    #ifdef LANES_SIMD
+    Lanes left   = SplatLanes(area.Left());
+    Lanes top    = SplatLanes(area.Top());
+    Lanes right  = SplatLanes(area.Right());
+    Lanes bottom = SplatLanes(area.Bottom());
+
+    for (; i + kLanes <= length; i += kLanes) {
+        Lanes inside = AndLanes(
+            AndLanes(LessEqualLanes(left, LoadLanes(minx + i)), LessEqualLanes(top,    LoadLanes(miny + i))),
+            AndLanes(LessEqualLanes(LoadLanes(maxx + i), right), LessEqualLanes(LoadLanes(maxy + i), bottom))
+        );
+
+        PushMatches(MaskLanes(inside), i, out);
+    }
+    #endif
+
+    for (; i < length; i++) {
+        if (area.Left()  <= minx[i] && area.Top()    <= miny[i] &&
+            area.Right() >= maxx[i] && area.Bottom() >= maxy[i]) {
+            out->Push(i);
+        }
+    }
+}
+
+void FindBoundsIntersecting(BoundsStore* store, Rect area, DynamicArray<size_t>* out) {
+    float *minx = store->minx.Data();
+    float *miny = store->miny.Data();
+    float *maxx = store->maxx.Data();
+    float *maxy = store->maxy.Data();
+
+    size_t length = store->Length();
+    size_t i      = 0;
+
+    #ifdef LANES_SIMD
+    Lanes left   = SplatLanes(area.Left());
+    Lanes top    = SplatLanes(area.Top());
+    Lanes right  = SplatLanes(area.Right());
+    Lanes bottom = SplatLanes(area.Bottom());
+
+    for (; i + kLanes <= length; i += kLanes) {
+        Lanes overlaps = AndLanes(
+            AndLanes(LessEqualLanes(LoadLanes(minx + i), right),  LessEqualLanes(left, LoadLanes(maxx + i))),
+            AndLanes(LessEqualLanes(LoadLanes(miny + i), bottom), LessEqualLanes(top,  LoadLanes(maxy + i)))
+        );
+
+        PushMatches(MaskLanes(overlaps), i, out);
+    }
+    #endif
+
+    for (; i < length; i++) {
+        if (minx[i] <= area.Right()  && area.Left() <= maxx[i] &&
+            miny[i] <= area.Bottom() && area.Top()  <= maxy[i]) {
+            out->Push(i);
+        }
+    }
+}
+
+void FindBoundsContainingPoint(BoundsStore* store, Vec2 point, float tolerance, DynamicArray<size_t>* out) {
+    // Growing every bound by the tolerance is the same as testing the bounds against a square around the point
+    Rect area = Rect::FromEdges(point.x - tolerance, point.y - tolerance, point.x + tolerance, point.y + tolerance);
+    FindBoundsIntersecting(store, area, out);
+}
+
+size_t FindFirstBoundsContaining(BoundsStore* store, size_t from, Rect rect) {
+    float *minx = store->minx.Data();
+    float *miny = store->miny.Data();
+    float *maxx = store->maxx.Data();
+    float *maxy = store->maxy.Data();
+
+    size_t length = store->Length();
+    size_t i      = from;
+
+    #ifdef LANES_SIMD
+    Lanes left   = SplatLanes(rect.Left());
+    Lanes top    = SplatLanes(rect.Top());
+    Lanes right  = SplatLanes(rect.Right());
+    Lanes bottom = SplatLanes(rect.Bottom());
+
+    for (; i + kLanes <= length; i += kLanes) {
+        Lanes contains = AndLanes(
+            AndLanes(LessEqualLanes(LoadLanes(minx + i), left),  LessEqualLanes(LoadLanes(miny + i), top)),
+            AndLanes(LessEqualLanes(right, LoadLanes(maxx + i)), LessEqualLanes(bottom, LoadLanes(maxy + i)))
+        );
+
+        int mask = MaskLanes(contains);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    #endif
+
+    for (; i < length; i++) {
+        if (minx[i] <= rect.Left()  && miny[i] <= rect.Top() &&
+            maxx[i] >= rect.Right() && maxy[i] >= rect.Bottom()) {
+            return i;
+        }
+    }
+
+    return kBoundsNotFound;
+}
+
+Rect UnionBounds(BoundsStore* store, size_t* indices, size_t count) {
+    float *minx = store->minx.Data();
+    float *miny = store->miny.Data();
+    float *maxx = store->maxx.Data();
+    float *maxy = store->maxy.Data();
+
+    float left   = minx[indices[0]];
+    float top    = miny[indices[0]];
+    float right  = maxx[indices[0]];
+    float bottom = maxy[indices[0]];
+
+    // Collections are usually only a handful of shapes so the gathered union stays scalar. The compiler turns
+    // the min / max into branchless instructions which is most of the win over Rect::Union.
+    for (size_t i=1; i<count; i++) {
+        size_t index = indices[i];
+        left   = std::min<float>(left,   minx[index]);
+        top    = std::min<float>(top,    miny[index]);
+        right  = std::max<float>(right,  maxx[index]);
+        bottom = std::max<float>(bottom, maxy[index]);
+    }
+
+    return Rect::FromEdges(left, top, right, bottom);
+}
+
+Rect UnionBoundsRange(BoundsStore* store, size_t start, size_t count) {
+    float *minx = store->minx.Data() + start;
+    float *miny = store->miny.Data() + start;
+    float *maxx = store->maxx.Data() + start;
+    float *maxy = store->maxy.Data() + start;
+
+    float left   = minx[0];
+    float top    = miny[0];
+    float right  = maxx[0];
+    float bottom = maxy[0];
+
+    size_t i = 0;
+
+    #ifdef LANES_SIMD
+    if (count >= kLanes) {
+        Lanes lefts   = LoadLanes(minx);
+        Lanes tops    = LoadLanes(miny);
+        Lanes rights  = LoadLanes(maxx);
+        Lanes bottoms = LoadLanes(maxy);
+
+        for (i = kLanes; i + kLanes <= count; i += kLanes) {
+            lefts   = MinLanes(lefts,   LoadLanes(minx + i));
+            tops    = MinLanes(tops,    LoadLanes(miny + i));
+            rights  = MaxLanes(rights,  LoadLanes(maxx + i));
+            bottoms = MaxLanes(bottoms, LoadLanes(maxy + i));
+        }
+
+        float reduce[4][kLanes];
+        StoreLanes(reduce[0], lefts);
+        StoreLanes(reduce[1], tops);
+        StoreLanes(reduce[2], rights);
+        StoreLanes(reduce[3], bottoms);
+
+        for (size_t lane=0; lane<kLanes; lane++) {
+            left   = std::min<float>(left,   reduce[0][lane]);
+            top    = std::min<float>(top,    reduce[1][lane]);
+            right  = std::max<float>(right,  reduce[2][lane]);
+            bottom = std::max<float>(bottom, reduce[3][lane]);
+        }
+    }
+    #endif
+
+    for (; i < count; i++) {
+        left   = std::min<float>(left,   minx[i]);
+        top    = std::min<float>(top,    miny[i]);
+        right  = std::max<float>(right,  maxx[i]);
+        bottom = std::max<float>(bottom, maxy[i]);
+    }
+
+    return Rect::FromEdges(left, top, right, bottom);
+}
@@ -0,0 +1,344 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "batch.hpp"
+#include "ds.hpp"
+#include "files.hpp"
+#include "packing_cache.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "svg.hpp"
+#include "sviggy.hpp"
+#include "trace.hpp"
+
+SysAllocator global_allocator = SysAllocator();
+
+// Same guess the app makes for how many shapes a file holds from its size
+constexpr size_t kBytesPerShapeEstimate = 250;
+
+// The longest output path a job can write to
+constexpr size_t kMaxOutputPath = 4096;
+
+// Smallest linear allocator handed to the pipeline for a document
+constexpr size_t kMinPipelinePoolSize = 4096;
+
+static void PrintUsage() {
+    printf("usage: sviggy-cli <pipeline spec> <output dir> <input.svg>... [--jobs N] [--trace trace.json] [--packing-cache dir] [--batch]\n");
+    printf("Runs the pipeline in the spec on every input and writes the results to the output dir with the same file names\n");
+    printf("Layouts reuse the packings in the packing cache dir and add theirs to it, the dir has to exist\n");
+    printf("With --batch the spec has to end in a layout, which packs the collections of every input together onto shared\n");
+    printf("sheets written as sheet-001.svg and so on, with batch.json saying where each collection came from\n");
+}
+
+static const char* BaseName(const char *path) {
+    const char *base = path;
+    for (const char *c=path; *c; c++) {
+        if (*c == '/' || *c == '\\') base = c + 1;
+    }
+
+    return base;
+}
+
+// Loads input, runs the pipeline in spec on it and writes the pipeline shapes into output_dir.
+// Every job has its own document and pipeline so jobs never share anything but the spec text and the packing cache,
+// which can be NULL.
+static bool RunJob(char *spec, size_t spec_length, char *input, char *output_dir, PackingCache *packing_cache) {
+    TRACE_FUNCTION();
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    size_t shape_estimation = std::max<size_t>(100, FileSize(input) / kBytesPerShapeEstimate);
+    Document doc = Document(shape_estimation);
+    PipelineActions pipeline = PipelineActions();
+    pipeline.packing_cache = packing_cache;
+
+    // BuildPipelineFromSpec edits the spec while it reads it so each job reads its own copy
+    char *job_spec = global_allocator.Alloc<char>(spec_length + 1);
+    std::memcpy(job_spec, spec, spec_length + 1);
+
+    bool ok = LoadSVGFile(input, &doc, NULL);
+    if (ok) {
+        ok = BuildPipelineFromSpec(job_spec, &pipeline);
+    }
+
+    if (ok) {
+        LinearAllocatorPool allocator = LinearAllocatorPool(std::max<size_t>(kMinPipelinePoolSize, doc.paths.Length() * 100));
+        pipeline.Run(&doc, &allocator);
+        allocator.FreeAllocator();
+
+        size_t unplaced = 0;
+        for (auto &stage : pipeline.stages) {
+            unplaced += stage.unplaced;
+        }
+        if (unplaced) printf("%s: %zu collections didn't fit in the layout bins\n", input, unplaced);
+
+        char output[kMaxOutputPath];
+        int written = snprintf(output, sizeof(output), "%s/%s", output_dir, BaseName(input));
+        ok = written > 0 && (size_t)written < sizeof(output);
+        if (ok) {
+            ok = WriteSVGFile(output, &doc.pipeline_shapes);
+        } else {
+            printf("Output path for %s is too long\n", input);
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    printf("%s %s: %zu shapes out in %.6f seconds\n", ok ? "Done" : "Failed", input, doc.pipeline_shapes.Length(), elapsed.count());
+
+    global_allocator.Free(job_spec);
+    pipeline.Free();
+    doc.Free();
+
+    return ok;
+}
+
+// Loads input into doc and runs every stage of the pipeline in spec but the last, which is the layout the whole batch
+// shares. doc keeps the pipeline shapes for the batch to move
+static bool RunBatchJob(char *spec, size_t spec_length, char *input, Document *doc) {
+    TRACE_FUNCTION();
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    PipelineActions pipeline = PipelineActions();
+
+    char *job_spec = global_allocator.Alloc<char>(spec_length + 1);
+    std::memcpy(job_spec, spec, spec_length + 1);
+
+    bool ok = LoadSVGFile(input, doc, NULL);
+    if (ok) {
+        ok = BuildPipelineFromSpec(job_spec, &pipeline);
+    }
+
+    if (ok) {
+        LinearAllocatorPool allocator = LinearAllocatorPool(std::max<size_t>(kMinPipelinePoolSize, doc->paths.Length() * 100));
+        pipeline.Run(doc, &allocator, pipeline.stages.Length() - 1);
+        allocator.FreeAllocator();
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    printf("%s %s: %zu shapes ready for the batch in %.6f seconds\n", ok ? "Loaded" : "Failed", input, doc->pipeline_shapes.Length(), elapsed.count());
+
+    global_allocator.Free(job_spec);
+    pipeline.Free();
+
+    return ok;
+}
+
+// Lays out the pipeline shapes of every document that loaded with layout and writes the sheets and the manifest
+// into output_dir. Returns how many files couldn't be written
+static size_t RunBatch(DynamicArray<Document*> *docs, DynamicArray<char*> *inputs, char *output_dir, PipelineLayout *layout, PackingCache *packing_cache) {
+    TRACE_FUNCTION();
+
+    auto documents = DynamicArray<Paths*>(docs->Length());
+    auto names     = DynamicArray<char*>(docs->Length());
+    size_t shapes  = 0;
+    for (size_t i=0; i<docs->Length(); i++) {
+        if (!(*docs)[i]) continue;
+
+        documents.Push(&(*docs)[i]->pipeline_shapes);
+        names.Push((*inputs)[i]);
+        shapes += (*docs)[i]->pipeline_shapes.Length();
+    }
+
+    LinearAllocatorPool allocator = LinearAllocatorPool(std::max<size_t>(kMinPipelinePoolSize, shapes * 100));
+    BatchLayout batch = RunBatchLayout(documents.Data(), documents.Length(), layout, packing_cache, &allocator);
+    printf("Batch packed %zu collections from %zu documents onto %zu sheets, %zu didn't fit\n",
+        batch.placements.Length(), documents.Length(), batch.sheets.Length(), batch.unplaced);
+
+    // Sheets only read the documents so they're written on every core
+    std::atomic<size_t> failures(0);
+    ParallelFor(batch.sheets.Length(), 1, [&](size_t chunk, size_t start, size_t end) {
+        TRACE_ZONE("Write Batch Sheets");
+
+        for (size_t sheet=start; sheet<end; sheet++) {
+            char output[kMaxOutputPath];
+            int written = snprintf(output, sizeof(output), "%s/sheet-%03zu.svg", output_dir, sheet + 1);
+            if (written <= 0 || (size_t)written >= sizeof(output)) {
+                printf("Output path for sheet %zu is too long\n", sheet + 1);
+                failures++;
+            } else if (!WriteSVGSheet(output, &batch, sheet, documents.Data(), names.Data())) {
+                failures++;
+            }
+        }
+    });
+
+    char manifest[kMaxOutputPath];
+    int written = snprintf(manifest, sizeof(manifest), "%s/batch.json", output_dir);
+    if (written <= 0 || (size_t)written >= sizeof(manifest)) {
+        printf("Output path for the batch manifest is too long\n");
+        failures++;
+    } else if (!WriteBatchManifest(manifest, &batch, names.Data())) {
+        printf("Couldn't write the batch manifest to %s\n", manifest);
+        failures++;
+    }
+
+    allocator.FreeAllocator();
+    documents.Free();
+    names.Free();
+
+    return failures.load();
+}
+
+int main(int argc, char **argv) {
+    size_t jobs = 0;
+    DynamicArray<char*> inputs = DynamicArray<char*>((size_t)argc);
+    char *spec_file   = NULL;
+    char *output_dir  = NULL;
+    char *trace_file  = NULL;
+    char *packing_dir = NULL;
+    bool batch        = false;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--jobs")) {
+            if (i + 1 >= argc || !(jobs = strtoull(argv[i + 1], NULL, 10))) {
+                PrintUsage();
+                return 1;
+            }
+
+            i++;
+        } else if (!strcmp(argv[i], "--trace")) {
+            if (i + 1 >= argc) {
+                PrintUsage();
+                return 1;
+            }
+
+            trace_file = argv[++i];
+        } else if (!strcmp(argv[i], "--packing-cache")) {
+            if (i + 1 >= argc) {
+                PrintUsage();
+                return 1;
+            }
+
+            packing_dir = argv[++i];
+        } else if (!strcmp(argv[i], "--batch")) {
+            batch = true;
+        } else if (!spec_file) {
+            spec_file = argv[i];
+        } else if (!output_dir) {
+            output_dir = argv[i];
+        } else {
+            inputs.Push(argv[i]);
+        }
+    }
+
+    if (!inputs.Length()) {
+        PrintUsage();
+        return 1;
+    }
+
+    size_t spec_length;
+    char *spec = ReadWholeFile(spec_file, &spec_length);
+    if (!spec) {
+        printf("Couldn't read the pipeline spec %s\n", spec_file);
+        return 1;
+    }
+
+    // Catch mistakes in the spec once up front instead of once per input. Filters look their tags up when they run
+    // so anything that compiles here compiles for every document. The checked pipeline is kept since a batch lays
+    // out every document with its last stage
+    char *check = global_allocator.Alloc<char>(spec_length + 1);
+    std::memcpy(check, spec, spec_length + 1);
+
+    PipelineActions checked = PipelineActions();
+    bool spec_ok = BuildPipelineFromSpec(check, &checked);
+    global_allocator.Free(check);
+
+    if (spec_ok && batch && (!checked.stages.Length() || checked.stages.LastPtr()->action.type != PipelineActionType::Layout)) {
+        printf("A batch spec has to end in a layout\n");
+        spec_ok = false;
+    }
+
+    if (!spec_ok) {
+        checked.Free();
+        return 1;
+    }
+
+    if (!jobs) {
+        jobs = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    jobs = std::min<size_t>(jobs, std::min<size_t>(inputs.Length(), kMaxParallelThreads));
+
+    PackingCache *packing_cache = packing_dir ? new PackingCache(packing_dir) : NULL;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Files vary a lot in size so instead of handing each worker a fixed range they all pull the next file off
+    // a shared counter until there aren't any left. Workers are started directly rather than with ParallelFor
+    // because --jobs is honored even past the number of cores
+    std::atomic<size_t> next_input(0);
+    std::atomic<size_t> failures(0);
+
+    // A batch keeps every document around until they've all been laid out together. Documents that failed are NULL
+    auto docs = DynamicArray<Document*>(batch ? inputs.Length() : 0);
+    if (batch) {
+        docs.Resize(inputs.Length());
+    }
+
+    auto worker = [&]() {
+        for (size_t input = next_input++; input < inputs.Length(); input = next_input++) {
+            if (!batch) {
+                if (!RunJob(spec, spec_length, inputs[input], output_dir, packing_cache)) failures++;
+                continue;
+            }
+
+            size_t shape_estimation = std::max<size_t>(100, FileSize(inputs[input]) / kBytesPerShapeEstimate);
+            Document *doc = new Document(shape_estimation);
+            if (!RunBatchJob(spec, spec_length, inputs[input], doc)) {
+                doc->Free();
+                delete doc;
+                doc = NULL;
+                failures++;
+            }
+
+            docs[input] = doc;
+        }
+    };
+
+    std::thread workers[kMaxParallelThreads];
+    for (size_t i=1; i<jobs; i++) {
+        workers[i] = std::thread(worker);
+    }
+
+    worker();
+
+    for (size_t i=1; i<jobs; i++) {
+        workers[i].join();
+    }
+
+    if (batch) {
+        if (failures.load() < inputs.Length()) {
+            failures += RunBatch(&docs, &inputs, output_dir, &checked.stages.LastPtr()->action.value.layout, packing_cache);
+        }
+
+        for (auto &doc : docs) {
+            if (!doc) continue;
+
+            doc->Free();
+            delete doc;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+    printf("Ran %zu files with %zu jobs in %.6f seconds, %zu failed\n", inputs.Length(), jobs, elapsed.count(), failures.load());
+    if (packing_cache) {
+        printf("Packing cache hits %zu misses %zu write failures %zu\n", packing_cache->hits.load(), packing_cache->misses.load(), packing_cache->write_failures.load());
+    }
+
+    if (trace_file && !WriteTraceFile(trace_file)) {
+        failures++;
+    }
+
+    global_allocator.Free(spec);
+    inputs.Free();
+    docs.Free();
+    checked.Free();
+    delete packing_cache;
+
+    return failures.load() ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <math.h>
+
+#include "bounds.hpp"
+#include "containment.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+
+ContainmentGrid::ContainmentGrid(Rect area, size_t estimated_items) :
+    entries(DynamicArray<ContainmentEntry>(estimated_items)),
+    originx(area.Left()),
+    originy(area.Top()) {
+
+    // Aim for roughly one cell per item with cells about as square as the area allows. Degenerate areas (a single
+    // point or everything on one line) still get a valid cell size so the division below never blows up.
+    float width  = std::max<float>(area.Width(),  1e-3f);
+    float height = std::max<float>(area.Height(), 1e-3f);
+
+    size_t cells = std::min<size_t>(std::max<size_t>(estimated_items, 1), kMaxContainmentCells);
+    this->columns = std::max<size_t>(1, (size_t)sqrtf(cells * width / height));
+    this->rows    = std::max<size_t>(1, cells / this->columns);
+
+    this->inverse_cell_width  = this->columns / width;
+    this->inverse_cell_height = this->rows    / height;
+
+    size_t cell_count = this->columns * this->rows;
+    this->cell_heads = DynamicArray<size_t>(cell_count);
+    this->cell_heads.Resize(cell_count);
+    std::fill(this->cell_heads.Data(), this->cell_heads.End(), kNoContainmentEntry);
+}
+
+void ContainmentGrid::Free() {
+    this->cell_heads.Free();
+    this->entries.Free();
+}
+
+size_t ContainmentGrid::Column(float x) {
+    float column = (x - this->originx) * this->inverse_cell_width;
+    return std::min<size_t>((size_t)std::max<float>(column, 0.0f), this->columns - 1);
+}
+
+size_t ContainmentGrid::Row(float y) {
+    float row = (y - this->originy) * this->inverse_cell_height;
+    return std::min<size_t>((size_t)std::max<float>(row, 0.0f), this->rows - 1);
+}
+
+void ContainmentGrid::Insert(size_t root, Rect bound) {
+    size_t first_column = this->Column(bound.Left());
+    size_t last_column  = this->Column(bound.Right());
+    size_t first_row    = this->Row(bound.Top());
+    size_t last_row     = this->Row(bound.Bottom());
+
+    for (size_t row=first_row; row<=last_row; row++) {
+        for (size_t column=first_column; column<=last_column; column++) {
+            size_t cell = row * this->columns + column;
+
+            ContainmentEntry entry;
+            entry.minx = bound.Left();
+            entry.miny = bound.Top();
+            entry.maxx = bound.Right();
+            entry.maxy = bound.Bottom();
+            entry.root = root;
+            entry.next = this->cell_heads[cell];
+
+            this->cell_heads[cell] = this->entries.Length();
+            this->entries.Push(entry);
+        }
+    }
+}
+
+size_t ContainmentGrid::FindSmallestContaining(Rect bound) {
+    // Anything containing the bound contains its top left corner so only that cell has to be searched
+    size_t cell  = this->Row(bound.Top()) * this->columns + this->Column(bound.Left());
+    size_t entry = this->cell_heads[cell];
+
+    size_t found      = kBoundsNotFound;
+    float  found_area = std::numeric_limits<float>::max();
+
+    ContainmentEntry *entries = this->entries.Data();
+    while (entry != kNoContainmentEntry) {
+        ContainmentEntry *e = &entries[entry];
+        if (e->minx <= bound.Left()  && e->miny <= bound.Top() &&
+            e->maxx >= bound.Right() && e->maxy >= bound.Bottom()) {
+
+            float area = (e->maxx - e->minx) * (e->maxy - e->miny);
+            if (area < found_area) {
+                found      = e->root;
+                found_area = area;
+            }
+        }
+
+        entry = e->next;
+    }
+
+    return found;
+}
+
+void FindContainers(BoundsStore* bounds, DynamicArray<size_t>* containers) {
+    size_t length = bounds->Length();
+    containers->Resize(length);
+    if (!length) return;
+
+    float *minx = bounds->minx.Data();
+    float *miny = bounds->miny.Data();
+    float *maxx = bounds->maxx.Data();
+    float *maxy = bounds->maxy.Data();
+
+    auto order = DynamicArray<size_t>(length);
+    order.Resize(length);
+    for (size_t i=0; i<length; i++) {
+        order[i] = i;
+    }
+
+    // Same ordering as SortRectPositionXY but read straight out of the columns. Identical bounds fall back to
+    // the index so the result doesn't depend on the sort implementation.
+    std::sort(order.Data(), order.End(), [=](size_t a, size_t b) {
+        if (minx[a] != minx[b]) return minx[a] < minx[b];
+        if (miny[a] != miny[b]) return miny[a] < miny[b];
+        if (maxx[a] != maxx[b]) return maxx[a] > maxx[b];
+        if (maxy[a] != maxy[b]) return maxy[a] > maxy[b];
+        return a < b;
+    });
+
+    auto grid = ContainmentGrid(UnionBoundsRange(bounds, 0, length), length);
+    for (auto index : order) {
+        Rect bound = bounds->Get(index);
+
+        size_t container = grid.FindSmallestContaining(bound);
+        if (container == kBoundsNotFound) {
+            container = index;
+            grid.Insert(index, bound);
+        }
+
+        (*containers)[index] = container;
+    }
+
+    grid.Free();
+    order.Free();
+}
@@ -13,6 +13,7 @@
 
 #include "dxstate.hpp"
 #include "sviggy.hpp"
+#include "trace.hpp"
 
 HRESULT DXState::CreateDeviceIndependentResources() {
     HRESULT hr;
@@ -269,6 +270,8 @@ HRESULT DXState::Resize(UINT width, UINT height) {
 }
 
 HRESULT DXState::Render(Document *doc, UIState *ui) {
+    TRACE_FUNCTION();
+
     HRESULT hr;
 
     ImGui_ImplDX11_NewFrame();
@@ -316,38 +319,81 @@ HRESULT DXState::Render(Document *doc, UIState *ui) {
 }
 
 void DXState::RenderPaths(Document *doc) {
-    HRESULT hr = S_OK;
+    TRACE_FUNCTION();
+
+    this->RenderPathsAtScale(&doc->paths, &doc->view);
+}
+
+// Draws the visible paths with the coarsest level of detail that's still within kFlattenTolerance pixels of
+// the real geometry at the current scale. Once no level is fine enough the full geometry is drawn
+void DXState::RenderPathsAtScale(Paths *paths, View *view) {
+    TRACE_FUNCTION();
+
+    auto visible = DynamicArray<size_t>(100);
+    this->FindVisiblePaths(paths, view, &visible);
+
+    float tolerance = kFlattenTolerance / (view->scale * kPixelsPerInch);
+    size_t level    = LodLevel(tolerance);
 
-    if (doc->view.scale < 0.1) {
-        return this->RenderPathsLowFidelity(&doc->paths);
+    if (level == kNoLod) {
+        this->RenderPathsHighFidelity(paths, &visible);
+    } else {
+        this->RenderPathsLod(paths, &visible, level);
     }
 
-    return this->RenderPathsHighFidelity(&doc->paths);
+    visible.Free();
+}
+
+// Only the paths that overlap the part of the document on screen get drawn
+void DXState::FindVisiblePaths(Paths *paths, View *view, DynamicArray<size_t>* visible) {
+    D2D1_SIZE_F size = this->d2_device_context->GetSize();
+    Rect area = view->VisibleArea(Vec2(size.width, size.height));
+
+    paths->QueryIntersecting(area, visible);
 }
 
-void DXState::RenderPathsLowFidelity(Paths *paths) {
-    for (auto &path : paths->low_fidelities) {
-        this->d2_device_context->DrawGeometryRealization(path, this->blackBrush);
+void DXState::RenderPathsLod(Paths *paths, DynamicArray<size_t>* visible, size_t level) {
+    TRACE_FUNCTION();
+
+    auto scratch = SegmentStore(64);
+
+    for (auto &index : *visible) {
+        ID2D1GeometryRealization** realization = &paths->lods[index].levels[level];
+        if (!(*realization)) {
+            CreateLodRealization(&paths->shapes[index], paths->transforms.Get(index), level, realization, &scratch, this);
+        }
+
+        this->d2_device_context->DrawGeometryRealization(*realization, this->blackBrush);
     }
+
+    scratch.Free();
 }
 
-void DXState::RenderPathsHighFidelity(Paths *paths) {
-    for (auto& path : paths->transformed_geometries) {
-        this->d2_device_context->DrawGeometry(path, this->blackBrush, kHairline);
+void DXState::RenderPathsHighFidelity(Paths *paths, DynamicArray<size_t>* visible) {
+    TRACE_FUNCTION();
+
+    for (auto &index : *visible) {
+        this->d2_device_context->DrawGeometry(paths->RealizedGeometry(this, index), this->blackBrush, kHairline);
     }
 }
 
 void DXState::RenderText(Document *doc) {
+    TRACE_FUNCTION();
+
     for (auto &text : doc->texts) {
         this->d2_device_context->DrawTextLayout(text.pos.D2Point(), text.layout, this->blackBrush, D2D1_DRAW_TEXT_OPTIONS_NONE);
     }
 }
 
 void DXState::RenderPipeline(Document *doc) {
-    this->RenderPathsHighFidelity(&doc->pipeline_shapes);
+    TRACE_FUNCTION();
+
+    this->RenderPathsAtScale(&doc->pipeline_shapes, &doc->view);
 }
 
 void DXState::RenderGridLines() {
+    TRACE_FUNCTION();
+
     this->d2_device_context->SetTransform(D2D1::Matrix3x2F::Identity());
     D2D1_SIZE_F size = d2_device_context->GetSize();
 
@@ -374,12 +420,16 @@ void DXState::RenderGridLines() {
 }
 
 void DXState::RenderDemoWindow(UIState *ui) {
+    TRACE_FUNCTION();
+
     if (!ui->show_demo_window) return;
 
     ImGui::ShowDemoWindow();
 }
 
 void DXState::RenderDebugWindow(UIState *ui, Document *doc) {
+    TRACE_FUNCTION();
+
     if (!ui->show_debug) return;
 
     ImGuiIO& io = ImGui::GetIO();
@@ -417,6 +467,8 @@ char cmd_view[] = "view";
 char cmd_zoom[] = "zoom";
 
 void DXState::RenderCommandPrompt(UIState *ui, Document *doc) {
+    TRACE_FUNCTION();
+
     if (!ui->show_command_prompt) {
         was_visible_previous_frame = false;
         return;
@@ -475,14 +527,16 @@ void DXState::RenderCommandPrompt(UIState *ui, Document *doc) {
 char tag_buf[256] = {0};
 
 void DXState::RenderActiveSelectionWindow(Document *doc) {
+    TRACE_FUNCTION();
+
     if (doc->active_shapes.Length() == 0) return;
 
     ImGui::Begin("Active Selection");
 
     for (auto &shape : doc->active_shapes) {
         if (ImGui::TreeNode(&shape, "Shape %zu\n", shape.id)) {
-            ShapeData* shape_data     = doc->paths.GetShapeData(shape.id);
-            Transformation* transform = &shape_data->transform;
+            // Edit the transform as parameters and hand it back through SetTransform which keeps the cached bounds up to date
+            Transformation transform = doc->paths.GetTransform(shape.id);
 
             size_t collection = doc->paths.collections.GetCollectionId(shape.id);
 
@@ -494,12 +548,17 @@ void DXState::RenderActiveSelectionWindow(Document *doc) {
             ImGui::Text("Pos: (%.3f, %.3f)", bound.Left(), bound.Top());
             ImGui::Text("Size: (%.3f, %.3f)", bound.Width(), bound.Height());
 
-            if(ImGui::DragFloat("Translation x", &transform->translation.x, 0.125)) doc->paths.RealizeGeometry(this, shape.id);
-            if(ImGui::DragFloat("Translation y", &transform->translation.y, 0.125)) doc->paths.RealizeGeometry(this, shape.id);
-            if(ImGui::DragFloat("Scale x",       &transform->scale.x,       0.125)) doc->paths.RealizeGeometry(this, shape.id);
-            if(ImGui::DragFloat("Scale y",       &transform->scale.y,       0.125)) doc->paths.RealizeGeometry(this, shape.id);
+            bool transform_changed = false;
+            if(ImGui::DragFloat("Translation x", &transform.translation.x, 0.125)) transform_changed = true;
+            if(ImGui::DragFloat("Translation y", &transform.translation.y, 0.125)) transform_changed = true;
+            if(ImGui::DragFloat("Scale x",       &transform.scale.x,       0.125)) transform_changed = true;
+            if(ImGui::DragFloat("Scale y",       &transform.scale.y,       0.125)) transform_changed = true;
 
-            if(ImGui::SliderFloat("Rotation", &transform->rotation, 0.0f, 360.0f)) doc->paths.RealizeGeometry(this, shape.id);
+            if(ImGui::SliderFloat("Rotation", &transform.rotation, 0.0f, 360.0f)) transform_changed = true;
+
+            if (transform_changed) {
+                doc->paths.SetTransform(shape.id, transform);
+            }
 
             ImGui::Text("Tags:");
             DynamicArray<TagId>* tags = doc->paths.tags.GetTags(shape.id);
@@ -529,6 +588,8 @@ void DXState::RenderActiveSelectionWindow(Document *doc) {
 }
 
 void DXState::RenderActiveSelectionBox(Document *doc, UIState *ui) {
+    TRACE_FUNCTION();
+
     if (!ui->is_selecting) return;
 
     float left  = ui->selection_start.x;
@@ -0,0 +1,157 @@
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ds.hpp"
+#include "files.hpp"
+
+// Longest path WriteWholeFileAtomically can make a temporary file next to
+constexpr size_t kMaxTemporaryPath = 4096;
+
+char* ReadWholeFile(char *file, size_t *length) {
+    FILE *f = fopen(file, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size < 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char *data = global_allocator.Alloc<char>((size_t)size + 1);
+    size_t read = fread(data, 1, (size_t)size, f);
+    fclose(f);
+
+    data[read] = 0;
+    if (length) *length = read;
+    return data;
+}
+
+size_t FileSize(char *file) {
+    FILE *f = fopen(file, "rb");
+    if (!f) return 0;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+
+    return size < 0 ? 0 : (size_t)size;
+}
+
+#ifdef _WIN32
+
+bool MapFile(char *file, MappedFile *mapped) {
+    HANDLE handle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || !size.QuadPart) {
+        CloseHandle(handle);
+        return false;
+    }
+
+    // The mapping keeps the file open by itself so the handle can go right away
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (!mapping) return false;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mapped->data   = data;
+    mapped->length = (size_t)size.QuadPart;
+    mapped->handle = mapping;
+    return true;
+}
+
+void MappedFile::Free() {
+    if (!this->data) return;
+
+    UnmapViewOfFile(this->data);
+    CloseHandle((HANDLE)this->handle);
+    this->data = NULL;
+}
+
+#else
+
+bool MapFile(char *file, MappedFile *mapped) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file open by itself so the descriptor can go right away
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    mapped->data   = data;
+    mapped->length = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::Free() {
+    if (!this->data) return;
+
+    munmap(this->data, this->length);
+    this->data = NULL;
+}
+
+#endif
+
+bool WriteWholeFileAtomically(char *file, void *data, size_t length) {
+    // Other threads and processes can be writing the same file at the same time so every write gets its own
+    // temporary file
+    static std::atomic<uint64_t> writes(0);
+    uint64_t unique = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^ (writes++ << 48);
+
+    char temporary[kMaxTemporaryPath];
+    int written = snprintf(temporary, sizeof(temporary), "%s.%016llx.tmp", file, (unsigned long long)unique);
+    if (written <= 0 || (size_t)written >= sizeof(temporary)) return false;
+
+    FILE *f = fopen(temporary, "wb");
+    if (!f) return false;
+
+    bool ok = fwrite(data, 1, length, f) == length;
+    ok = !fclose(f) && ok;
+
+    // Windows won't rename over a file that exists, in which case the file someone else just wrote is kept
+    if (ok && rename(temporary, file)) {
+        ok = FileSize(file) == length;
+    }
+
+    remove(temporary);
+    return ok;
+}
+
+void WriteJsonString(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s < 0x20) continue;
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
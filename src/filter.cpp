@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bounds.hpp"
+#include "ds.hpp"
+#include "filter.hpp"
+#include "lanes.hpp"
+#include "parallel.hpp"
+
+constexpr float kMillimetersPerInch = 25.4f;
+
+static bool IsFilterNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static char LowerFilterChar(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Recursive descent over the grammar in filter.hpp. Each rule emits its ops after the ops of its operands so the
+// program comes out in postfix order without building a tree first.
+class FilterParser {
+    public:
+    char                    *source;
+    char                    *at;
+    LinearAllocatorPool     *allocator;
+    FilterProgram           *program;
+    size_t                  depth; // Masks on the stack after the ops emitted so far
+    FilterParser(char* source, LinearAllocatorPool* allocator, FilterProgram* program) :
+        source(source),
+        at(source),
+        allocator(allocator),
+        program(program),
+        depth(0) {};
+
+    bool Fail(const char* message) {
+        printf("Filter error at column %zu: %s\n%s\n", (size_t)(this->at - this->source) + 1, message, this->source);
+        return false;
+    }
+
+    void SkipWhitespace() {
+        while (*this->at == ' ' || *this->at == '\t' || *this->at == '\r' || *this->at == '\n') this->at++;
+    }
+
+    // Consumes word if it's next in any case and isn't just the start of a longer name. word is lowercase
+    bool Keyword(const char* word) {
+        this->SkipWhitespace();
+
+        size_t length = strlen(word);
+        for (size_t i=0; i<length; i++) {
+            if (LowerFilterChar(this->at[i]) != word[i]) return false;
+        }
+        if (IsFilterNameChar(this->at[length])) return false;
+
+        this->at += length;
+        return true;
+    }
+
+    bool Symbol(const char* symbol) {
+        this->SkipWhitespace();
+
+        size_t length = strlen(symbol);
+        if (strncmp(this->at, symbol, length)) return false;
+
+        this->at += length;
+        return true;
+    }
+
+    bool Emit(FilterOp op) {
+        switch (op.type) {
+            case FilterOpType::Tag:
+            case FilterOpType::Collection:
+                this->program->leaves++;
+                this->depth++;
+                break;
+
+            case FilterOpType::Compare:
+                this->depth++;
+                break;
+
+            case FilterOpType::And:
+            case FilterOpType::Or:
+                this->depth--;
+                break;
+
+            case FilterOpType::Not:
+                break;
+        }
+
+        if (this->depth > kMaxFilterDepth) return this->Fail("expression is nested too deeply");
+
+        this->program->depth = std::max<size_t>(this->program->depth, this->depth);
+        this->program->ops.Push(op, this->allocator);
+        return true;
+    }
+
+    bool Expression() {
+        if (!this->Term()) return false;
+
+        while (this->Keyword("or")) {
+            if (!this->Term()) return false;
+            if (!this->Emit(FilterOp(FilterOpType::Or))) return false;
+        }
+
+        return true;
+    }
+
+    bool Term() {
+        if (!this->Factor()) return false;
+
+        while (this->Keyword("and")) {
+            if (!this->Factor()) return false;
+            if (!this->Emit(FilterOp(FilterOpType::And))) return false;
+        }
+
+        return true;
+    }
+
+    bool Factor() {
+        if (this->Keyword("not")) {
+            if (!this->Factor()) return false;
+            return this->Emit(FilterOp(FilterOpType::Not));
+        }
+
+        if (this->Symbol("(")) {
+            if (!this->Expression()) return false;
+            if (!this->Symbol(")")) return this->Fail("expected ')'");
+            return true;
+        }
+
+        if (this->Keyword("collection")) {
+            this->SkipWhitespace();
+
+            char *end;
+            unsigned long long id = strtoull(this->at, &end, 10);
+            if (end == this->at) return this->Fail("expected a collection id");
+            this->at = end;
+
+            FilterOp op = FilterOp(FilterOpType::Collection);
+            op.id = (size_t)id;
+            return this->Emit(op);
+        }
+
+        const char* fields[] = { "left", "top", "right", "bottom", "width", "height", "area" };
+        for (size_t field=0; field<sizeof(fields) / sizeof(fields[0]); field++) {
+            if (this->Keyword(fields[field])) {
+                return this->Comparison((FilterField)field);
+            }
+        }
+
+        return this->Tag();
+    }
+
+    bool Comparison(FilterField field) {
+        FilterOp op = FilterOp(FilterOpType::Compare);
+        op.field = field;
+
+        // The two character operators have to be checked before their one character prefixes
+        if      (this->Symbol("<=")) op.compare = FilterCompare::LessEqual;
+        else if (this->Symbol(">=")) op.compare = FilterCompare::GreaterEqual;
+        else if (this->Symbol("==")) op.compare = FilterCompare::Equal;
+        else if (this->Symbol("!=")) op.compare = FilterCompare::NotEqual;
+        else if (this->Symbol("<"))  op.compare = FilterCompare::Less;
+        else if (this->Symbol(">"))  op.compare = FilterCompare::Greater;
+        else return this->Fail("expected a comparison");
+
+        this->SkipWhitespace();
+
+        char *end;
+        op.value = strtof(this->at, &end);
+        if (end == this->at) return this->Fail("expected a number");
+        this->at = end;
+
+        if (this->Keyword("mm")) {
+            op.value /= kMillimetersPerInch;
+            if (field == FilterField::Area) op.value /= kMillimetersPerInch;
+        } else {
+            this->Keyword("in");
+        }
+
+        return this->Emit(op);
+    }
+
+    bool Tag() {
+        this->SkipWhitespace();
+
+        char *start = this->at;
+        char *end;
+        if (*start == '"') {
+            start++;
+            end = start;
+            while (*end && *end != '"') end++;
+            if (!*end) return this->Fail("unterminated tag name");
+            this->at = end + 1;
+        } else {
+            end = start;
+            while (IsFilterNameChar(*end)) end++;
+            if (end == start) return this->Fail("expected a tag, field, collection or '('");
+            this->at = end;
+        }
+
+        // Tags are looked up by name when the filter runs so the name is kept with the program
+        size_t length = end - start;
+        char *name = this->allocator->Alloc<char>(length + 1);
+        std::memcpy(name, start, length);
+        name[length] = 0;
+
+        FilterOp op = FilterOp(FilterOpType::Tag);
+        op.name = name;
+        return this->Emit(op);
+    }
+};
+
+bool CompileFilter(char* source, LinearAllocatorPool* allocator, FilterProgram* program) {
+    program->ops    = DynamicArrayEx<FilterOp, LinearAllocatorPool>(8, allocator);
+    program->depth  = 0;
+    program->leaves = 0;
+
+    FilterParser parser = FilterParser(source, allocator, program);
+    if (!parser.Expression()) return false;
+
+    parser.SkipWhitespace();
+    if (*parser.at) return parser.Fail("expected 'and', 'or' or the end of the filter");
+
+    return true;
+}
+
+static inline float FieldValue(FilterField field, float minx, float miny, float maxx, float maxy) {
+    switch (field) {
+        case FilterField::Left:   return minx;
+        case FilterField::Top:    return miny;
+        case FilterField::Right:  return maxx;
+        case FilterField::Bottom: return maxy;
+        case FilterField::Width:  return maxx - minx;
+        case FilterField::Height: return maxy - miny;
+        case FilterField::Area:   return (maxx - minx) * (maxy - miny);
+    }
+
+    return 0.0f;
+}
+
+static inline bool CompareValue(FilterCompare compare, float x, float value) {
+    switch (compare) {
+        case FilterCompare::Less:         return x <  value;
+        case FilterCompare::LessEqual:    return x <= value;
+        case FilterCompare::Greater:      return x >  value;
+        case FilterCompare::GreaterEqual: return x >= value;
+        case FilterCompare::Equal:        return x == value;
+        case FilterCompare::NotEqual:     return x != value;
+    }
+
+    return false;
+}
+
+#ifdef LANES_SIMD
+static inline Lanes FieldLanes(FilterField field, float *minx, float *miny, float *maxx, float *maxy) {
+    switch (field) {
+        case FilterField::Left:   return LoadLanes(minx);
+        case FilterField::Top:    return LoadLanes(miny);
+        case FilterField::Right:  return LoadLanes(maxx);
+        case FilterField::Bottom: return LoadLanes(maxy);
+        case FilterField::Width:  return SubLanes(LoadLanes(maxx), LoadLanes(minx));
+        case FilterField::Height: return SubLanes(LoadLanes(maxy), LoadLanes(miny));
+        case FilterField::Area:   return MulLanes(SubLanes(LoadLanes(maxx), LoadLanes(minx)), SubLanes(LoadLanes(maxy), LoadLanes(miny)));
+    }
+
+    return SplatLanes(0.0f);
+}
+
+// Bit per lane of x compared against value, matching CompareValue including for NaNs
+static inline int CompareLanes(FilterCompare compare, Lanes x, Lanes value) {
+    constexpr int all = (1 << kLanes) - 1;
+
+    switch (compare) {
+        case FilterCompare::Less:         return MaskLanes(LessLanes(x, value));
+        case FilterCompare::LessEqual:    return MaskLanes(LessEqualLanes(x, value));
+        case FilterCompare::Greater:      return MaskLanes(LessLanes(value, x));
+        case FilterCompare::GreaterEqual: return MaskLanes(LessEqualLanes(value, x));
+        case FilterCompare::Equal:        return MaskLanes(AndLanes(LessEqualLanes(x, value), LessEqualLanes(value, x)));
+        case FilterCompare::NotEqual:     return ~MaskLanes(AndLanes(LessEqualLanes(x, value), LessEqualLanes(value, x))) & all;
+    }
+
+    return 0;
+}
+#endif
+
+// Pushes the result of a comparison for count bounds starting at start into out
+static void CompareBlock(BoundsStore* bounds, size_t start, size_t count, FilterOp* op, unsigned char* out) {
+    float *minx = bounds->minx.Data() + start;
+    float *miny = bounds->miny.Data() + start;
+    float *maxx = bounds->maxx.Data() + start;
+    float *maxy = bounds->maxy.Data() + start;
+
+    size_t i = 0;
+
+    #ifdef LANES_SIMD
+    Lanes value = SplatLanes(op->value);
+    for (; i + kLanes <= count; i += kLanes) {
+        int mask = CompareLanes(op->compare, FieldLanes(op->field, minx + i, miny + i, maxx + i, maxy + i), value);
+        for (size_t lane=0; lane<kLanes; lane++) {
+            out[i + lane] = (mask >> lane) & 1;
+        }
+    }
+    #endif
+
+    for (; i < count; i++) {
+        out[i] = CompareValue(op->compare, FieldValue(op->field, minx[i], miny[i], maxx[i], maxy[i]), op->value);
+    }
+}
+
+void FilterProgram::Evaluate(BoundsStore* bounds, unsigned char* leaf_masks, bool* keep) {
+    size_t length = bounds->Length();
+    FilterOp *ops = this->ops.Data();
+    size_t op_count = this->ops.Length();
+
+    ParallelFor(length, kDefaultParallelChunk, [&](size_t chunk, size_t start, size_t end) {
+        unsigned char stack[kMaxFilterDepth][kFilterBlock];
+
+        for (size_t block=start; block<end; block+=kFilterBlock) {
+            size_t count = std::min<size_t>(kFilterBlock, end - block);
+            size_t top   = 0;
+            size_t leaf  = 0;
+
+            for (size_t i=0; i<op_count; i++) {
+                FilterOp *op = &ops[i];
+                switch (op->type) {
+                    case FilterOpType::Tag:
+                    case FilterOpType::Collection: {
+                        std::memcpy(stack[top], leaf_masks + leaf * length + block, count);
+                        top++;
+                        leaf++;
+                        break;
+                    }
+
+                    case FilterOpType::Compare: {
+                        CompareBlock(bounds, block, count, op, stack[top]);
+                        top++;
+                        break;
+                    }
+
+                    case FilterOpType::And: {
+                        top--;
+                        for (size_t j=0; j<count; j++) stack[top - 1][j] &= stack[top][j];
+                        break;
+                    }
+
+                    case FilterOpType::Or: {
+                        top--;
+                        for (size_t j=0; j<count; j++) stack[top - 1][j] |= stack[top][j];
+                        break;
+                    }
+
+                    case FilterOpType::Not: {
+                        for (size_t j=0; j<count; j++) stack[top - 1][j] ^= 1;
+                        break;
+                    }
+                }
+            }
+
+            for (size_t j=0; j<count; j++) {
+                keep[block + j] = stack[0][j];
+            }
+        }
+    });
+}
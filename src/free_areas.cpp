@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <math.h>
+
+#include "ds.hpp"
+#include "free_areas.hpp"
+
+constexpr size_t kFreeAreaClassOffset = kFreeAreaClasses / 2;
+
+size_t FreeAreaClass(float size) {
+    if (!(size > 0.0f)) return 0;
+
+    float c = floorf(log2f(size) * kFreeAreaClassesPerDoubling) + kFreeAreaClassOffset;
+    return (size_t)std::min<float>(std::max<float>(c, 0.0f), kFreeAreaClasses - 1);
+}
+
+// Smallest size that lands in each class, used to bound how good anything in a bucket can be
+class FreeAreaClassLows {
+    public:
+    float lows[kFreeAreaClasses];
+    FreeAreaClassLows() {
+        this->lows[0] = 0.0f;
+        for (size_t c=1; c<kFreeAreaClasses; c++) {
+            this->lows[c] = exp2f(((float)c - kFreeAreaClassOffset) / kFreeAreaClassesPerDoubling);
+        }
+    }
+};
+
+static float FreeAreaClassLow(size_t c) {
+    static FreeAreaClassLows table;
+    return table.lows[c];
+}
+
+FreeAreaIndex::FreeAreaIndex(size_t estimated_areas) :
+    areas(DynamicArray<FreeArea>(estimated_areas)),
+    free_slots(DynamicArray<size_t>(16)),
+    heads(DynamicArray<size_t>(kFreeAreaClasses * kFreeAreaClasses)),
+    masks(DynamicArray<uint64_t>(kFreeAreaClasses * kFreeAreaMaskWords)),
+    length(0) {
+
+    this->heads.Resize(kFreeAreaClasses * kFreeAreaClasses);
+    this->masks.Resize(kFreeAreaClasses * kFreeAreaMaskWords);
+    this->Clear();
+}
+
+void FreeAreaIndex::Free() {
+    this->areas.Free();
+    this->free_slots.Free();
+    this->heads.Free();
+    this->masks.Free();
+}
+
+void FreeAreaIndex::Clear() {
+    this->areas.Clear();
+    this->free_slots.Clear();
+    std::fill(this->heads.Data(), this->heads.Data() + this->heads.Length(), kNullArea);
+    std::fill(this->masks.Data(), this->masks.Data() + this->masks.Length(), 0);
+    this->length = 0;
+}
+
+size_t FreeAreaIndex::Insert(Rect rect, size_t bin) {
+    size_t id;
+    if (this->free_slots.Length()) {
+        id = this->free_slots.Last();
+        this->free_slots.RemoveIndex(this->free_slots.Length() - 1);
+        this->areas[id] = FreeArea(rect, bin);
+    } else {
+        id = this->areas.Length();
+        this->areas.Push(FreeArea(rect, bin));
+    }
+
+    size_t width_class  = FreeAreaClass(rect.size.x);
+    size_t height_class = FreeAreaClass(rect.size.y);
+    size_t bucket       = width_class * kFreeAreaClasses + height_class;
+
+    FreeArea* area = &this->areas[id];
+    area->bucket = bucket;
+    area->next   = this->heads[bucket];
+    if (area->next != kNullArea) this->areas[area->next].prev = id;
+    this->heads[bucket] = id;
+
+    this->masks[width_class * kFreeAreaMaskWords + height_class / 64] |= 1ull << (height_class % 64);
+    this->length++;
+
+    return id;
+}
+
+void FreeAreaIndex::Remove(size_t id) {
+    FreeArea* area = &this->areas[id];
+    size_t bucket  = area->bucket;
+
+    if (area->prev != kNullArea) this->areas[area->prev].next = area->next;
+    else                         this->heads[bucket]          = area->next;
+    if (area->next != kNullArea) this->areas[area->next].prev = area->prev;
+
+    if (this->heads[bucket] == kNullArea) {
+        size_t width_class  = bucket / kFreeAreaClasses;
+        size_t height_class = bucket % kFreeAreaClasses;
+        this->masks[width_class * kFreeAreaMaskWords + height_class / 64] &= ~(1ull << (height_class % 64));
+    }
+
+    area->bucket = kNullArea;
+    this->free_slots.Push(id);
+    this->length--;
+}
+
+// Lower bound on the score of anything in the bucket. The score goes up with both classes, which is what lets a
+// search stop walking a row as soon as the bound stops beating the best so far
+static inline float BucketBound(FreeAreaFit fit, size_t width_class, size_t height_class, Vec2 size) {
+    float width  = std::max<float>(FreeAreaClassLow(width_class),  size.x);
+    float height = std::max<float>(FreeAreaClassLow(height_class), size.y);
+
+    switch (fit) {
+        case FreeAreaFit::BestShortSide: return std::min<float>(width - size.x, height - size.y);
+        case FreeAreaFit::BestArea:      return width * height - size.x * size.y;
+    }
+
+    return 0.0f;
+}
+
+size_t FreeAreaIndex::FindBest(Vec2 size, FreeAreaFit fit) {
+    size_t min_width_class  = FreeAreaClass(size.x);
+    size_t min_height_class = FreeAreaClass(size.y);
+
+    size_t best           = kNullArea;
+    float  best_score     = std::numeric_limits<float>::infinity();
+    float  best_secondary = std::numeric_limits<float>::infinity();
+
+    for (size_t width_class=min_width_class; width_class<kFreeAreaClasses; width_class++) {
+        // For best area the bound only grows with the width class too so no later row can do better either
+        if (fit == FreeAreaFit::BestArea && BucketBound(fit, width_class, min_height_class, size) >= best_score) break;
+
+        uint64_t* row = &this->masks[width_class * kFreeAreaMaskWords];
+        bool row_done = false;
+
+        for (size_t word=min_height_class / 64; word<kFreeAreaMaskWords && !row_done; word++) {
+            uint64_t bits = row[word];
+            if (word == min_height_class / 64) bits &= ~0ull << (min_height_class % 64);
+
+            while (bits) {
+                size_t height_class = word * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+
+                if (BucketBound(fit, width_class, height_class, size) >= best_score) {
+                    row_done = true;
+                    break;
+                }
+
+                size_t probed = 0;
+                for (size_t id=this->heads[width_class * kFreeAreaClasses + height_class]; id!=kNullArea && probed<kFreeAreaProbe; id=this->areas[id].next) {
+                    FreeArea* area = &this->areas[id];
+                    if (!area->rect.size.Fits(size)) continue;
+
+                    probed++;
+
+                    float leftover_x = area->rect.size.x - size.x;
+                    float leftover_y = area->rect.size.y - size.y;
+                    float short_side = std::min<float>(leftover_x, leftover_y);
+
+                    float score     = 0.0f;
+                    float secondary = 0.0f;
+                    switch (fit) {
+                        case FreeAreaFit::BestShortSide:
+                            score     = short_side;
+                            secondary = std::max<float>(leftover_x, leftover_y);
+                            break;
+
+                        case FreeAreaFit::BestArea:
+                            score     = area->rect.Area() - size.x * size.y;
+                            secondary = short_side;
+                            break;
+                    }
+
+                    bool better = score < best_score ||
+                        (score == best_score && (secondary < best_secondary ||
+                        (secondary == best_secondary && area->bin < this->areas[best].bin)));
+
+                    if (better) {
+                        best           = id;
+                        best_score     = score;
+                        best_secondary = secondary;
+                    }
+                }
+            }
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,934 @@
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+
+#include "bin_packing.hpp"
+#include "ds.hpp"
+#include "nesting.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+using NestClock = std::chrono::steady_clock;
+
+// Starting room in the cache maps. They can grow past it but growing spills the map into another pool. Every pair of
+// shapes has up to 16 no-fit polygons so there's room for a lot more of them than shapes
+constexpr size_t kNestCacheShapes = 1024;
+constexpr size_t kNestCachePairs  = 16384;
+
+constexpr size_t kNestNone = std::numeric_limits<size_t>::max();
+
+static inline Vec2 Add(Vec2 a, Vec2 b) {
+    return Vec2(a.x + b.x, a.y + b.y);
+}
+
+static inline Vec2 Sub(Vec2 a, Vec2 b) {
+    return Vec2(a.x - b.x, a.y - b.y);
+}
+
+static inline float Cross(Vec2 a, Vec2 b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+// Twice the signed area, positive for counterclockwise points
+static float SignedArea2(Vec2 *points, size_t count) {
+    float area = 0.0f;
+    for (size_t i=0; i<count; i++) {
+        Vec2 a = points[i];
+        Vec2 b = points[i + 1 == count ? 0 : i + 1];
+        area += a.x * b.y - b.x * a.y;
+    }
+
+    return area;
+}
+
+// Whether point is more than margin inside the convex piece. The margin is scaled by the Manhattan length of each
+// edge instead of the real one to keep the square root out of the loop, which only makes it a little bigger
+static bool PieceContains(Vec2 *piece, size_t count, Vec2 point, float margin) {
+    if (count < 3) return false;
+
+    for (size_t i=0; i<count; i++) {
+        Vec2 a = piece[i];
+        Vec2 b = piece[i + 1 == count ? 0 : i + 1];
+
+        float ex = b.x - a.x;
+        float ey = b.y - a.y;
+        if (ex * (point.y - a.y) - ey * (point.x - a.x) <= margin * (fabsf(ex) + fabsf(ey))) return false;
+    }
+
+    return true;
+}
+
+// Unlike RemoveIndex this keeps the rest of the elements in order
+template <typename T>
+static void RemoveOrdered(DynamicArray<T> *array, size_t index) {
+    std::copy(array->Data() + index + 1, array->End(), array->Data() + index);
+    array->Resize(array->Length() - 1);
+}
+
+static inline bool RectContainsStrictly(Rect *rect, Vec2 point) {
+    return point.x > rect->Left() && point.x < rect->Right() && point.y > rect->Top() && point.y < rect->Bottom();
+}
+
+ConvexPieces::ConvexPieces(size_t estimated_points) :
+    points(DynamicArray<Vec2>(estimated_points)),
+    starts(DynamicArray<size_t>(8)),
+    bounds(DynamicArray<Rect>(8)),
+    bound(Rect(Vec2(0.0f, 0.0f), Vec2(0.0f, 0.0f))) {
+
+    this->starts.Push(0);
+}
+
+void ConvexPieces::Free() {
+    this->points.Free();
+    this->starts.Free();
+    this->bounds.Free();
+}
+
+void ConvexPieces::Clear() {
+    this->points.Clear();
+    this->starts.Clear();
+    this->starts.Push(0);
+    this->bounds.Clear();
+    this->bound = Rect(Vec2(0.0f, 0.0f), Vec2(0.0f, 0.0f));
+}
+
+void ConvexPieces::Push(Vec2 *points, size_t count) {
+    float left   = std::numeric_limits<float>::max();
+    float top    = std::numeric_limits<float>::max();
+    float right  = std::numeric_limits<float>::lowest();
+    float bottom = std::numeric_limits<float>::lowest();
+
+    for (size_t i=0; i<count; i++) {
+        this->points.Push(points[i]);
+
+        left   = std::min<float>(left,   points[i].x);
+        top    = std::min<float>(top,    points[i].y);
+        right  = std::max<float>(right,  points[i].x);
+        bottom = std::max<float>(bottom, points[i].y);
+    }
+
+    Rect piece = Rect::FromEdges(left, top, right, bottom);
+    this->bound = this->bounds.Length() ? this->bound.Union(&piece) : piece;
+    this->bounds.Push(piece);
+    this->starts.Push(this->points.Length());
+}
+
+bool ConvexPieces::ContainsStrictly(Vec2 point) {
+    if (!RectContainsStrictly(&this->bound, point)) return false;
+
+    for (size_t piece=0; piece<this->Length(); piece++) {
+        if (!RectContainsStrictly(&this->bounds[piece], point)) continue;
+
+        size_t count;
+        Vec2 *points = this->Piece(piece, &count);
+        if (PieceContains(points, count, point, kNestingTouch)) return true;
+    }
+
+    return false;
+}
+
+void NestPart::Free() {
+    this->pieces.Free();
+}
+
+// Andrew's monotone chain. Sorts points and writes their hull into hull counterclockwise, without the points along
+// its edges. hull needs room for 2 * count points. Returns how many points the hull has
+static size_t ConvexHull(Vec2 *points, size_t count, Vec2 *hull) {
+    std::sort(points, points + count, [](Vec2 a, Vec2 b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+
+    size_t length = 0;
+    for (size_t i=0; i<count; i++) {
+        while (length >= 2 && Cross(Sub(hull[length - 1], hull[length - 2]), Sub(points[i], hull[length - 2])) <= 0.0f) length--;
+        hull[length++] = points[i];
+    }
+
+    size_t lower = length + 1;
+    for (size_t i=count - 1; i-->0;) {
+        while (length >= lower && Cross(Sub(hull[length - 1], hull[length - 2]), Sub(points[i], hull[length - 2])) <= 0.0f) length--;
+        hull[length++] = points[i];
+    }
+
+    // The last point is the first one again, unless every point was the same
+    return count > 1 ? length - 1 : length;
+}
+
+// Scratch for splitting outlines into convex pieces
+class ConvexSplit {
+    public:
+    DynamicArray<Vec2>   points;
+    DynamicArray<size_t> remaining; // Points of the outline that haven't been cut off as an ear yet
+    DynamicArray<size_t> indices;   // Points of every polygon, by index into points
+    DynamicArray<size_t> starts;    // Of each polygon in indices
+    DynamicArray<size_t> counts;
+    DynamicArray<bool>   alive;     // Merged polygons are left in place and marked dead
+    DynamicArray<Vec2>   piece;
+    ConvexSplit() :
+        points(DynamicArray<Vec2>(64)),
+        remaining(DynamicArray<size_t>(64)),
+        indices(DynamicArray<size_t>(256)),
+        starts(DynamicArray<size_t>(64)),
+        counts(DynamicArray<size_t>(64)),
+        alive(DynamicArray<bool>(64)),
+        piece(DynamicArray<Vec2>(64)) {};
+
+    void Free() {
+        this->points.Free();
+        this->remaining.Free();
+        this->indices.Free();
+        this->starts.Free();
+        this->counts.Free();
+        this->alive.Free();
+        this->piece.Free();
+    }
+
+    void AddPolygon(size_t *polygon, size_t count) {
+        this->starts.Push(this->indices.Length());
+        this->counts.Push(count);
+        this->alive.Push(true);
+        for (size_t i=0; i<count; i++) {
+            this->indices.Push(polygon[i]);
+        }
+    }
+
+    size_t Point(size_t polygon, size_t i) {
+        return this->indices[this->starts[polygon] + i % this->counts[polygon]];
+    }
+
+    bool Triangulate();
+    bool MergeOnce();
+};
+
+static bool TriangleContains(Vec2 a, Vec2 b, Vec2 c, Vec2 p) {
+    return Cross(Sub(b, a), Sub(p, a)) >= 0.0f && Cross(Sub(c, b), Sub(p, b)) >= 0.0f && Cross(Sub(a, c), Sub(p, c)) >= 0.0f;
+}
+
+// Cuts the counterclockwise outline in points into triangles by clipping ears. Returns false when it gets stuck,
+// which happens when the outline crosses itself
+bool ConvexSplit::Triangulate() {
+    this->remaining.Clear();
+    for (size_t i=0; i<this->points.Length(); i++) {
+        this->remaining.Push(i);
+    }
+
+    while (this->remaining.Length() > 3) {
+        size_t count = this->remaining.Length();
+        bool clipped = false;
+
+        for (size_t i=0; i<count && !clipped; i++) {
+            size_t prev = this->remaining[(i + count - 1) % count];
+            size_t at   = this->remaining[i];
+            size_t next = this->remaining[(i + 1) % count];
+
+            Vec2 a = this->points[prev];
+            Vec2 b = this->points[at];
+            Vec2 c = this->points[next];
+
+            // A point along a straight stretch of the outline isn't needed at all
+            float turn = Cross(Sub(b, a), Sub(c, b));
+            if (turn == 0.0f) {
+                RemoveOrdered(&this->remaining, i);
+                clipped = true;
+                break;
+            }
+
+            if (turn < 0.0f) continue;
+
+            bool ear = true;
+            for (size_t j=0; j<count && ear; j++) {
+                size_t other = this->remaining[j];
+                if (other == prev || other == at || other == next) continue;
+
+                ear = !TriangleContains(a, b, c, this->points[other]);
+            }
+
+            if (ear) {
+                size_t triangle[3] = { prev, at, next };
+                this->AddPolygon(triangle, 3);
+                RemoveOrdered(&this->remaining, i);
+                clipped = true;
+            }
+        }
+
+        if (!clipped) return false;
+    }
+
+    if (this->remaining.Length() == 3) {
+        Vec2 a = this->points[this->remaining[0]];
+        Vec2 b = this->points[this->remaining[1]];
+        Vec2 c = this->points[this->remaining[2]];
+        if (Cross(Sub(b, a), Sub(c, b)) > 0.0f) this->AddPolygon(this->remaining.Data(), 3);
+    }
+
+    return true;
+}
+
+// Merges the first two polygons it finds that share an edge and make a convex polygon together. This is
+// Hertel-Mehlhorn's way of getting from a triangulation to a handful of convex pieces, which ends up with at most
+// four times as many pieces as the fewest possible
+bool ConvexSplit::MergeOnce() {
+    size_t polygons = this->counts.Length();
+
+    for (size_t a=0; a<polygons; a++) {
+        if (!this->alive[a]) continue;
+
+        for (size_t b=a + 1; b<polygons; b++) {
+            if (!this->alive[b]) continue;
+
+            size_t count_a = this->counts[a];
+            size_t count_b = this->counts[b];
+
+            for (size_t i=0; i<count_a; i++) {
+                size_t from = this->Point(a, i);
+                size_t to   = this->Point(a, i + 1);
+
+                // Both are counterclockwise so b has the shared edge going the other way
+                size_t j = 0;
+                while (j < count_b && !(this->Point(b, j) == to && this->Point(b, j + 1) == from)) j++;
+                if (j == count_b) continue;
+
+                // All of a starting from the end of the shared edge, then the rest of b
+                this->piece.Clear();
+                auto merged = DynamicArray<size_t>(count_a + count_b);
+                for (size_t k=0; k<count_a; k++) {
+                    merged.Push(this->Point(a, i + 1 + k));
+                }
+                for (size_t k=2; k<count_b; k++) {
+                    merged.Push(this->Point(b, j + k));
+                }
+
+                bool convex = true;
+                for (size_t k=0; k<merged.Length() && convex; k++) {
+                    Vec2 p = this->points[merged[k]];
+                    Vec2 q = this->points[merged[(k + 1) % merged.Length()]];
+                    Vec2 r = this->points[merged[(k + 2) % merged.Length()]];
+                    convex = Cross(Sub(q, p), Sub(r, q)) >= 0.0f;
+                }
+
+                if (convex) {
+                    this->alive[a] = false;
+                    this->alive[b] = false;
+                    this->AddPolygon(merged.Data(), merged.Length());
+                }
+
+                merged.Free();
+                if (convex) return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Adds the convex pieces of a closed outline to pieces. Returns false when the outline can't be split, in which case
+// nothing was added
+static bool SplitConvex(Vec2 *outline, size_t count, ConvexSplit *split, ConvexPieces *pieces) {
+    split->points.Clear();
+    split->indices.Clear();
+    split->starts.Clear();
+    split->counts.Clear();
+    split->alive.Clear();
+
+    // Repeated points would make zero length edges
+    for (size_t i=0; i<count; i++) {
+        Vec2 p = outline[i];
+        if (split->points.Length() && split->points.LastPtr()->x == p.x && split->points.LastPtr()->y == p.y) continue;
+        split->points.Push(p);
+    }
+    while (split->points.Length() > 1 && split->points[0].x == split->points.LastPtr()->x && split->points[0].y == split->points.LastPtr()->y) {
+        RemoveOrdered(&split->points, split->points.Length() - 1);
+    }
+
+    float area = SignedArea2(split->points.Data(), split->points.Length());
+    if (split->points.Length() < 3 || area == 0.0f) return false;
+    if (area < 0.0f) std::reverse(split->points.Data(), split->points.End());
+
+    if (!split->Triangulate()) return false;
+    while (split->MergeOnce());
+
+    for (size_t polygon=0; polygon<split->counts.Length(); polygon++) {
+        if (!split->alive[polygon]) continue;
+
+        split->piece.Clear();
+        for (size_t i=0; i<split->counts[polygon]; i++) {
+            split->piece.Push(split->points[split->Point(polygon, i)]);
+        }
+        pieces->Push(split->piece.Data(), split->piece.Length());
+    }
+
+    return true;
+}
+
+// A run of connected segments in the flattened outlines
+class NestFigure {
+    public:
+    size_t start, count;
+    bool   closed;
+    Rect   bound;
+    NestFigure(size_t start, size_t count, bool closed, Rect bound) : start(start), count(count), closed(closed), bound(bound) {};
+};
+
+NestPart BuildNestPart(SegmentStore *outlines, Rect bound) {
+    auto points  = DynamicArray<Vec2>(outlines->Length() + 1);
+    auto figures = DynamicArray<NestFigure>(4);
+
+    // FlattenPath writes each figure's segments one after another, so a segment that doesn't start where the last one
+    // ended starts a new figure
+    for (size_t i=0; i<outlines->Length(); i++) {
+        Vec2 from = Vec2(outlines->x0[i] - bound.Left(), outlines->y0[i] - bound.Top());
+        Vec2 to   = Vec2(outlines->x1[i] - bound.Left(), outlines->y1[i] - bound.Top());
+
+        bool connected = figures.Length() && points.LastPtr()->x == from.x && points.LastPtr()->y == from.y;
+        if (!connected) {
+            figures.Push(NestFigure(points.Length(), 0, false, Rect(from, Vec2(0.0f, 0.0f))));
+            points.Push(from);
+        }
+        points.Push(to);
+    }
+
+    for (auto &figure : figures) {
+        size_t end = figure.start;
+        while (end < points.Length() && (&figure == figures.LastPtr() || end < (&figure + 1)->start)) end++;
+        figure.count = end - figure.start;
+
+        Vec2 first = points[figure.start];
+        Vec2 last  = points[end - 1];
+        figure.closed = figure.count > 2 && first.x == last.x && first.y == last.y;
+        if (figure.closed) figure.count--;
+
+        for (size_t i=figure.start; i<figure.start + figure.count; i++) {
+            Rect point = Rect(points[i], Vec2(0.0f, 0.0f));
+            figure.bound = figure.bound.Union(&point);
+        }
+    }
+
+    // Outlines that fit inside a piece of a bigger one don't need pieces of their own, so the biggest go first
+    std::sort(figures.Data(), figures.End(), [](NestFigure a, NestFigure b) {
+        return a.bound.Area() > b.bound.Area() || (a.bound.Area() == b.bound.Area() && a.start < b.start);
+    });
+
+    auto pieces  = ConvexPieces(points.Length());
+    auto split   = ConvexSplit();
+    auto scratch = DynamicArray<Vec2>(64);
+    auto hull    = DynamicArray<Vec2>(64);
+
+    for (auto &figure : figures) {
+        Vec2 *outline = &points[figure.start];
+
+        bool covered = pieces.Length() > 0;
+        for (size_t i=0; i<figure.count && covered; i++) {
+            bool inside = false;
+            for (size_t piece=0; piece<pieces.Length() && !inside; piece++) {
+                size_t count;
+                Vec2 *piece_points = pieces.Piece(piece, &count);
+                inside = PieceContains(piece_points, count, outline[i], -kNestingTolerance);
+            }
+            covered = inside;
+        }
+        if (covered) continue;
+
+        if (figure.closed && figure.count <= kNestingMaxSplitPoints && SplitConvex(outline, figure.count, &split, &pieces)) continue;
+
+        scratch.Clear();
+        for (size_t i=0; i<figure.count; i++) {
+            scratch.Push(outline[i]);
+        }
+        hull.Resize(2 * figure.count + 1);
+
+        size_t length = ConvexHull(scratch.Data(), scratch.Length(), hull.Data());
+        if (length >= 2) pieces.Push(hull.Data(), length);
+    }
+
+    // Nothing but single points, so the part is as big as its bounds say
+    if (!pieces.Length()) {
+        Vec2 corners[4] = { Vec2(0.0f, 0.0f), Vec2(bound.size.x, 0.0f), Vec2(bound.size.x, bound.size.y), Vec2(0.0f, bound.size.y) };
+        pieces.Push(corners, 4);
+    }
+
+    float area = 0.0f;
+    for (size_t piece=0; piece<pieces.Length(); piece++) {
+        size_t count;
+        Vec2 *piece_points = pieces.Piece(piece, &count);
+        area += SignedArea2(piece_points, count) / 2.0f;
+    }
+
+    uint64_t shape = HashBytes(kHashBytesSeed, &bound.size, sizeof(bound.size));
+    shape = HashBytes(shape, pieces.points.Data(), pieces.points.Length() * sizeof(Vec2));
+    shape = HashBytes(shape, pieces.starts.Data(), pieces.starts.Length() * sizeof(size_t));
+
+    points.Free();
+    figures.Free();
+    split.Free();
+    scratch.Free();
+    hull.Free();
+
+    return NestPart(pieces, bound.size, area, shape);
+}
+
+Mat3x2 NestRotation(size_t quarter_turns, Vec2 size) {
+    switch (quarter_turns % kNestingQuarterTurns) {
+        case 1:  return Mat3x2( 0.0f,  1.0f, -1.0f,  0.0f, size.y, 0.0f);
+        case 2:  return Mat3x2(-1.0f,  0.0f,  0.0f, -1.0f, size.x, size.y);
+        case 3:  return Mat3x2( 0.0f, -1.0f,  1.0f,  0.0f, 0.0f,   size.x);
+        default: return Mat3x2();
+    }
+}
+
+static Vec2 TurnedSize(size_t quarter_turns, Vec2 size) {
+    return quarter_turns % 2 ? Vec2(size.y, size.x) : size;
+}
+
+// Turning keeps the points counterclockwise since it doesn't mirror anything
+static void TurnPieces(ConvexPieces *from, size_t quarter_turns, Vec2 size, ConvexPieces *out, DynamicArray<Vec2> *scratch) {
+    Mat3x2 turn = NestRotation(quarter_turns, size);
+
+    for (size_t piece=0; piece<from->Length(); piece++) {
+        size_t count;
+        Vec2 *points = from->Piece(piece, &count);
+
+        scratch->Clear();
+        for (size_t i=0; i<count; i++) {
+            scratch->Push(turn.Apply(points[i]));
+        }
+        out->Push(scratch->Data(), scratch->Length());
+    }
+}
+
+// Index of the lowest point, the leftmost of them on a tie
+static size_t LowestPoint(Vec2 *points, size_t count) {
+    size_t lowest = 0;
+    for (size_t i=1; i<count; i++) {
+        if (points[i].y < points[lowest].y || (points[i].y == points[lowest].y && points[i].x < points[lowest].x)) lowest = i;
+    }
+
+    return lowest;
+}
+
+// Pushes the Minkowski sum of the convex pieces a and -b onto out, which is every offset of b from a where they
+// overlap. Both pieces' edges are already sorted by angle going counterclockwise, so starting both from their lowest
+// point the sum is a merge of the two
+static void PushMinkowskiDifference(Vec2 *a, size_t count_a, Vec2 *b, size_t count_b, DynamicArray<Vec2> *scratch, ConvexPieces *out) {
+    scratch->Clear();
+
+    size_t start_a = LowestPoint(a, count_a);
+    for (size_t i=0; i<count_a + 2; i++) {
+        scratch->Push(a[(start_a + i) % count_a]);
+    }
+
+    // Negating b turns it half way around, which keeps it counterclockwise
+    auto negated = DynamicArray<Vec2>(count_b);
+    for (size_t i=0; i<count_b; i++) {
+        negated.Push(Vec2(-b[i].x, -b[i].y));
+    }
+    size_t start_b = LowestPoint(negated.Data(), count_b);
+    for (size_t i=0; i<count_b + 2; i++) {
+        scratch->Push(negated[(start_b + i) % count_b]);
+    }
+    negated.Free();
+
+    Vec2 *p = scratch->Data();
+    Vec2 *q = scratch->Data() + count_a + 2;
+
+    auto sum = DynamicArray<Vec2>(count_a + count_b);
+    size_t i = 0;
+    size_t j = 0;
+    while (i < count_a || j < count_b) {
+        sum.Push(Add(p[i], q[j]));
+
+        float cross = Cross(Sub(p[i + 1], p[i]), Sub(q[j + 1], q[j]));
+        if (cross >= 0.0f && i < count_a) i++;
+        if (cross <= 0.0f && j < count_b) j++;
+    }
+
+    out->Push(sum.Data(), sum.Length());
+    sum.Free();
+}
+
+static void MakeNoFitPolygon(ConvexPieces *fixed, ConvexPieces *moving, DynamicArray<Vec2> *scratch, ConvexPieces *out) {
+    for (size_t a=0; a<fixed->Length(); a++) {
+        size_t count_a;
+        Vec2 *points_a = fixed->Piece(a, &count_a);
+
+        for (size_t b=0; b<moving->Length(); b++) {
+            size_t count_b;
+            Vec2 *points_b = moving->Piece(b, &count_b);
+
+            PushMinkowskiDifference(points_a, count_a, points_b, count_b, scratch, out);
+        }
+    }
+}
+
+NestCache::NestCache() :
+    shapes(HashMap<uint64_t, size_t>(kNestCacheShapes)),
+    index(HashMap<uint64_t, size_t>(kNestCachePairs)),
+    nfps(DynamicArray<ConvexPieces>(64)) {};
+
+void NestCache::Free() {
+    for (auto &nfp : this->nfps) {
+        nfp.Free();
+    }
+    this->nfps.Free();
+
+    this->shapes.Free();
+    this->shapes.allocator.FreeAllocator();
+    this->index.Free();
+    this->index.allocator.FreeAllocator();
+}
+
+size_t NestCache::ShapeIndex(uint64_t shape) {
+    size_t *found = this->shapes.GetPtr(shape);
+    if (found) return *found;
+
+    size_t index = this->shapes.Length();
+    this->shapes.Set(shape, index);
+    return index;
+}
+
+// A part's kind is its shape and how far it's turned
+static inline size_t NestKind(size_t shape_index, size_t quarter_turns) {
+    return shape_index * kNestingQuarterTurns + quarter_turns;
+}
+
+static inline uint64_t NestPairKey(size_t fixed_kind, size_t moving_kind) {
+    return ((uint64_t)fixed_kind << 32) | (uint64_t)moving_kind;
+}
+
+class NestPlaced {
+    public:
+    size_t kind;
+    Vec2   pos;
+    NestPlaced(size_t kind, Vec2 pos) : kind(kind), pos(pos) {};
+};
+
+class NestSheet {
+    public:
+    Vec2                                             size;
+    float                                            free_area;
+    DynamicArrayEx<NestPlaced, LinearAllocatorPool>  placed;
+    NestSheet(Vec2 size, LinearAllocatorPool *allocator) :
+        size(size),
+        free_area(size.x * size.y),
+        placed(DynamicArrayEx<NestPlaced, LinearAllocatorPool>(16, allocator)) {};
+};
+
+class NestPair {
+    public:
+    size_t fixed, moving;
+    NestPair(size_t fixed, size_t moving) : fixed(fixed), moving(moving) {};
+};
+
+// Everything a nesting run keeps around between parts
+class NestRun {
+    public:
+    NestCache                                      *cache;
+    DynamicArray<ConvexPieces>                     turned;    // Pieces of every kind placed in this run
+    DynamicArrayEx<size_t, LinearAllocatorPool>    turned_of; // Index into turned by kind, kNestNone if there isn't one
+    DynamicArrayEx<size_t, LinearAllocatorPool>    placed_kinds;
+    DynamicArrayEx<bool, LinearAllocatorPool>      kind_placed;
+    DynamicArrayEx<NestPair, LinearAllocatorPool>  missing;
+    DynamicArray<Vec2>                             candidates;
+    DynamicArray<ConvexPieces*>                    sheet_nfps; // No-fit polygon of each part in the sheet being tried
+
+    NestRun(NestCache *cache, size_t kinds, LinearAllocatorPool *allocator) :
+        cache(cache),
+        turned(DynamicArray<ConvexPieces>(16)),
+        turned_of(DynamicArrayEx<size_t, LinearAllocatorPool>(kinds, allocator)),
+        placed_kinds(DynamicArrayEx<size_t, LinearAllocatorPool>(16, allocator)),
+        kind_placed(DynamicArrayEx<bool, LinearAllocatorPool>(kinds, allocator)),
+        missing(DynamicArrayEx<NestPair, LinearAllocatorPool>(16, allocator)),
+        candidates(DynamicArray<Vec2>(256)),
+        sheet_nfps(DynamicArray<ConvexPieces*>(16)) {
+
+        this->turned_of.Resize(kinds, allocator);
+        this->kind_placed.Resize(kinds, allocator);
+        std::fill(this->turned_of.Data(), this->turned_of.End(), kNestNone);
+        std::fill(this->kind_placed.Data(), this->kind_placed.End(), false);
+    }
+
+    void Free() {
+        for (auto &pieces : this->turned) {
+            pieces.Free();
+        }
+        this->turned.Free();
+        this->candidates.Free();
+        this->sheet_nfps.Free();
+    }
+
+    ConvexPieces* NoFitPolygon(size_t fixed_kind, size_t moving_kind) {
+        return &this->cache->nfps[*this->cache->index.GetPtr(NestPairKey(fixed_kind, moving_kind))];
+    }
+
+    void MakeMissing();
+    bool Fits(NestSheet *sheet, Vec2 pos);
+    bool FindSpot(NestSheet *sheet, size_t shape_index, Vec2 size, size_t *turns, size_t turn_count, size_t *best_turn, Vec2 *best_pos);
+};
+
+// The pairs are independent and some of them take a while, so they're made one per thread and only added to the
+// cache once they're all done
+void NestRun::MakeMissing() {
+    TRACE_FUNCTION();
+
+    size_t count = this->missing.Length();
+    if (!count) return;
+
+    auto made = DynamicArray<ConvexPieces>(count);
+    for (size_t i=0; i<count; i++) {
+        made.Push(ConvexPieces(64));
+    }
+
+    ParallelFor(count, 1, [&](size_t chunk, size_t start, size_t end) {
+        TRACE_ZONE("Make No-Fit Polygons");
+        auto scratch = DynamicArray<Vec2>(64);
+
+        for (size_t i=start; i<end; i++) {
+            NestPair pair = this->missing[i];
+            MakeNoFitPolygon(&this->turned[this->turned_of[pair.fixed]], &this->turned[this->turned_of[pair.moving]], &scratch, &made[i]);
+        }
+
+        scratch.Free();
+    });
+
+    for (size_t i=0; i<count; i++) {
+        NestPair pair = this->missing[i];
+        this->cache->index.Set(NestPairKey(pair.fixed, pair.moving), this->cache->nfps.Length());
+        this->cache->nfps.Push(made[i]);
+    }
+
+    made.Free();
+}
+
+bool NestRun::Fits(NestSheet *sheet, Vec2 pos) {
+    for (size_t i=0; i<sheet->placed.Length(); i++) {
+        NestPlaced *placed = &sheet->placed[i];
+        if (this->sheet_nfps[i]->ContainsStrictly(Sub(pos, placed->pos))) return false;
+    }
+
+    return true;
+}
+
+// Candidates are clamped into the range of positions that keep the part inside the sheet, since anything within
+// kNestingTouch of it is really on its edge
+static inline bool ClampCandidate(Vec2 *candidate, Vec2 range) {
+    if (candidate->x < -kNestingTouch || candidate->x > range.x + kNestingTouch) return false;
+    if (candidate->y < -kNestingTouch || candidate->y > range.y + kNestingTouch) return false;
+
+    candidate->x = std::min<float>(std::max<float>(candidate->x, 0.0f), range.x);
+    candidate->y = std::min<float>(std::max<float>(candidate->y, 0.0f), range.y);
+    return true;
+}
+
+// The best spot for a part is somewhere on the edge of a no-fit polygon or of the range of positions inside the
+// sheet, so the candidates are the corners of both and the points where the edges of no-fit polygons cross the edges
+// of the range. Crossings between two no-fit polygons are left out, they're rarely the best spot and there are a lot
+// of them. The candidates are tried top to bottom and left to right and the first one that fits is taken.
+bool NestRun::FindSpot(NestSheet *sheet, size_t shape_index, Vec2 size, size_t *turns, size_t turn_count, size_t *best_turn, Vec2 *best_pos) {
+    bool found = false;
+
+    for (size_t t=0; t<turn_count; t++) {
+        size_t kind = NestKind(shape_index, turns[t]);
+        Vec2 turned = TurnedSize(turns[t], size);
+        Vec2 range  = Vec2(sheet->size.x - turned.x, sheet->size.y - turned.y);
+        if (range.x < -kNestingTouch || range.y < -kNestingTouch) continue;
+        range = Vec2(std::max<float>(range.x, 0.0f), std::max<float>(range.y, 0.0f));
+
+        this->sheet_nfps.Clear();
+        for (auto &placed : sheet->placed) {
+            this->sheet_nfps.Push(this->NoFitPolygon(placed.kind, kind));
+        }
+
+        this->candidates.Clear();
+        this->candidates.Push(Vec2(0.0f, 0.0f));
+        this->candidates.Push(Vec2(range.x, 0.0f));
+        this->candidates.Push(Vec2(0.0f, range.y));
+        this->candidates.Push(range);
+
+        for (size_t i=0; i<sheet->placed.Length(); i++) {
+            Vec2 offset = sheet->placed[i].pos;
+            ConvexPieces *nfp = this->sheet_nfps[i];
+
+            for (size_t piece=0; piece<nfp->Length(); piece++) {
+                size_t count;
+                Vec2 *points = nfp->Piece(piece, &count);
+
+                for (size_t k=0; k<count; k++) {
+                    Vec2 a = Add(points[k], offset);
+                    Vec2 b = Add(points[k + 1 == count ? 0 : k + 1], offset);
+
+                    Vec2 corner = a;
+                    if (ClampCandidate(&corner, range)) this->candidates.Push(corner);
+
+                    float xs[2] = { 0.0f, range.x };
+                    for (auto x : xs) {
+                        if (a.x == b.x || (a.x - x) * (b.x - x) > 0.0f) continue;
+
+                        Vec2 crossing = Vec2(x, a.y + (x - a.x) / (b.x - a.x) * (b.y - a.y));
+                        if (ClampCandidate(&crossing, range)) this->candidates.Push(crossing);
+                    }
+
+                    float ys[2] = { 0.0f, range.y };
+                    for (auto y : ys) {
+                        if (a.y == b.y || (a.y - y) * (b.y - y) > 0.0f) continue;
+
+                        Vec2 crossing = Vec2(a.x + (y - a.y) / (b.y - a.y) * (b.x - a.x), y);
+                        if (ClampCandidate(&crossing, range)) this->candidates.Push(crossing);
+                    }
+                }
+            }
+        }
+
+        std::sort(this->candidates.Data(), this->candidates.End(), [](Vec2 a, Vec2 b) {
+            return a.y < b.y || (a.y == b.y && a.x < b.x);
+        });
+
+        for (auto &candidate : this->candidates) {
+            // Nothing further down the list can beat what another rotation already found
+            if (found && (candidate.y > best_pos->y || (candidate.y == best_pos->y && candidate.x >= best_pos->x))) break;
+
+            if (this->Fits(sheet, candidate)) {
+                found      = true;
+                *best_turn = turns[t];
+                *best_pos  = candidate;
+                break;
+            }
+        }
+    }
+
+    return found;
+}
+
+DynamicArrayEx<Vec2, LinearAllocatorPool> NestParts(
+        NestCache *cache,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool> *available_bins,
+        DynamicArray<NestPart> *parts,
+        NestOptions options,
+        DynamicArrayEx<NestPlacement, LinearAllocatorPool> *placements,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    auto deadline = NestClock::now() + std::chrono::duration_cast<NestClock::duration>(std::chrono::duration<float>(options.seconds));
+    size_t count  = parts->Length();
+
+    // Two rotations turn the part upside down rather than on its side so it keeps running the same way as the sheet
+    size_t all_turns[kNestingQuarterTurns] = { 0, 2, 1, 3 };
+    size_t turn_count = options.rotations >= 4 ? 4 : (options.rotations >= 2 ? 2 : 1);
+
+    placements->Clear();
+    auto shape_indexes = DynamicArrayEx<size_t, LinearAllocatorPool>(count, allocator);
+    for (size_t i=0; i<count; i++) {
+        placements->Push(NestPlacement(kNestUnplaced, 0, Vec2(0.0f, 0.0f)), allocator);
+        shape_indexes.Push(cache->ShapeIndex((*parts)[i].shape), allocator);
+    }
+
+    auto run = NestRun(cache, cache->shapes.Length() * kNestingQuarterTurns, allocator);
+    auto scratch = DynamicArray<Vec2>(64);
+    for (size_t i=0; i<count; i++) {
+        NestPart *part = &(*parts)[i];
+
+        for (size_t t=0; t<turn_count; t++) {
+            size_t kind = NestKind(shape_indexes[i], all_turns[t]);
+            if (run.turned_of[kind] != kNestNone) continue;
+
+            run.turned_of[kind] = run.turned.Length();
+            run.turned.Push(ConvexPieces(part->pieces.points.Length()));
+            TurnPieces(&part->pieces, all_turns[t], part->size, run.turned.LastPtr(), &scratch);
+        }
+    }
+    scratch.Free();
+
+    auto order = DynamicArrayEx<size_t, LinearAllocatorPool>(count, allocator);
+    for (size_t i=0; i<count; i++) {
+        order.Push(i, allocator);
+    }
+    std::sort(order.Data(), order.End(), [parts](size_t a, size_t b) {
+        float area_a = (*parts)[a].area;
+        float area_b = (*parts)[b].area;
+        return area_a > area_b || (area_a == area_b && a < b);
+    });
+
+    auto sheets     = DynamicArrayEx<NestSheet, LinearAllocatorPool>(16, allocator);
+    auto used_count = DynamicArrayEx<size_t, LinearAllocatorPool>(available_bins->Length(), allocator);
+    used_count.Resize(available_bins->Length(), allocator);
+    std::fill(used_count.Data(), used_count.End(), 0);
+
+    auto late = DynamicArrayEx<RectNamed, LinearAllocatorPool>(16, allocator);
+
+    for (auto &i : order) {
+        NestPart *part = &(*parts)[i];
+
+        if (NestClock::now() >= deadline) {
+            late.Push(RectNamed(Rect(Vec2(0.0f, 0.0f), part->size), i), allocator);
+            continue;
+        }
+
+        run.missing.Clear();
+        for (auto &placed_kind : run.placed_kinds) {
+            for (size_t t=0; t<turn_count; t++) {
+                size_t kind = NestKind(shape_indexes[i], all_turns[t]);
+                if (!cache->index.GetPtr(NestPairKey(placed_kind, kind))) run.missing.Push(NestPair(placed_kind, kind), allocator);
+            }
+        }
+        run.MakeMissing();
+
+        size_t turn  = 0;
+        Vec2   pos   = Vec2(0.0f, 0.0f);
+        size_t sheet = kNestUnplaced;
+
+        for (size_t s=0; s<sheets.Length() && sheet == kNestUnplaced; s++) {
+            if (sheets[s].free_area < part->area) continue;
+            if (run.FindSpot(&sheets[s], shape_indexes[i], part->size, all_turns, turn_count, &turn, &pos)) sheet = s;
+        }
+
+        // Nothing open has room so the part starts a new sheet, in the first kind of bin it fits
+        for (size_t b=0; b<available_bins->Length() && sheet == kNestUnplaced; b++) {
+            Vec2Many *available = available_bins->GetPtr(b);
+            if (used_count[b] >= available->quantity) continue;
+
+            auto empty = NestSheet(available->vec2, allocator);
+            if (!run.FindSpot(&empty, shape_indexes[i], part->size, all_turns, turn_count, &turn, &pos)) continue;
+
+            used_count[b]++;
+            sheet = sheets.Length();
+            sheets.Push(empty, allocator);
+        }
+
+        if (sheet == kNestUnplaced) continue;
+
+        size_t kind = NestKind(shape_indexes[i], turn);
+        sheets[sheet].placed.Push(NestPlaced(kind, pos), allocator);
+        sheets[sheet].free_area -= part->area;
+        (*placements)[i] = NestPlacement(sheet, turn, pos);
+
+        if (!run.kind_placed[kind]) {
+            run.kind_placed[kind] = true;
+            run.placed_kinds.Push(kind, allocator);
+        }
+    }
+
+    auto bins = DynamicArrayEx<Vec2, LinearAllocatorPool>(sheets.Length() + 1, allocator);
+    for (auto &sheet : sheets) {
+        bins.Push(sheet.size, allocator);
+    }
+
+    // Whatever the deadline cut off goes in bins of its own by its bounds, out of what's left of each kind of bin
+    if (late.Length()) {
+        auto left_over = available_bins->Clone(allocator);
+        for (size_t b=0; b<left_over.Length(); b++) {
+            left_over[b].quantity -= used_count[b];
+        }
+
+        // Parts that don't fit in what's left keep kNestUnplaced
+        bool out_of_space;
+        auto packed = PackBins(&left_over, &late, &out_of_space, allocator);
+        for (auto &bin : packed) {
+            for (auto &rect : bin.rects) {
+                (*placements)[rect.id] = NestPlacement(bins.Length(), 0, rect.vec2);
+            }
+            bins.Push(bin.size, allocator);
+        }
+    }
+
+    run.Free();
+    return bins;
+}
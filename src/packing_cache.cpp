@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+
+#include "bin_packing.hpp"
+#include "ds.hpp"
+#include "files.hpp"
+#include "packing_cache.hpp"
+#include "trace.hpp"
+
+// "SVPK"
+constexpr uint32_t kPackingCacheMagic = 0x4b505653;
+
+constexpr uint32_t kPackingCacheUnpacked = std::numeric_limits<uint32_t>::max();
+
+// An entry is the header followed by the available bins, the size of every packed bin and then the rects sorted by
+// size, each with where it went
+class PackingCacheHeader {
+    public:
+    uint32_t magic;
+    uint32_t version;
+    uint32_t packer;
+    uint32_t fit;
+    uint32_t order;
+    uint32_t grid_groups;
+    float    search_seconds;
+    uint32_t available_bin_count;
+    uint64_t bin_count;
+    uint64_t rect_count;
+};
+
+class PackingCacheRect {
+    public:
+    Vec2     size;
+    Vec2     pos;
+    uint32_t bin; // kPackingCacheUnpacked when it didn't fit anywhere
+    PackingCacheRect(Vec2 size, Vec2 pos, uint32_t bin) : size(size), pos(pos), bin(bin) {};
+};
+
+// What an entry for the rects would hold besides the packing itself. order has the index of every rect sorted by size,
+// which is the order the entry lists them in
+class PackingCacheInput {
+    public:
+    PackingCacheHeader                          header;
+    DynamicArrayEx<size_t, LinearAllocatorPool> order;
+    uint64_t                                    key;
+
+    PackingCacheInput(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        float search_seconds,
+        LinearAllocatorPool *allocator
+    );
+
+    size_t EntrySize(size_t bin_count) {
+        return sizeof(PackingCacheHeader) + this->header.available_bin_count * sizeof(Vec2Many) + bin_count * sizeof(Vec2) +
+            this->header.rect_count * sizeof(PackingCacheRect);
+    }
+};
+
+PackingCacheInput::PackingCacheInput(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        float search_seconds,
+        LinearAllocatorPool *allocator
+) : order(DynamicArrayEx<size_t, LinearAllocatorPool>(rects->Length(), allocator)) {
+    // Zeroed first so the bin count, which is only known once packed, and any padding always hash the same
+    memset(&this->header, 0, sizeof(this->header));
+    this->header.magic               = kPackingCacheMagic;
+    this->header.version             = kPackingCacheVersion;
+    this->header.packer              = (uint32_t)options.packer;
+    this->header.fit                 = (uint32_t)options.fit;
+    this->header.order               = (uint32_t)options.order;
+    this->header.grid_groups         = options.grid_groups;
+    this->header.search_seconds      = search_seconds;
+    this->header.available_bin_count = (uint32_t)available_bins->Length();
+    this->header.rect_count          = rects->Length();
+
+    this->order.Resize(rects->Length(), allocator);
+    for (size_t i=0; i<rects->Length(); i++) {
+        this->order[i] = i;
+    }
+
+    // Rects of the same size can be swapped for each other so it doesn't matter how ties are ordered
+    std::sort(this->order.Data(), this->order.End(), [rects](size_t a, size_t b) {
+        return PackingSizeKey(rects->GetPtr(a)->rect.size) < PackingSizeKey(rects->GetPtr(b)->rect.size);
+    });
+
+    this->key = HashBytes(kHashBytesSeed, &this->header, sizeof(this->header));
+    this->key = HashBytes(this->key, available_bins->Data(), available_bins->Length() * sizeof(Vec2Many));
+    for (auto &index : this->order) {
+        this->key = HashBytes(this->key, &rects->GetPtr(index)->rect.size, sizeof(Vec2));
+    }
+}
+
+PackingCache::PackingCache(const char *directory) : hits(0), misses(0), write_failures(0) {
+    snprintf(this->directory, sizeof(this->directory), "%s", directory);
+}
+
+bool PackingCache::EntryPath(uint64_t key, char *path) {
+    int written = snprintf(path, kMaxPackingCachePath, "%s/%016llx.pack", this->directory, (unsigned long long)key);
+    return written > 0 && (size_t)written < kMaxPackingCachePath;
+}
+
+// Fills bins from the entry in the file when it's for exactly these rects, and out_of_space with whether the packing
+// left any of them out
+static bool FindCachedPacking(
+        char *path,
+        PackingCacheInput *input,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        DynamicArrayEx<Bin, LinearAllocatorPool> *bins,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    MappedFile mapped;
+    if (!MapFile(path, &mapped)) return false;
+
+    char *data = (char *)mapped.data;
+    PackingCacheHeader *header = (PackingCacheHeader *)data;
+
+    // Everything but the bin count has to match what the entry would be written with
+    PackingCacheHeader expected = input->header;
+    expected.bin_count = mapped.length >= sizeof(PackingCacheHeader) ? header->bin_count : 0;
+
+    bool ok = mapped.length >= sizeof(PackingCacheHeader) && !memcmp(header, &expected, sizeof(expected)) &&
+        header->bin_count <= header->rect_count && mapped.length == input->EntrySize(header->bin_count);
+    if (!ok) {
+        mapped.Free();
+        return false;
+    }
+
+    Vec2Many *available = (Vec2Many *)(data + sizeof(PackingCacheHeader));
+    ok = !memcmp(available, available_bins->Data(), available_bins->Length() * sizeof(Vec2Many));
+
+    Vec2 *bin_sizes = (Vec2 *)(available + header->available_bin_count);
+    PackingCacheRect *cached = (PackingCacheRect *)(bin_sizes + header->bin_count);
+    for (size_t i=0; ok && i<input->order.Length(); i++) {
+        ok = PackingSizeKey(cached[i].size) == PackingSizeKey(rects->GetPtr(input->order[i])->rect.size) &&
+            (cached[i].bin == kPackingCacheUnpacked || cached[i].bin < header->bin_count);
+    }
+
+    if (ok) {
+        *out_of_space = false;
+        *bins = DynamicArrayEx<Bin, LinearAllocatorPool>(header->bin_count, allocator);
+        for (size_t i=0; i<header->bin_count; i++) {
+            bins->Push(Bin(bin_sizes[i], allocator), allocator);
+        }
+
+        for (size_t i=0; i<input->order.Length(); i++) {
+            if (cached[i].bin == kPackingCacheUnpacked) {
+                *out_of_space = true;
+                continue;
+            }
+
+            size_t id = rects->GetPtr(input->order[i])->id;
+            (*bins)[cached[i].bin].rects.Push(Vec2Named(cached[i].pos, id), allocator);
+        }
+    }
+
+    mapped.Free();
+    return ok;
+}
+
+// Returns false when the entry couldn't be written
+static bool StoreCachedPacking(
+        char *path,
+        PackingCacheInput *input,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        DynamicArrayEx<Bin, LinearAllocatorPool> *bins,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    size_t size = input->EntrySize(bins->Length());
+    char *data  = global_allocator.Alloc<char>(size);
+
+    PackingCacheHeader *header = (PackingCacheHeader *)data;
+    *header = input->header;
+    header->bin_count = bins->Length();
+
+    Vec2Many *available = (Vec2Many *)(data + sizeof(PackingCacheHeader));
+    memcpy(available, available_bins->Data(), available_bins->Length() * sizeof(Vec2Many));
+
+    Vec2 *bin_sizes = (Vec2 *)(available + available_bins->Length());
+    PackingCacheRect *cached = (PackingCacheRect *)(bin_sizes + bins->Length());
+
+    // Packed rects only have their id so they're matched back to their place in the entry through it
+    auto entry_of = HashMapEx<size_t, size_t, LinearAllocatorPool>(std::max<size_t>(16, rects->Length()), allocator);
+    for (size_t i=0; i<input->order.Length(); i++) {
+        RectNamed *rect = rects->GetPtr(input->order[i]);
+        entry_of.Set(rect->id, i, allocator);
+
+        cached[i] = PackingCacheRect(rect->rect.size, Vec2(0.0f, 0.0f), kPackingCacheUnpacked);
+    }
+
+    for (size_t bin=0; bin<bins->Length(); bin++) {
+        bin_sizes[bin] = (*bins)[bin].size;
+
+        for (auto &packed : (*bins)[bin].rects) {
+            size_t entry = entry_of[packed.id];
+            cached[entry].pos = packed.vec2;
+            cached[entry].bin = (uint32_t)bin;
+        }
+    }
+
+    bool written = WriteWholeFileAtomically(path, data, size);
+    global_allocator.Free(data);
+
+    return written;
+}
+
+static DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsUncached(
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        float search_seconds,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    if (search_seconds > 0.0f) {
+        return PackBinsSearch(available_bins, rects, PackingSearchOptions(search_seconds), out_of_space, allocator);
+    }
+
+    return PackBins(available_bins, rects, options, out_of_space, allocator);
+}
+
+DynamicArrayEx<Bin, LinearAllocatorPool> PackBinsCached(
+        PackingCache *cache,
+        DynamicArrayEx<Vec2Many, LinearAllocatorPool>* available_bins,
+        DynamicArrayEx<RectNamed, LinearAllocatorPool> *rects,
+        PackingOptions options,
+        float search_seconds,
+        bool *out_of_space,
+        LinearAllocatorPool *allocator
+) {
+    TRACE_FUNCTION();
+
+    if (!cache || options.order == PackingOrder::Given) {
+        return PackBinsUncached(available_bins, rects, options, search_seconds, out_of_space, allocator);
+    }
+
+    PackingCacheInput input = PackingCacheInput(available_bins, rects, options, search_seconds, allocator);
+
+    char path[kMaxPackingCachePath];
+    if (!cache->EntryPath(input.key, path)) {
+        return PackBinsUncached(available_bins, rects, options, search_seconds, out_of_space, allocator);
+    }
+
+    DynamicArrayEx<Bin, LinearAllocatorPool> bins;
+    if (FindCachedPacking(path, &input, available_bins, rects, &bins, out_of_space, allocator)) {
+        cache->hits++;
+        return bins;
+    }
+
+    cache->misses++;
+    bins = PackBinsUncached(available_bins, rects, options, search_seconds, out_of_space, allocator);
+    if (!StoreCachedPacking(path, &input, available_bins, rects, &bins, allocator)) cache->write_failures++;
+
+    return bins;
+}
@@ -0,0 +1,573 @@
+#include <math.h>
+
+#include "ds.hpp"
+#include "geometry.hpp"
+#include "lanes.hpp"
+#include "path.hpp"
+
+constexpr float kPi = 3.14159265358979323846f;
+
+SegmentStore::SegmentStore(size_t capacity) :
+    x0(DynamicArray<float>(capacity)),
+    y0(DynamicArray<float>(capacity)),
+    x1(DynamicArray<float>(capacity)),
+    y1(DynamicArray<float>(capacity)) {};
+
+void SegmentStore::Free() {
+    this->x0.Free();
+    this->y0.Free();
+    this->x1.Free();
+    this->y1.Free();
+}
+
+void SegmentStore::Push(Vec2 from, Vec2 to) {
+    this->x0.Push(from.x);
+    this->y0.Push(from.y);
+    this->x1.Push(to.x);
+    this->y1.Push(to.y);
+}
+
+size_t SegmentStore::Length() {
+    // All of the columns are the same length so arbitrarily pick one of them
+    return this->x0.Length();
+}
+
+void SegmentStore::Clear() {
+    this->x0.Clear();
+    this->y0.Clear();
+    this->x1.Clear();
+    this->y1.Clear();
+}
+
+static size_t ClampSegmentCount(float count) {
+    if (!(count >= 1.0f)) return 1; // Also catches NaN from degenerate input
+    return std::min<size_t>((size_t)ceilf(count), kMaxCurveSegments);
+}
+
+// Cubics are flattened after their control points are transformed since the curve is affine invariant. The
+// segment count comes from Wang's formula which bounds the distance between the curve and the chords of n
+// equal parameter steps using the second differences of the control points.
+static void FlattenCubic(Vec2 p0, Vec2 p1, Vec2 p2, Vec2 p3, float tolerance, SegmentStore* out) {
+    float ax = p0.x - 2.0f * p1.x + p2.x;
+    float ay = p0.y - 2.0f * p1.y + p2.y;
+    float bx = p1.x - 2.0f * p2.x + p3.x;
+    float by = p1.y - 2.0f * p2.y + p3.y;
+    float second_difference = sqrtf(std::max<float>(ax * ax + ay * ay, bx * bx + by * by));
+
+    size_t segments = ClampSegmentCount(sqrtf(0.75f * second_difference / tolerance));
+
+    Vec2 previous = p0;
+    for (size_t i=1; i<segments; i++) {
+        float t  = (float)i / (float)segments;
+        float mt = 1.0f - t;
+
+        float w0 = mt * mt * mt;
+        float w1 = 3.0f * mt * mt * t;
+        float w2 = 3.0f * mt * t * t;
+        float w3 = t * t * t;
+
+        Vec2 point = Vec2(
+            w0 * p0.x + w1 * p1.x + w2 * p2.x + w3 * p3.x,
+            w0 * p0.y + w1 * p1.y + w2 * p2.y + w3 * p3.y
+        );
+        out->Push(previous, point);
+        previous = point;
+    }
+
+    out->Push(previous, p3);
+}
+
+// Arcs come in the endpoint form D2D and SVG use. Flattening and bounds both work on the center form instead
+// which is the ellipse (center, radii, rotation) plus the range of angles swept around it.
+class ArcCenter {
+    public:
+    float cx, cy;
+    float rx, ry;
+    float cos_phi, sin_phi;
+    float start_angle, sweep_angle;
+
+    // Path units point on the ellipse at angle
+    Vec2 Point(float angle) {
+        float cos_a = cosf(angle);
+        float sin_a = sinf(angle);
+
+        return Vec2(
+            this->cx + this->rx * this->cos_phi * cos_a - this->ry * this->sin_phi * sin_a,
+            this->cy + this->rx * this->sin_phi * cos_a + this->ry * this->cos_phi * sin_a
+        );
+    }
+};
+
+// Converts an arc to center form following the SVG spec, appendix F.6.5. Returns false when the arc is
+// degenerate and should be treated as a straight line.
+static bool ToArcCenter(Vec2 from, Vec2 to, Vec2 radii, float rotation, float direction, ArcCenter* arc) {
+    float rx = fabsf(radii.x);
+    float ry = fabsf(radii.y);
+
+    if (rx == 0.0f || ry == 0.0f || (from.x == to.x && from.y == to.y)) {
+        return false;
+    }
+
+    float phi     = rotation * kPi / 180.0f;
+    float cos_phi = cosf(phi);
+    float sin_phi = sinf(phi);
+
+    float half_dx = (from.x - to.x) * 0.5f;
+    float half_dy = (from.y - to.y) * 0.5f;
+    float x1 =  cos_phi * half_dx + sin_phi * half_dy;
+    float y1 = -sin_phi * half_dx + cos_phi * half_dy;
+
+    // Radii too small to reach the end point get scaled up until they just do
+    float lambda = (x1 * x1) / (rx * rx) + (y1 * y1) / (ry * ry);
+    if (lambda > 1.0f) {
+        float scale = sqrtf(lambda);
+        rx *= scale;
+        ry *= scale;
+    }
+
+    float rx2 = rx * rx;
+    float ry2 = ry * ry;
+    float numerator   = rx2 * ry2 - rx2 * y1 * y1 - ry2 * x1 * x1;
+    float denominator = rx2 * y1 * y1 + ry2 * x1 * x1;
+    float coefficient = sqrtf(std::max<float>(numerator / denominator, 0.0f));
+
+    // The builder always asks for the large arc so the center is on the opposite side for clockwise sweeps
+    bool sweep = direction == kClockwise;
+    if (sweep) coefficient = -coefficient;
+
+    float cx1 =  coefficient * rx * y1 / ry;
+    float cy1 = -coefficient * ry * x1 / rx;
+
+    arc->cx = cos_phi * cx1 - sin_phi * cy1 + (from.x + to.x) * 0.5f;
+    arc->cy = sin_phi * cx1 + cos_phi * cy1 + (from.y + to.y) * 0.5f;
+    arc->rx = rx;
+    arc->ry = ry;
+    arc->cos_phi = cos_phi;
+    arc->sin_phi = sin_phi;
+
+    float start_angle = atan2f((y1 - cy1) / ry, (x1 - cx1) / rx);
+    float end_angle   = atan2f((-y1 - cy1) / ry, (-x1 - cx1) / rx);
+    float sweep_angle = end_angle - start_angle;
+    if (sweep  && sweep_angle < 0.0f) sweep_angle += 2.0f * kPi;
+    if (!sweep && sweep_angle > 0.0f) sweep_angle -= 2.0f * kPi;
+
+    arc->start_angle = start_angle;
+    arc->sweep_angle = sweep_angle;
+
+    return true;
+}
+
+// Arcs are flattened in path units and then transformed, which is why they take the tolerance in path units
+static void FlattenArc(Vec2 from, Vec2 to, Vec2 radii, float rotation, float direction, Mat3x2 transform, float tolerance, SegmentStore* out) {
+    ArcCenter arc;
+    if (!ToArcCenter(from, to, radii, rotation, direction, &arc)) {
+        out->Push(transform.Apply(from), transform.Apply(to));
+        return;
+    }
+
+    // Each chord of angle a on a circle of radius r is at most r * (1 - cos(a / 2)) away from the arc
+    float radius = std::max<float>(arc.rx, arc.ry);
+    float max_step = tolerance < radius ? 2.0f * acosf(1.0f - tolerance / radius) : kPi * 0.5f;
+    size_t segments = ClampSegmentCount(fabsf(arc.sweep_angle) / max_step);
+
+    Vec2 previous = transform.Apply(from);
+    for (size_t i=1; i<segments; i++) {
+        float angle = arc.start_angle + arc.sweep_angle * ((float)i / (float)segments);
+
+        Vec2 point = transform.Apply(arc.Point(angle));
+        out->Push(previous, point);
+        previous = point;
+    }
+
+    out->Push(previous, transform.Apply(to));
+}
+
+void FlattenPath(DynamicArray<float>* commands, Mat3x2 transform, float tolerance, SegmentStore* out) {
+    float *c      = commands->Data();
+    size_t length = commands->Length();
+
+    // Arcs are flattened before they're transformed so their tolerance is brought back into path units
+    float arc_tolerance = tolerance / std::max<float>(transform.MaxScale(), 1e-12f);
+
+    Vec2 pos          = Vec2(0.0f, 0.0f);
+    Vec2 figure_start = pos;
+
+    size_t i = 0;
+    while (i < length) {
+        float command = c[i];
+
+        if (command == kPathCommandMove) {
+            pos          = Vec2(c[i+1], c[i+2]);
+            figure_start = pos;
+            i += 3;
+        } else if (command == kPathCommandLine) {
+            Vec2 to = Vec2(c[i+1], c[i+2]);
+            out->Push(transform.Apply(pos), transform.Apply(to));
+            pos = to;
+            i += 3;
+        } else if (command == kPathCommandCubic) {
+            Vec2 c1  = Vec2(c[i+1], c[i+2]);
+            Vec2 c2  = Vec2(c[i+3], c[i+4]);
+            Vec2 end = Vec2(c[i+5], c[i+6]);
+            FlattenCubic(transform.Apply(pos), transform.Apply(c1), transform.Apply(c2), transform.Apply(end), tolerance, out);
+            pos = end;
+            i += 7;
+        } else if (command == kPathCommandArc) {
+            Vec2 end  = Vec2(c[i+1], c[i+2]);
+            Vec2 size = Vec2(c[i+3], c[i+4]);
+            FlattenArc(pos, end, size, c[i+5], c[i+6], transform, arc_tolerance, out);
+            pos = end;
+            i += 7;
+        } else if (command == kPathCommandClose) {
+            if (pos.x != figure_start.x || pos.y != figure_start.y) {
+                out->Push(transform.Apply(pos), transform.Apply(figure_start));
+            }
+            pos = figure_start;
+            i += 1;
+        } else {
+            // Only PathBuilder writes commands so anything else means the stream is corrupt
+            printf("Unknown path command %f at %zu\n", command, i);
+            return;
+        }
+    }
+}
+
+// Running min / max of every point added to it
+class Extents {
+    public:
+    float minx, miny, maxx, maxy;
+    Extents() :
+        minx(std::numeric_limits<float>::max()),
+        miny(std::numeric_limits<float>::max()),
+        maxx(std::numeric_limits<float>::lowest()),
+        maxy(std::numeric_limits<float>::lowest()) {};
+
+    void Add(Vec2 p) {
+        this->minx = std::min<float>(this->minx, p.x);
+        this->miny = std::min<float>(this->miny, p.y);
+        this->maxx = std::max<float>(this->maxx, p.x);
+        this->maxy = std::max<float>(this->maxy, p.y);
+    }
+};
+
+// Transformed cubic control points waiting for their extrema to be found, one column per coordinate
+class CubicBatch {
+    public:
+    float x0[kCubicBatchSize], y0[kCubicBatchSize];
+    float x1[kCubicBatchSize], y1[kCubicBatchSize];
+    float x2[kCubicBatchSize], y2[kCubicBatchSize];
+    float x3[kCubicBatchSize], y3[kCubicBatchSize];
+    size_t length;
+    CubicBatch() : length(0) {};
+};
+
+static inline float ClampUnit(float t) {
+    // Written so NaN ends up as 0
+    return t > 0.0f ? (t < 1.0f ? t : 1.0f) : 0.0f;
+}
+
+static inline float Cubic(float t, float p0, float p1, float p2, float p3) {
+    float mt = 1.0f - t;
+    return mt * mt * mt * p0 + 3.0f * mt * mt * t * p1 + 3.0f * mt * t * t * p2 + t * t * t * p3;
+}
+
+// A cubic's extrema in one coordinate are where the derivative a t^2 + b t + c is 0. Both roots of the quadratic
+// are returned along with the root of its linear part, which is the only real root when a is 0 (a quadratic
+// raised to a cubic). Every candidate gets clamped into [0, 1] and evaluated. Candidates that aren't real
+// extrema (no real roots, divisions by 0, roots outside the curve) still land on the curve so they can never
+// grow the bounds past the true ones, which lets the batch skip masking them out.
+static inline void CubicExtremaCandidates(float p0, float p1, float p2, float p3, float t[3]) {
+    float a = -p0 + 3.0f * p1 - 3.0f * p2 + p3;
+    float b = 2.0f * (p0 - 2.0f * p1 + p2);
+    float c = p1 - p0;
+
+    float root = sqrtf(std::max<float>(b * b - 4.0f * a * c, 0.0f));
+    t[0] = ClampUnit((-b + root) / (2.0f * a));
+    t[1] = ClampUnit((-b - root) / (2.0f * a));
+    t[2] = ClampUnit(-c / b);
+}
+
+static void AddCubicExtrema(CubicBatch* batch, Extents* extents) {
+    size_t i = 0;
+
+    #ifdef LANES_SIMD
+    if (batch->length >= kLanes) {
+        Lanes zero  = SplatLanes(0.0f);
+        Lanes one   = SplatLanes(1.0f);
+        Lanes two   = SplatLanes(2.0f);
+        Lanes three = SplatLanes(3.0f);
+        Lanes four  = SplatLanes(4.0f);
+
+        Lanes minx = SplatLanes(extents->minx);
+        Lanes miny = SplatLanes(extents->miny);
+        Lanes maxx = SplatLanes(extents->maxx);
+        Lanes maxy = SplatLanes(extents->maxy);
+
+        auto cubic = [&](Lanes t, Lanes p0, Lanes p1, Lanes p2, Lanes p3) {
+            Lanes mt  = SubLanes(one, t);
+            Lanes w0  = MulLanes(MulLanes(mt, mt), mt);
+            Lanes w1  = MulLanes(MulLanes(three, MulLanes(mt, mt)), t);
+            Lanes w2  = MulLanes(MulLanes(three, mt), MulLanes(t, t));
+            Lanes w3  = MulLanes(MulLanes(t, t), t);
+            return AddLanes(AddLanes(MulLanes(w0, p0), MulLanes(w1, p1)), AddLanes(MulLanes(w2, p2), MulLanes(w3, p3)));
+        };
+
+        // Same as ClampUnit, MaxLanes returns zero when t is NaN
+        auto clamp = [&](Lanes t) {
+            return MinLanes(MaxLanes(t, zero), one);
+        };
+
+        for (; i + kLanes <= batch->length; i += kLanes) {
+            Lanes x0 = LoadLanes(batch->x0 + i), y0 = LoadLanes(batch->y0 + i);
+            Lanes x1 = LoadLanes(batch->x1 + i), y1 = LoadLanes(batch->y1 + i);
+            Lanes x2 = LoadLanes(batch->x2 + i), y2 = LoadLanes(batch->y2 + i);
+            Lanes x3 = LoadLanes(batch->x3 + i), y3 = LoadLanes(batch->y3 + i);
+
+            Lanes p0[2] = { x0, y0 };
+            Lanes p1[2] = { x1, y1 };
+            Lanes p2[2] = { x2, y2 };
+            Lanes p3[2] = { x3, y3 };
+
+            for (int axis=0; axis<2; axis++) {
+                Lanes a = AddLanes(SubLanes(p3[axis], p0[axis]), MulLanes(three, SubLanes(p1[axis], p2[axis])));
+                Lanes b = MulLanes(two, AddLanes(SubLanes(p0[axis], MulLanes(two, p1[axis])), p2[axis]));
+                Lanes c = SubLanes(p1[axis], p0[axis]);
+
+                Lanes root = SqrtLanes(MaxLanes(SubLanes(MulLanes(b, b), MulLanes(four, MulLanes(a, c))), zero));
+                Lanes two_a = MulLanes(two, a);
+                Lanes negative_b = SubLanes(zero, b);
+
+                Lanes candidates[3] = {
+                    clamp(DivLanes(AddLanes(negative_b, root), two_a)),
+                    clamp(DivLanes(SubLanes(negative_b, root), two_a)),
+                    clamp(DivLanes(SubLanes(zero, c), b)),
+                };
+
+                for (auto &t : candidates) {
+                    Lanes x = cubic(t, x0, x1, x2, x3);
+                    Lanes y = cubic(t, y0, y1, y2, y3);
+                    minx = MinLanes(minx, x);
+                    miny = MinLanes(miny, y);
+                    maxx = MaxLanes(maxx, x);
+                    maxy = MaxLanes(maxy, y);
+                }
+            }
+        }
+
+        float reduce[4][kLanes];
+        StoreLanes(reduce[0], minx);
+        StoreLanes(reduce[1], miny);
+        StoreLanes(reduce[2], maxx);
+        StoreLanes(reduce[3], maxy);
+
+        for (size_t lane=0; lane<kLanes; lane++) {
+            extents->minx = std::min<float>(extents->minx, reduce[0][lane]);
+            extents->miny = std::min<float>(extents->miny, reduce[1][lane]);
+            extents->maxx = std::max<float>(extents->maxx, reduce[2][lane]);
+            extents->maxy = std::max<float>(extents->maxy, reduce[3][lane]);
+        }
+    }
+    #endif
+
+    for (; i < batch->length; i++) {
+        float t[6];
+        CubicExtremaCandidates(batch->x0[i], batch->x1[i], batch->x2[i], batch->x3[i], t);
+        CubicExtremaCandidates(batch->y0[i], batch->y1[i], batch->y2[i], batch->y3[i], t + 3);
+
+        for (auto candidate : t) {
+            extents->Add(Vec2(
+                Cubic(candidate, batch->x0[i], batch->x1[i], batch->x2[i], batch->x3[i]),
+                Cubic(candidate, batch->y0[i], batch->y1[i], batch->y2[i], batch->y3[i])
+            ));
+        }
+    }
+
+    batch->length = 0;
+}
+
+// True when angle is within the part of the ellipse the arc sweeps over
+static bool ArcCoversAngle(ArcCenter* arc, float angle) {
+    float delta = fmodf(angle - arc->start_angle, 2.0f * kPi);
+
+    if (arc->sweep_angle >= 0.0f) {
+        if (delta < 0.0f) delta += 2.0f * kPi;
+        return delta <= arc->sweep_angle;
+    }
+
+    if (delta > 0.0f) delta -= 2.0f * kPi;
+    return delta >= arc->sweep_angle;
+}
+
+// The transformed arc is C + U cos(angle) + V sin(angle) where U and V are the ellipse axes put through the
+// transform. Each coordinate is extreme where its derivative -U sin(angle) + V cos(angle) is 0, which is
+// atan2(V, U) and the opposite side of the ellipse. The end points are added by the caller.
+static void AddArcExtrema(Vec2 from, Vec2 to, Vec2 radii, float rotation, float direction, Mat3x2 transform, Extents* extents) {
+    ArcCenter arc;
+    if (!ToArcCenter(from, to, radii, rotation, direction, &arc)) {
+        return;
+    }
+
+    float ux = arc.rx * arc.cos_phi;
+    float uy = arc.rx * arc.sin_phi;
+    float vx = -arc.ry * arc.sin_phi;
+    float vy =  arc.ry * arc.cos_phi;
+
+    float tux = ux * transform.m11 + uy * transform.m21;
+    float tuy = ux * transform.m12 + uy * transform.m22;
+    float tvx = vx * transform.m11 + vy * transform.m21;
+    float tvy = vx * transform.m12 + vy * transform.m22;
+
+    float x_angle = atan2f(tvx, tux);
+    float y_angle = atan2f(tvy, tuy);
+    float angles[4] = { x_angle, x_angle + kPi, y_angle, y_angle + kPi };
+
+    for (auto angle : angles) {
+        if (ArcCoversAngle(&arc, angle)) {
+            extents->Add(transform.Apply(arc.Point(angle)));
+        }
+    }
+}
+
+Rect PathBounds(DynamicArray<float>* commands, Mat3x2 transform) {
+    float *c      = commands->Data();
+    size_t length = commands->Length();
+
+    Extents    extents;
+    CubicBatch cubics;
+
+    Vec2 pos          = Vec2(0.0f, 0.0f);
+    Vec2 figure_start = pos;
+
+    size_t i = 0;
+    while (i < length) {
+        float command = c[i];
+
+        if (command == kPathCommandMove) {
+            pos          = Vec2(c[i+1], c[i+2]);
+            figure_start = pos;
+            extents.Add(transform.Apply(pos));
+            i += 3;
+        } else if (command == kPathCommandLine) {
+            pos = Vec2(c[i+1], c[i+2]);
+            extents.Add(transform.Apply(pos));
+            i += 3;
+        } else if (command == kPathCommandCubic) {
+            Vec2 p0 = transform.Apply(pos);
+            Vec2 p1 = transform.Apply(Vec2(c[i+1], c[i+2]));
+            Vec2 p2 = transform.Apply(Vec2(c[i+3], c[i+4]));
+            Vec2 p3 = transform.Apply(Vec2(c[i+5], c[i+6]));
+
+            size_t n = cubics.length++;
+            cubics.x0[n] = p0.x; cubics.y0[n] = p0.y;
+            cubics.x1[n] = p1.x; cubics.y1[n] = p1.y;
+            cubics.x2[n] = p2.x; cubics.y2[n] = p2.y;
+            cubics.x3[n] = p3.x; cubics.y3[n] = p3.y;
+
+            if (cubics.length == kCubicBatchSize) {
+                AddCubicExtrema(&cubics, &extents);
+            }
+
+            pos = Vec2(c[i+5], c[i+6]);
+            extents.Add(p3);
+            i += 7;
+        } else if (command == kPathCommandArc) {
+            Vec2 end = Vec2(c[i+1], c[i+2]);
+            AddArcExtrema(pos, end, Vec2(c[i+3], c[i+4]), c[i+5], c[i+6], transform, &extents);
+
+            pos = end;
+            extents.Add(transform.Apply(pos));
+            i += 7;
+        } else if (command == kPathCommandClose) {
+            pos = figure_start;
+            i += 1;
+        } else {
+            printf("Unknown path command %f at %zu\n", command, i);
+            break;
+        }
+    }
+
+    AddCubicExtrema(&cubics, &extents);
+
+    if (extents.minx > extents.maxx) {
+        return Rect(Vec2(0.0f, 0.0f), Vec2(0.0f, 0.0f));
+    }
+
+    return Rect::FromEdges(extents.minx, extents.miny, extents.maxx, extents.maxy);
+}
+
+float LodTolerance(size_t level) {
+    return kLodFinestTolerance * powf(kLodLevelStep, (float)level);
+}
+
+size_t LodLevel(float tolerance) {
+    for (size_t level=kLodLevels; level>0; level--) {
+        if (LodTolerance(level - 1) <= tolerance) {
+            return level - 1;
+        }
+    }
+
+    return kNoLod;
+}
+
+float SegmentsDistanceSquared(SegmentStore* segments, Vec2 point) {
+    float *x0 = segments->x0.Data();
+    float *y0 = segments->y0.Data();
+    float *x1 = segments->x1.Data();
+    float *y1 = segments->y1.Data();
+
+    size_t length = segments->Length();
+    size_t i      = 0;
+    float  best   = std::numeric_limits<float>::infinity();
+
+    // For each segment the closest point is the projection of point onto the segment's line clamped to the
+    // segment. Zero length segments get a tiny length instead of a branch, their projection is always 0.
+    #ifdef LANES_SIMD
+    if (length >= kLanes) {
+        Lanes px    = SplatLanes(point.x);
+        Lanes py    = SplatLanes(point.y);
+        Lanes zero  = SplatLanes(0.0f);
+        Lanes one   = SplatLanes(1.0f);
+        Lanes tiny  = SplatLanes(1e-20f);
+        Lanes bests = SplatLanes(best);
+
+        for (; i + kLanes <= length; i += kLanes) {
+            Lanes ax = LoadLanes(x0 + i);
+            Lanes ay = LoadLanes(y0 + i);
+            Lanes dx = SubLanes(LoadLanes(x1 + i), ax);
+            Lanes dy = SubLanes(LoadLanes(y1 + i), ay);
+            Lanes wx = SubLanes(px, ax);
+            Lanes wy = SubLanes(py, ay);
+
+            Lanes length_squared = MaxLanes(AddLanes(MulLanes(dx, dx), MulLanes(dy, dy)), tiny);
+            Lanes t = DivLanes(AddLanes(MulLanes(wx, dx), MulLanes(wy, dy)), length_squared);
+            t = MinLanes(MaxLanes(t, zero), one);
+
+            Lanes ex = SubLanes(wx, MulLanes(t, dx));
+            Lanes ey = SubLanes(wy, MulLanes(t, dy));
+            bests = MinLanes(bests, AddLanes(MulLanes(ex, ex), MulLanes(ey, ey)));
+        }
+
+        float reduce[kLanes];
+        StoreLanes(reduce, bests);
+        for (size_t lane=0; lane<kLanes; lane++) {
+            best = std::min<float>(best, reduce[lane]);
+        }
+    }
+    #endif
+
+    for (; i < length; i++) {
+        float dx = x1[i] - x0[i];
+        float dy = y1[i] - y0[i];
+        float wx = point.x - x0[i];
+        float wy = point.y - y0[i];
+
+        float length_squared = std::max<float>(dx * dx + dy * dy, 1e-20f);
+        float t = std::min<float>(std::max<float>((wx * dx + wy * dy) / length_squared, 0.0f), 1.0f);
+
+        float ex = wx - t * dx;
+        float ey = wy - t * dy;
+        best = std::min<float>(best, ex * ex + ey * ey);
+    }
+
+    return best;
+}
@@ -1,137 +1,521 @@
 #include "bin_packing.hpp"
 #include "ds.hpp"
+#include "filter.hpp"
+#include "nesting.hpp"
+#include "packing_cache.hpp"
+#include "parallel.hpp"
 #include "pipeline.hpp"
-#include "shapes.hpp"
 #include "sviggy.hpp"
+#include "trace.hpp"
 
-#include <chrono>
+#include <cstring>
+#include <stdlib.h>
 
-PipelineAction PipelineAction::Filter(DynamicArrayEx<TagId, LinearAllocatorPool> tags) {
+PipelineAction PipelineAction::Filter(FilterProgram filter) {
     PipelineActionValue value = PipelineActionValue {};
-    value.filter_tags = tags;
+    value.filter = filter;
     return PipelineAction(PipelineActionType::Filter, value);
 }
 
 PipelineAction PipelineAction::Layout(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins) {
+    return PipelineAction::Layout(bins, 0.0f);
+}
+
+PipelineAction PipelineAction::Layout(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float search_seconds) {
     PipelineActionValue value = PipelineActionValue {};
-    value.layout_bins = bins;
+    value.layout.bins           = bins;
+    value.layout.search_seconds = search_seconds;
     return PipelineAction(PipelineActionType::Layout, value);
 }
 
-void PipelineActions::Run(Document *input_doc, DXState *dx, LinearAllocatorPool* allocator) {
-    // TODO: add a free for the old pipeline shapes + free the resources
-    input_doc->pipeline_shapes = input_doc->paths.Clone();
-    input_doc->pipeline_shapes.RealizeAllHighFidelityGeometry(dx);
+PipelineAction PipelineAction::Collect() {
+    return PipelineAction(PipelineActionType::Collect, PipelineActionValue {});
+}
+
+PipelineAction PipelineAction::Nest(DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float seconds, size_t rotations) {
+    PipelineActionValue value = PipelineActionValue {};
+    value.nest.bins      = bins;
+    value.nest.seconds   = seconds;
+    value.nest.rotations = rotations;
+    return PipelineAction(PipelineActionType::Nest, value);
+}
+
+uint64_t PipelineAction::Key(uint64_t input_key) {
+    uint64_t key = HashBytes(kPipelineHashSeed, &input_key, sizeof(input_key));
+    key = HashBytes(key, &this->type, sizeof(this->type));
+
+    switch (this->type) {
+        case PipelineActionType::Filter: {
+            // Field by field since the ops have padding and point at tag names that live wherever they were compiled
+            for (auto &op : this->value.filter.ops) {
+                key = HashBytes(key, &op.type,    sizeof(op.type));
+                key = HashBytes(key, &op.field,   sizeof(op.field));
+                key = HashBytes(key, &op.compare, sizeof(op.compare));
+                key = HashBytes(key, &op.value,   sizeof(op.value));
+                key = HashBytes(key, &op.id,      sizeof(op.id));
+
+                if (op.type == FilterOpType::Tag) {
+                    size_t length = strlen(op.name);
+                    key = HashBytes(key, &length, sizeof(length));
+                    key = HashBytes(key, op.name, length);
+                }
+            }
+            break;
+        }
+
+        case PipelineActionType::Layout: {
+            key = HashBytes(key, this->value.layout.bins.Data(), this->value.layout.bins.Length() * sizeof(Vec2Many));
+            key = HashBytes(key, &this->value.layout.search_seconds, sizeof(this->value.layout.search_seconds));
+            break;
+        }
+
+        case PipelineActionType::Collect: {
+            break;
+        }
+
+        case PipelineActionType::Nest: {
+            key = HashBytes(key, this->value.nest.bins.Data(), this->value.nest.bins.Length() * sizeof(Vec2Many));
+            key = HashBytes(key, &this->value.nest.seconds, sizeof(this->value.nest.seconds));
+            key = HashBytes(key, &this->value.nest.rotations, sizeof(this->value.nest.rotations));
+            break;
+        }
+    }
+
+    return key;
+}
+
+PipelineStage::PipelineStage(PipelineAction action, size_t input) :
+    action(action),
+    input(input),
+    key(0),
+    computed(false),
+    output(Paths(1)),
+    unplaced(0),
+    packer(NULL),
+    nfps(NULL) {};
+
+void PipelineStage::Free() {
+    this->output.Free();
+
+    if (this->packer) {
+        this->packer->Free();
+        delete this->packer;
+    }
+
+    if (this->nfps) {
+        this->nfps->Free();
+        delete this->nfps;
+    }
+}
+
+PipelineActions::PipelineActions() :
+    allocator(LinearAllocatorPool(kPipelineParamsPoolSize)),
+    stages(DynamicArray<PipelineStage>(4)),
+    shown_key(0),
+    packing_cache(NULL) {};
+
+void PipelineActions::Free() {
+    for (auto &stage : this->stages) {
+        stage.Free();
+    }
+
+    this->stages.Free();
+    this->allocator.FreeAllocator();
+}
+
+size_t PipelineActions::Push(PipelineAction action) {
+    size_t input = this->stages.Length() ? this->stages.Length() - 1 : kPipelineSource;
+    return this->Push(action, input);
+}
+
+size_t PipelineActions::Push(PipelineAction action, size_t input) {
+    this->stages.Push(PipelineStage(action, input));
+    return this->stages.Length() - 1;
+}
+
+void PipelineActions::SetFilter(size_t stage, FilterProgram filter) {
+    this->stages[stage].action = PipelineAction::Filter(filter);
+}
+
+void PipelineActions::SetLayout(size_t stage, DynamicArrayEx<Vec2Many, LinearAllocatorPool> bins, float search_seconds) {
+    this->stages[stage].action = PipelineAction::Layout(bins, search_seconds);
+}
+
+void PipelineActions::Run(Document *input_doc, LinearAllocatorPool* allocator) {
+    this->Run(input_doc, allocator, this->stages.Length());
+}
+
+void PipelineActions::Run(Document *input_doc, LinearAllocatorPool* allocator, size_t stage_count) {
+    TRACE_ZONE("Pipeline Run");
+
+    // The document is identified by where its paths live plus their revision, so editing it or switching to
+    // another document invalidates every stage
+    Paths    *source    = &input_doc->paths;
+    uint64_t source_key = HashBytes(kPipelineHashSeed, &source, sizeof(source));
+    source_key = HashBytes(source_key, &source->revision, sizeof(source->revision));
+
+    // Stages can only read from earlier stages so computing them in order always has the input ready. A stage
+    // whose key still matches keeps its output and everything downstream of it only reruns if its own key changed
+    for (auto i=0; i<stage_count; i++) {
+        PipelineStage *stage = &this->stages[i];
+        PipelineStage *input = stage->input == kPipelineSource ? NULL : &this->stages[stage->input];
+
+        uint64_t key = stage->action.Key(input ? input->key : source_key);
+        if (stage->computed && stage->key == key) continue;
+
+        Paths *input_paths = input ? &input->output : source;
+        stage->output.Free();
 
-    for (auto &action : this->actions) {
-        switch (action.type) {
+        switch (stage->action.type) {
             case PipelineActionType::Filter: {
-               printf("running filter\n");
-               RunFilter(input_doc, dx, allocator, &action.value.filter_tags);
-               break;
+                TRACE_ZONE("Pipeline Filter");
+
+                // Filtering builds its output straight from the input so there's nothing to clone first
+                stage->output = RunFilter(input_paths, &stage->action.value.filter, &input_doc->tag_god.index);
+                break;
             }
 
             case PipelineActionType::Layout: {
-                printf("Running layout\n");
-                RunLayout(input_doc, dx, allocator, &action.value.layout_bins);
+                TRACE_ZONE("Pipeline Layout");
+                if (!stage->packer) stage->packer = new IncrementalPacker();
+
+                stage->output = input_paths->Clone();
+                stage->unplaced = RunLayout(&stage->output, allocator, &stage->action.value.layout, stage->packer, this->packing_cache);
+                break;
+            }
+
+            case PipelineActionType::Collect: {
+                TRACE_ZONE("Pipeline Collect");
+                stage->output = input_paths->Clone();
+                stage->output.AutoCollect();
+                break;
+            }
+
+            case PipelineActionType::Nest: {
+                TRACE_ZONE("Pipeline Nest");
+                if (!stage->nfps) stage->nfps = new NestCache();
+
+                stage->output = input_paths->Clone();
+                RunNest(&stage->output, allocator, &stage->action.value.nest, stage->nfps);
                 break;
             }
         }
+
+        stage->key      = key;
+        stage->computed = true;
+    }
+
+    // Nothing is realized here. Shapes that come out exactly where they were last time keep their realizations and
+    // the rest are realized when they're first drawn, so what a run costs in realizations depends on what's on
+    // screen afterwards rather than on how many shapes went in
+    Paths    *last    = stage_count ? &this->stages[stage_count - 1].output : source;
+    uint64_t last_key = stage_count ? this->stages[stage_count - 1].key : source_key;
+    if (last_key != this->shown_key) {
+        Paths shown = last->Clone();
+        shown.AdoptRealizations(&input_doc->pipeline_shapes);
+
+        input_doc->pipeline_shapes.FreeAndReleaseResources();
+        input_doc->pipeline_shapes = shown;
+
+        this->shown_key = last_key;
+    }
+}
+
+static bool IsSpecWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Reads "WIDTHxHEIGHT" or "WIDTHxHEIGHT*QUANTITY" from at, moving it past what was read
+static bool ParseSpecBin(char **at, Vec2Many *bin) {
+    char *end;
+
+    float width = strtof(*at, &end);
+    if (end == *at || *end != 'x') return false;
+    *at = end + 1;
+
+    float height = strtof(*at, &end);
+    if (end == *at) return false;
+    *at = end;
+
+    float quantity = kInfinity;
+    if (**at == '*') {
+        (*at)++;
+        quantity = strtof(*at, &end);
+        if (end == *at) return false;
+        *at = end;
     }
 
-    input_doc->pipeline_shapes.RealizeAllHighFidelityGeometry(dx);
+    *bin = Vec2Many(Vec2(width, height), quantity);
+    return true;
 }
 
-void RunFilter(Document* input_doc, DXState* dx, LinearAllocatorPool* allocator, DynamicArrayEx<TagId, LinearAllocatorPool>* tags) {
-    auto keep_shapes = HashMapEx<PathId, bool, LinearAllocatorPool>(input_doc->pipeline_shapes.Length() * 2, allocator);
+static bool SpecKeyword(char **at, const char *word) {
+    size_t length = strlen(word);
+    if (strncmp(*at, word, length) || !(IsSpecWhitespace((*at)[length]) || !(*at)[length])) return false;
+
+    *at += length;
+    while (IsSpecWhitespace(**at)) (*at)++;
+    return true;
+}
+
+bool BuildPipelineFromSpec(char *spec, PipelineActions *pipeline) {
+    size_t line_number = 0;
+    char *line = spec;
+
+    while (*line) {
+        line_number++;
+
+        char *end = line;
+        while (*end && *end != '\n') end++;
+
+        // Each line is parsed in place with its newline swapped for a terminator
+        char saved = *end;
+        *end = 0;
+
+        char *at = line;
+        while (IsSpecWhitespace(*at)) at++;
+
+        bool ok = true;
+        if (!*at || *at == '#') {
+            // Blank line or comment
+        } else if (SpecKeyword(&at, "filter")) {
+            FilterProgram filter;
+            ok = CompileFilter(at, &pipeline->allocator, &filter);
+            if (ok) pipeline->Push(PipelineAction::Filter(filter));
+        } else if (SpecKeyword(&at, "layout")) {
+            auto bins = DynamicArrayEx<Vec2Many, LinearAllocatorPool>(4, &pipeline->allocator);
+            float search_seconds = 0.0f;
+            while (*at && ok) {
+                if (SpecKeyword(&at, "search")) {
+                    char *end;
+                    search_seconds = strtof(at, &end);
+                    ok = end != at && search_seconds >= 0.0f;
+                    at = end;
+                    while (IsSpecWhitespace(*at)) at++;
 
-    for (auto &entry : input_doc->pipeline_shapes.tags.reverse_tags) {
-        TagId tag  = entry.key;
-        if (tags->Find(tag)) {
-            DynamicArray<PathId> shapes = entry.value;
-            for (auto &id : shapes) {
-                keep_shapes.Set(id, true, allocator);
+                    // The search has to come last
+                    ok = ok && !*at;
+                    break;
+                }
+
+                Vec2Many bin = Vec2Many(Vec2(0.0f, 0.0f), 0.0f);
+                ok = ParseSpecBin(&at, &bin);
+                if (ok) bins.Push(bin, &pipeline->allocator);
+                while (IsSpecWhitespace(*at)) at++;
+            }
+
+            ok = ok && bins.Length();
+            if (ok) pipeline->Push(PipelineAction::Layout(bins, search_seconds));
+        } else if (SpecKeyword(&at, "nest")) {
+            auto bins = DynamicArrayEx<Vec2Many, LinearAllocatorPool>(4, &pipeline->allocator);
+            float seconds    = kDefaultNestSeconds;
+            size_t rotations = kDefaultNestRotations;
+            while (*at && ok) {
+                char *end;
+                if (SpecKeyword(&at, "seconds")) {
+                    seconds = strtof(at, &end);
+                    ok = end != at && seconds >= 0.0f;
+                    at = end;
+                } else if (SpecKeyword(&at, "rotations")) {
+                    rotations = strtoul(at, &end, 10);
+                    ok = end != at && (rotations == 1 || rotations == 2 || rotations == 4);
+                    at = end;
+                } else {
+                    Vec2Many bin = Vec2Many(Vec2(0.0f, 0.0f), 0.0f);
+                    ok = ParseSpecBin(&at, &bin);
+                    if (ok) bins.Push(bin, &pipeline->allocator);
+                }
+                while (IsSpecWhitespace(*at)) at++;
             }
+
+            ok = ok && bins.Length();
+            if (ok) pipeline->Push(PipelineAction::Nest(bins, seconds, rotations));
+        } else if (SpecKeyword(&at, "collect")) {
+            ok = !*at;
+            if (ok) pipeline->Push(PipelineAction::Collect());
+        } else {
+            ok = false;
         }
+
+        if (!ok) {
+            printf("Pipeline spec line %zu isn't a valid stage: %s\n", line_number, line);
+        }
+
+        *end = saved;
+        if (!ok) return false;
+
+        line = saved ? end + 1 : end;
     }
 
-    for (int i=0; i<input_doc->pipeline_shapes.index.Capacity(); i++) {
-        auto slot = input_doc->pipeline_shapes.index.Slot(i);
-        for (int j=0; j<slot->Length(); j++) {
-            auto entry = slot->Get(j);
-            PathId id = entry.key;
-            if(!keep_shapes.GetPtr(id)) {
-                input_doc->pipeline_shapes.DeletePath(id);
+    return true;
+}
 
-                // Decrement j so we can process the element that was moved into the current slot in place of the deleted one
-                j--;
-            }
+// Id of the tag named name in tag_ids, or the largest id, which no tag has, when there isn't one
+static size_t ResolveFilterTag(HashMap<String, size_t>* tag_ids, char* name) {
+    String key  = String(name);
+    size_t* id  = tag_ids->GetPtr(key);
+    key.Free();
+
+    return id ? *id : std::numeric_limits<size_t>::max();
+}
+
+Paths RunFilter(Paths* paths, FilterProgram* filter, HashMap<String, size_t>* tag_ids) {
+    size_t length = paths->Length();
+    paths->UpdateBounds();
+
+    // Tags and collections are kept as lists of paths so each one the filter reads gets scattered into a mask
+    // over every path first. After that the program reads them a block at a time like the bounds columns
+    auto leaf_masks = DynamicArray<unsigned char>(filter->leaves * length);
+    leaf_masks.Resize(filter->leaves * length);
+    std::memset(leaf_masks.Data(), 0, filter->leaves * length);
+
+    size_t leaf = 0;
+    for (auto &op : filter->ops) {
+        DynamicArray<PathId>* members;
+        switch (op.type) {
+            case FilterOpType::Tag:        members = paths->tags.reverse_tags.GetPtr(ResolveFilterTag(tag_ids, op.name)); break;
+            case FilterOpType::Collection: members = paths->collections.reverse_collections_index.GetPtr(op.id); break;
+            default: continue;
+        }
+
+        unsigned char *mask = leaf_masks.Data() + leaf * length;
+        leaf++;
+        if (!members) continue;
+
+        for (auto &id : *members) {
+            size_t *index = paths->index.GetPtr(id);
+            if (index) mask[*index] = 1;
         }
     }
 
+    auto keep = DynamicArray<bool>(length);
+    keep.Resize(length);
+    filter->Evaluate(&paths->bounds, leaf_masks.Data(), keep.Data());
+
+    Paths filtered = paths->Compact(keep.Data());
+    keep.Free();
+    leaf_masks.Free();
+
+    return filtered;
 }
 
-void RunLayout(Document* input_doc, DXState* dx, LinearAllocatorPool* allocator, DynamicArrayEx<Vec2Many, LinearAllocatorPool>* bins) {
-    auto collection_bounds = GetCollectionBounds(input_doc, allocator);
+size_t RunLayout(Paths* paths, LinearAllocatorPool* allocator, PipelineLayout* layout, IncrementalPacker* packer, PackingCache* cache) {
+    auto collection_bounds = GetCollectionBounds(paths, allocator);
 
-    DynamicArrayEx<Bin, LinearAllocatorPool> packed_bins = PackBins(bins, &collection_bounds.array, allocator);
+    bool out_of_space;
+    DynamicArrayEx<Bin, LinearAllocatorPool> packed_bins;
+    if (packer) {
+        packer->cache = cache;
+        packed_bins   = packer->Pack(&layout->bins, &collection_bounds.array, layout->search_seconds, &out_of_space, allocator);
+    } else {
+        packed_bins = PackBinsCached(cache, &layout->bins, &collection_bounds.array, PackingOptions(), layout->search_seconds, &out_of_space, allocator);
+    }
 
+    size_t placed   = 0;
     Vec2 bin_offset = Vec2(0.0f, 0.0f);
     for (auto i=0; i<packed_bins.Length(); i++) {
         Bin* bin = &packed_bins[i];
+        placed  += bin->rects.Length();
 
         for (auto j=0; j<bin->rects.Length(); j++) {
             Vec2Named packed_collection = bin->rects[j];
-            DynamicArray<size_t>* collection = &input_doc->pipeline_shapes.collections.reverse_collections_index[packed_collection.id];
+            DynamicArray<size_t>* collection = &paths->collections.reverse_collections_index[packed_collection.id];
 
+            // Every shape in the collection moves by the same amount so the whole collection is one bulk matrix update
             Rect collection_bound = collection_bounds.map[packed_collection.id];
-            for (auto shape_idx=0; shape_idx<collection->Length(); shape_idx++) {
-                size_t shape_id = collection->Get(shape_idx);
+            Vec2 desired          = bin_offset + packed_collection.vec2;
+            Vec2 offset           = Vec2(desired.x - collection_bound.Left(), desired.y - collection_bound.Top());
+
+            paths->ApplyMatrix(collection->Data(), collection->Length(), Mat3x2::Translation(offset));
+        }
 
-                ID2D1TransformedGeometry* geometry = *input_doc->pipeline_shapes.GetTransformedGeometry(shape_id);
+        bin_offset += bin->size;
+    }
+
+    return out_of_space ? collection_bounds.array.Length() - placed : 0;
+}
 
-                Rect shape_bound = GetBounds(geometry);
+void RunNest(Paths* paths, LinearAllocatorPool* allocator, PipelineNest* nest, NestCache* cache) {
+    auto collection_bounds = GetCollectionBounds(paths, allocator);
+    size_t count = collection_bounds.array.Length();
 
-                Vec2 shape_offset = Vec2(shape_bound.Left() - collection_bound.Left(), shape_bound.Top() - collection_bound.Top());
-                Vec2 desired      = bin_offset + packed_collection.vec2 + shape_offset;
+    // Flattening is the slow part of building parts so every thread flattens its own collections
+    auto parts = DynamicArray<NestPart>(count);
+    parts.Resize(count);
+    ParallelFor(count, 16, [&](size_t chunk, size_t start, size_t end) {
+        TRACE_ZONE("Build Nest Parts");
+        auto outlines = SegmentStore(256);
 
-                // Right now we're not really setup to provide a transformation on top of a current transformation
-                // This could be fixed by just moving the transformation to a matrix. Since we only need to worry
-                // about the translation here, just add the translation from the new transformation to the original
-                Transformation transformation = GetTranslationTo(desired, &shape_bound);
-                ShapeData *data = input_doc->pipeline_shapes.GetShapeData(shape_id);
-                data->transform.translation += transformation.translation;
+        for (size_t i=start; i<end; i++) {
+            RectNamed *collection_bound = &collection_bounds.array[i];
+            DynamicArray<PathId>* collection = &paths->collections.reverse_collections_index[collection_bound->id];
+
+            outlines.Clear();
+            for (auto &id : *collection) {
+                size_t index = paths->index[id];
+                FlattenPath(&paths->shapes[index].commands, paths->transforms.Get(index), kNestingTolerance, &outlines);
             }
+
+            parts[i] = BuildNestPart(&outlines, collection_bound->rect);
         }
 
-        bin_offset += bin->size;
+        outlines.Free();
+    });
+
+    auto placements = DynamicArrayEx<NestPlacement, LinearAllocatorPool>(count, allocator);
+    auto bins = NestParts(cache, &nest->bins, &parts, NestOptions(nest->seconds, nest->rotations), &placements, allocator);
+
+    // Bins go down and to the right of each other like a layout's
+    auto bin_offsets = DynamicArrayEx<Vec2, LinearAllocatorPool>(bins.Length(), allocator);
+    Vec2 bin_offset  = Vec2(0.0f, 0.0f);
+    for (auto &size : bins) {
+        bin_offsets.Push(bin_offset, allocator);
+        bin_offset += size;
+    }
+
+    for (size_t i=0; i<count; i++) {
+        NestPlacement *placement = &placements[i];
+        RectNamed *collection_bound = &collection_bounds.array[i];
+        if (placement->bin == kNestUnplaced) continue;
+
+        DynamicArray<PathId>* collection = &paths->collections.reverse_collections_index[collection_bound->id];
+
+        Vec2 desired = Vec2(bin_offsets[placement->bin].x + placement->pos.x, bin_offsets[placement->bin].y + placement->pos.y);
+        Mat3x2 move  = Mat3x2::Translation(Vec2(-collection_bound->rect.Left(), -collection_bound->rect.Top())) *
+            NestRotation(placement->rotation, collection_bound->rect.size) * Mat3x2::Translation(desired);
+
+        paths->ApplyMatrix(collection->Data(), collection->Length(), move);
+    }
+
+    for (auto &part : parts) {
+        part.Free();
     }
+    parts.Free();
 }
 
-CollectionBounds GetCollectionBounds(Document *doc, LinearAllocatorPool *allocator) {
-    size_t collection_count = doc->pipeline_shapes.collections.reverse_collections_index.Length();
+CollectionBounds GetCollectionBounds(Paths *paths, LinearAllocatorPool *allocator) {
+    size_t collection_count = paths->collections.reverse_collections_index.Length();
     CollectionBounds bounds = {
         DynamicArrayEx<RectNamed, LinearAllocatorPool>(collection_count, allocator),
         HashMapEx<size_t, Rect, LinearAllocatorPool>(collection_count, allocator),
     };
 
-    for (auto &entry : doc->pipeline_shapes.collections.reverse_collections_index) {
-        CollectionId collection     = entry.key;
-        DynamicArray<PathId> shapes = entry.value;
-
-        size_t shape_id       = shapes[0];
-        Rect collection_bound = doc->pipeline_shapes.GetBounds(shape_id);
-
-        for (auto k=1; k<shapes.Length(); k++) {
-            shape_id = shapes[k];
+    paths->UpdateBounds();
 
-            ID2D1TransformedGeometry* geo = *doc->pipeline_shapes.GetTransformedGeometry(shape_id);
+    // Holds the index into the bounds store of every shape in the collection being reduced
+    auto indices = DynamicArrayEx<size_t, LinearAllocatorPool>(10, allocator);
 
-            Rect shape_bound = GetBounds(geo);
+    for (auto &entry : paths->collections.reverse_collections_index) {
+        CollectionId collection     = entry.key;
+        DynamicArray<PathId> shapes = entry.value;
 
-            collection_bound = collection_bound.Union(&shape_bound);
+        indices.Clear();
+        for (auto& shape_id : shapes) {
+            indices.Push(paths->index[shape_id], allocator);
         }
 
+        Rect collection_bound = UnionBounds(&paths->bounds, indices.Data(), indices.Length());
+
         bounds.array.Push(RectNamed(collection_bound, collection), allocator);
         bounds.map.Set(collection, collection_bound, allocator);
     }
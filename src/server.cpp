@@ -0,0 +1,606 @@
+// sviggy-server runs pipeline jobs for other programs on the same machine and keeps what it loaded warm between
+// them, so a job on a file it's already seen skips the parse, the geometry and the tag interning and a job it's
+// already run skips the pipeline too. Clients connect to the unix socket, send one request, shut down their side
+// for writing and read the reply until the server closes the connection:
+//
+//     run <input.svg> <output.svg>    followed by the pipeline spec on the next lines, see BuildPipelineFromSpec
+//     stats
+//     trace <trace.json>              writes what the zones in trace.hpp recorded so far
+//     shutdown
+//
+// run replies "ok <shapes out> <seconds> <document hit|miss> <result hit|miss>" or "error <message>". Paths are
+// separated by single spaces so they can't contain spaces themselves.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ds.hpp"
+#include "files.hpp"
+#include "packing_cache.hpp"
+#include "parallel.hpp"
+#include "pipeline.hpp"
+#include "svg.hpp"
+#include "sviggy.hpp"
+#include "trace.hpp"
+
+SysAllocator global_allocator = SysAllocator();
+
+// Same guess the app makes for how many shapes a file holds from its size
+constexpr size_t kBytesPerShapeEstimate = 250;
+
+// Documents kept loaded by default. The least recently used one that isn't in use is dropped past this
+constexpr size_t kDefaultCachedDocuments = 32;
+
+// Pipeline results kept per document, one per spec. The oldest is dropped past this
+constexpr size_t kMaxCachedResults = 8;
+
+// Requests are a couple of paths and a spec so anything bigger is a mistake
+constexpr size_t kMaxRequestSize = 1 << 20;
+
+// How many of the latest jobs the latency percentiles are taken over
+constexpr size_t kLatencyWindow = 1024;
+
+constexpr size_t kMaxReplySize = 1024;
+
+// Smallest linear allocator handed to the pipeline for a document
+constexpr size_t kMinPipelinePoolSize = 4096;
+
+class CachedResult {
+    public:
+    uint64_t spec_key;
+    Paths    shapes; // The pipeline shapes the spec produced
+    CachedResult(uint64_t spec_key, Paths shapes) : spec_key(spec_key), shapes(shapes) {};
+};
+
+// A loaded document and the pipeline results computed from it. Only one job uses a document at a time since
+// running a pipeline writes to the document's pipeline shapes
+class CachedDocument {
+    public:
+    uint64_t                   content_key; // Hash of the file contents
+    std::mutex                 lock;        // Held by the job using the document
+    bool                       loaded;      // Guarded by lock
+    Document                   doc;         // Guarded by lock
+    DynamicArray<CachedResult> results;     // Guarded by lock, oldest first
+    size_t                     users;       // Jobs holding or waiting on the document, guarded by the cache lock
+    uint64_t                   last_used;   // Guarded by the cache lock
+    CachedDocument(uint64_t content_key, size_t estimated_shapes) :
+        content_key(content_key),
+        loaded(false),
+        doc(Document(estimated_shapes)),
+        results(DynamicArray<CachedResult>(kMaxCachedResults)),
+        users(0),
+        last_used(0) {};
+
+    void Free();
+
+    CachedResult* FindResult(uint64_t spec_key);
+    CachedResult* AddResult(uint64_t spec_key, Paths shapes);
+};
+
+void CachedDocument::Free() {
+    for (auto &result : this->results) {
+        result.shapes.Free();
+    }
+
+    this->results.Free();
+    this->doc.Free();
+}
+
+CachedResult* CachedDocument::FindResult(uint64_t spec_key) {
+    for (auto &result : this->results) {
+        if (result.spec_key == spec_key) return &result;
+    }
+
+    return NULL;
+}
+
+CachedResult* CachedDocument::AddResult(uint64_t spec_key, Paths shapes) {
+    if (this->results.Length() >= kMaxCachedResults) {
+        this->results[0].shapes.Free();
+        this->results.RemoveIndex(0);
+    }
+
+    this->results.Push(CachedResult(spec_key, shapes));
+    return this->results.LastPtr();
+}
+
+// Documents by the hash of their file contents, so the same file under another name or a copy of it is still a hit
+class DocumentCache {
+    public:
+    std::mutex                    lock;
+    DynamicArray<CachedDocument*> documents;
+    size_t                        capacity;
+    uint64_t                      clock; // Bumped on every acquire to order the documents by use
+    DocumentCache(size_t capacity) : documents(DynamicArray<CachedDocument*>(capacity)), capacity(capacity), clock(0) {};
+
+    void Free();
+
+    // Returns the document for content_key, adding an empty one when there isn't one yet. The document can't be
+    // dropped until it's released. It still has to be locked before it's used
+    CachedDocument* Acquire(uint64_t content_key, size_t estimated_shapes);
+    void Release(CachedDocument* document);
+
+    size_t Length();
+};
+
+void DocumentCache::Free() {
+    for (auto document : this->documents) {
+        document->Free();
+        delete document;
+    }
+
+    this->documents.Free();
+}
+
+CachedDocument* DocumentCache::Acquire(uint64_t content_key, size_t estimated_shapes) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->clock++;
+
+    for (auto document : this->documents) {
+        if (document->content_key == content_key) {
+            document->users++;
+            document->last_used = this->clock;
+            return document;
+        }
+    }
+
+    // When every document is in use the cache grows past its capacity for a bit instead of making the job wait
+    while (this->documents.Length() >= this->capacity) {
+        size_t oldest = this->documents.Length();
+        for (size_t i=0; i<this->documents.Length(); i++) {
+            CachedDocument *document = this->documents[i];
+            if (document->users) continue;
+            if (oldest == this->documents.Length() || document->last_used < this->documents[oldest]->last_used) {
+                oldest = i;
+            }
+        }
+
+        if (oldest == this->documents.Length()) break;
+
+        this->documents[oldest]->Free();
+        delete this->documents[oldest];
+        this->documents.RemoveIndex(oldest);
+    }
+
+    CachedDocument *document = new CachedDocument(content_key, estimated_shapes);
+    document->users     = 1;
+    document->last_used = this->clock;
+    this->documents.Push(document);
+
+    return document;
+}
+
+void DocumentCache::Release(CachedDocument* document) {
+    std::lock_guard<std::mutex> guard(this->lock);
+    document->users--;
+}
+
+size_t DocumentCache::Length() {
+    std::lock_guard<std::mutex> guard(this->lock);
+    return this->documents.Length();
+}
+
+class ServerMetrics {
+    public:
+    std::mutex lock;
+    std::chrono::high_resolution_clock::time_point started;
+    size_t jobs;
+    size_t failures;
+    size_t document_hits;
+    size_t result_hits;
+    double total_seconds;
+    double max_seconds;
+    double latencies[kLatencyWindow]; // Seconds of the latest jobs, written round robin
+    ServerMetrics() :
+        started(std::chrono::high_resolution_clock::now()),
+        jobs(0),
+        failures(0),
+        document_hits(0),
+        result_hits(0),
+        total_seconds(0.0),
+        max_seconds(0.0) {};
+
+    void Record(double seconds, bool ok, bool document_hit, bool result_hit);
+
+    // Writes a line per metric into out. packing_cache can be NULL
+    void Report(char *out, size_t size, size_t cached_documents, PackingCache *packing_cache);
+};
+
+void ServerMetrics::Record(double seconds, bool ok, bool document_hit, bool result_hit) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->latencies[this->jobs % kLatencyWindow] = seconds;
+    this->jobs++;
+    this->failures      += !ok;
+    this->document_hits += document_hit;
+    this->result_hits   += result_hit;
+    this->total_seconds += seconds;
+    this->max_seconds    = std::max(this->max_seconds, seconds);
+}
+
+void ServerMetrics::Report(char *out, size_t size, size_t cached_documents, PackingCache *packing_cache) {
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    auto now = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> uptime = now - this->started;
+
+    double sorted[kLatencyWindow];
+    size_t window = std::min<size_t>(this->jobs, kLatencyWindow);
+    std::memcpy(sorted, this->latencies, window * sizeof(double));
+    std::sort(sorted, sorted + window);
+
+    double p50  = window ? sorted[window / 2] : 0.0;
+    double p99  = window ? sorted[std::min<size_t>(window - 1, window * 99 / 100)] : 0.0;
+    double mean = this->jobs ? this->total_seconds / this->jobs : 0.0;
+
+    int written = snprintf(out, size,
+        "jobs %zu\n"
+        "failed %zu\n"
+        "uptime %.3f seconds\n"
+        "throughput %.3f jobs/second\n"
+        "latency mean %.6f p50 %.6f p99 %.6f max %.6f seconds\n"
+        "document hits %zu\n"
+        "result hits %zu\n"
+        "cached documents %zu\n",
+        this->jobs,
+        this->failures,
+        uptime.count(),
+        uptime.count() > 0.0 ? this->jobs / uptime.count() : 0.0,
+        mean, p50, p99, this->max_seconds,
+        this->document_hits,
+        this->result_hits,
+        cached_documents
+    );
+
+    if (packing_cache && written > 0 && (size_t)written < size) {
+        snprintf(out + written, size - written, "packing cache hits %zu misses %zu write failures %zu\n",
+            packing_cache->hits.load(), packing_cache->misses.load(), packing_cache->write_failures.load());
+    }
+}
+
+// Connections waiting on a worker
+class ConnectionQueue {
+    public:
+    std::mutex              lock;
+    std::condition_variable ready;
+    DynamicArray<int>       connections;
+    bool                    closed;
+    ConnectionQueue() : connections(DynamicArray<int>(64)), closed(false) {};
+
+    void Push(int connection);
+
+    // Waits for a connection. Returns false once the queue is closed and empty
+    bool Pop(int *connection);
+    void Close();
+};
+
+void ConnectionQueue::Push(int connection) {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->connections.Push(connection);
+    }
+
+    this->ready.notify_one();
+}
+
+bool ConnectionQueue::Pop(int *connection) {
+    std::unique_lock<std::mutex> guard(this->lock);
+    this->ready.wait(guard, [this] { return this->connections.Length() || this->closed; });
+
+    if (!this->connections.Length()) return false;
+
+    *connection = this->connections[0];
+    this->connections.RemoveIndex(0);
+    return true;
+}
+
+void ConnectionQueue::Close() {
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->closed = true;
+    }
+
+    this->ready.notify_all();
+}
+
+class Server {
+    public:
+    int               listener;
+    std::atomic<bool> stopping;
+    DocumentCache     documents;
+    ServerMetrics     metrics;
+    ConnectionQueue   queue;
+    PackingCache      *packing_cache; // NULL unless --packing-cache was given
+    Server(int listener, size_t cached_documents, PackingCache *packing_cache) :
+        listener(listener), stopping(false), documents(DocumentCache(cached_documents)), packing_cache(packing_cache) {};
+};
+
+static void PrintUsage() {
+    printf("usage: sviggy-server <socket path> [--jobs N] [--cache N] [--packing-cache dir]\n");
+    printf("Runs pipeline jobs sent over the socket with N workers, keeping up to N documents loaded between jobs\n");
+    printf("Layouts reuse the packings in the packing cache dir and add theirs to it, the dir has to exist\n");
+}
+
+static bool SendAll(int connection, const char *data, size_t length) {
+    while (length) {
+        ssize_t sent = send(connection, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+
+        data   += sent;
+        length -= sent;
+    }
+
+    return true;
+}
+
+// Reads until the client shuts down its side. Returns NULL when the request is too big or the read fails
+static char* ReadRequest(int connection) {
+    DynamicArray<char> request = DynamicArray<char>(4096);
+    char buffer[4096];
+
+    for (;;) {
+        ssize_t got = recv(connection, buffer, sizeof(buffer), 0);
+        if (got == 0) break;
+
+        if (got < 0 || request.Length() + got > kMaxRequestSize) {
+            request.Free();
+            return NULL;
+        }
+
+        for (ssize_t i=0; i<got; i++) {
+            request.Push(buffer[i]);
+        }
+    }
+
+    request.Push(0);
+    return request.Data();
+}
+
+// Runs spec on input and writes the pipeline shapes to output, filling in reply either way
+static void RunJob(Server *server, char *input, char *output, char *spec, char *reply, size_t reply_size) {
+    TRACE_FUNCTION();
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bool document_hit = false;
+    bool result_hit   = false;
+    size_t shapes     = 0;
+
+    size_t length;
+    char *data = ReadWholeFile(input, &length);
+    bool ok = data != NULL;
+
+    if (!ok) {
+        snprintf(reply, reply_size, "error couldn't read %s\n", input);
+    } else {
+        uint64_t content_key = HashBytes(kPipelineHashSeed, data, length);
+        uint64_t spec_key    = HashBytes(kPipelineHashSeed, spec, strlen(spec));
+
+        size_t estimated_shapes = std::max<size_t>(100, length / kBytesPerShapeEstimate);
+        CachedDocument *entry = server->documents.Acquire(content_key, estimated_shapes);
+
+        {
+            std::lock_guard<std::mutex> guard(entry->lock);
+
+            document_hit = entry->loaded;
+            if (!entry->loaded) {
+                entry->loaded = LoadSVGBuffer(data, length, input, &entry->doc, NULL);
+            }
+
+            ok = entry->loaded;
+            if (!ok) snprintf(reply, reply_size, "error couldn't load %s\n", input);
+
+            CachedResult *result = ok ? entry->FindResult(spec_key) : NULL;
+            result_hit = result != NULL;
+
+            if (ok && !result) {
+                // Filters compile against the cached document's tags, which were interned when it was loaded
+                PipelineActions pipeline = PipelineActions();
+                pipeline.packing_cache = server->packing_cache;
+                ok = BuildPipelineFromSpec(spec, &pipeline);
+
+                if (ok) {
+                    LinearAllocatorPool allocator = LinearAllocatorPool(std::max<size_t>(kMinPipelinePoolSize, entry->doc.paths.Length() * 100));
+                    pipeline.Run(&entry->doc, &allocator);
+                    allocator.FreeAllocator();
+
+                    // The result takes over the pipeline shapes rather than copying them
+                    result = entry->AddResult(spec_key, entry->doc.pipeline_shapes);
+                    entry->doc.pipeline_shapes = Paths(1);
+                } else {
+                    snprintf(reply, reply_size, "error the pipeline spec isn't valid\n");
+                }
+
+                pipeline.Free();
+            }
+
+            if (ok) {
+                shapes = result->shapes.Length();
+                ok = WriteSVGFile(output, &result->shapes);
+                if (!ok) snprintf(reply, reply_size, "error couldn't write %s\n", output);
+            }
+        }
+
+        server->documents.Release(entry);
+        global_allocator.Free(data);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> elapsed = end - start;
+
+    if (ok) {
+        snprintf(reply, reply_size, "ok %zu %.6f document %s result %s\n", shapes, elapsed.count(), document_hit ? "hit" : "miss", result_hit ? "hit" : "miss");
+    }
+
+    server->metrics.Record(elapsed.count(), ok, document_hit, result_hit);
+    printf("%s %s -> %s in %.6f seconds\n", ok ? "Ran" : "Failed", input, output, elapsed.count());
+}
+
+static void HandleConnection(Server *server, int connection) {
+    char reply[kMaxReplySize];
+    char *request = ReadRequest(connection);
+
+    if (!request) {
+        snprintf(reply, sizeof(reply), "error the request couldn't be read\n");
+        SendAll(connection, reply, strlen(reply));
+        close(connection);
+        return;
+    }
+
+    // The first line is the command and everything after it is the spec for run
+    char *spec = request;
+    while (*spec && *spec != '\n') spec++;
+    if (*spec) *spec++ = 0;
+
+    size_t line_length = strlen(request);
+    if (line_length && request[line_length - 1] == '\r') request[line_length - 1] = 0;
+
+    if (!strcmp(request, "stats")) {
+        server->metrics.Report(reply, sizeof(reply), server->documents.Length(), server->packing_cache);
+    } else if (!strncmp(request, "trace ", 6)) {
+        bool ok = WriteTraceFile(request + 6);
+        snprintf(reply, sizeof(reply), ok ? "ok\n" : "error couldn't write %s\n", request + 6);
+    } else if (!strcmp(request, "shutdown")) {
+        snprintf(reply, sizeof(reply), "ok\n");
+
+        // Stops accept so the main thread can wind the workers down
+        server->stopping = true;
+        shutdown(server->listener, SHUT_RDWR);
+    } else if (!strncmp(request, "run ", 4)) {
+        char *input  = request + 4;
+        char *output = strchr(input, ' ');
+
+        if (output && *(output + 1)) {
+            *output++ = 0;
+            RunJob(server, input, output, spec, reply, sizeof(reply));
+        } else {
+            snprintf(reply, sizeof(reply), "error expected run <input.svg> <output.svg>\n");
+        }
+    } else {
+        snprintf(reply, sizeof(reply), "error unknown command %s\n", request);
+    }
+
+    SendAll(connection, reply, strlen(reply));
+    close(connection);
+
+    global_allocator.Free(request);
+}
+
+int main(int argc, char **argv) {
+    size_t jobs             = 0;
+    size_t cached_documents = kDefaultCachedDocuments;
+    char   *socket_path     = NULL;
+    char   *packing_dir     = NULL;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "--cache")) {
+            size_t value = i + 1 < argc ? strtoull(argv[i + 1], NULL, 10) : 0;
+            if (!value) {
+                PrintUsage();
+                return 1;
+            }
+
+            if (!strcmp(argv[i], "--jobs")) jobs = value;
+            else                            cached_documents = value;
+
+            i++;
+        } else if (!strcmp(argv[i], "--packing-cache")) {
+            if (i + 1 >= argc) {
+                PrintUsage();
+                return 1;
+            }
+
+            packing_dir = argv[++i];
+        } else if (!socket_path) {
+            socket_path = argv[i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!socket_path) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!jobs) {
+        jobs = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    jobs = std::min<size_t>(jobs, kMaxParallelThreads);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Socket path %s is too long\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        printf("Couldn't create a socket\n");
+        return 1;
+    }
+
+    // A socket file left behind by a server that didn't shut down cleanly would make bind fail
+    unlink(socket_path);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) || listen(listener, SOMAXCONN)) {
+        printf("Couldn't listen on %s\n", socket_path);
+        close(listener);
+        return 1;
+    }
+
+    PackingCache *packing_cache = packing_dir ? new PackingCache(packing_dir) : NULL;
+
+    Server *server = new Server(listener, cached_documents, packing_cache);
+    printf("Listening on %s with %zu workers and room for %zu documents\n", socket_path, jobs, cached_documents);
+
+    std::thread workers[kMaxParallelThreads];
+    for (size_t i=0; i<jobs; i++) {
+        workers[i] = std::thread([server]() {
+            int connection;
+            while (server->queue.Pop(&connection)) {
+                HandleConnection(server, connection);
+            }
+        });
+    }
+
+    while (!server->stopping) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) continue;
+
+        server->queue.Push(connection);
+    }
+
+    // Connections already queued still get run before the workers stop
+    server->queue.Close();
+    for (size_t i=0; i<jobs; i++) {
+        workers[i].join();
+    }
+
+    char report[kMaxReplySize];
+    server->metrics.Report(report, sizeof(report), server->documents.Length(), server->packing_cache);
+    printf("%s", report);
+
+    close(listener);
+    unlink(socket_path);
+
+    server->documents.Free();
+    server->queue.connections.Free();
+    delete server;
+    delete packing_cache;
+
+    return 0;
+}
@@ -1,22 +1,20 @@
+#include <algorithm>
+#ifndef SVIGGY_HEADLESS
 #include <d2d1.h>
 #include <d2d1_2.h>
+#endif
 
+#include "containment.hpp"
 #include "ds.hpp"
-#include "shapes.hpp"
+#include "parallel.hpp"
 #include "sviggy.hpp"
+#include "trace.hpp"
 
 // TODO: errors need to be handled in this file when creating geometry
 // Maybe a messagebox pops up to the user asking them if they want to close
 // the application
 
-Transformation::Transformation() : translation(Vec2(0.0f, 0.0f)), scale(Vec2(1.0, 1.0)), rotation(0.0f) {};
-D2D1::Matrix3x2F Transformation::Matrix(Vec2 center) {
-    D2D1::Matrix3x2F rotation = D2D1::Matrix3x2F::Rotation(this->rotation, center.D2Point());
-    D2D1::Matrix3x2F translation = D2D1::Matrix3x2F::Translation(this->translation.Size());
-    D2D1::Matrix3x2F scale = D2D1::Matrix3x2F::Scale(this->scale.Size(), center.D2Point());
-    return scale * rotation * translation;
-};
-
+#ifndef SVIGGY_HEADLESS
 Text::Text(Vec2 pos, String text, DXState* dx) : pos(pos), text(text), transform(Transformation()) {
     HRESULT hr;
 
@@ -57,8 +55,11 @@ float Text::X() {
 float Text::Y() {
     return this->pos.y;
 }
+#endif
 
-PathBuilder::PathBuilder(DXState *dx) : has_open_figure(false) {
+PathBuilder::PathBuilder(DXState *dx) : geometry_sink(NULL), geometry(NULL), commands(DynamicArray<float>(16)), has_open_figure(false) {
+    // Headless builds only record the commands
+    #ifndef SVIGGY_HEADLESS
     HRESULT hr;
 
     hr = dx->factory->CreatePathGeometry(&this->geometry);
@@ -68,6 +69,7 @@ PathBuilder::PathBuilder(DXState *dx) : has_open_figure(false) {
     ExitOnFailure(hr);
 
     geometry_sink->SetFillMode(D2D1_FILL_MODE_WINDING);
+    #endif
 }
 
 ShapeData PathBuilder::CreateLine(Vec2 from, Vec2 to, DXState *dx) {
@@ -109,50 +111,87 @@ ShapeData PathBuilder::CreateCircle(Vec2 center, float radius, DXState *dx) {
     // to do it so I'm leaving this TODO as a reminder to come back later
     PathBuilder builder = PathBuilder(dx);
     builder.Move(start);
-    builder.Arc(end, size, 0.0f, D2D1_SWEEP_DIRECTION_CLOCKWISE);
+    builder.Arc(end, size, 0.0f, kClockwise);
     builder.Move(start);
-    builder.Arc(end, size, 0.0f, D2D1_SWEEP_DIRECTION_COUNTER_CLOCKWISE);
+    builder.Arc(end, size, 0.0f, kCounterClockwise);
 
     return builder.BuildPath(dx);
 }
 
 void PathBuilder::Move(Vec2 to) {
+    #ifndef SVIGGY_HEADLESS
     if (this->has_open_figure) {
         geometry_sink->EndFigure(D2D1_FIGURE_END_OPEN);
     }
 
     geometry_sink->BeginFigure(to.D2Point(), D2D1_FIGURE_BEGIN_FILLED);
+    #endif
     this->has_open_figure = true;
+
+    this->commands.Push(kPathCommandMove);
+    this->commands.Push(to.x);
+    this->commands.Push(to.y);
 }
 
 void PathBuilder::Line(Vec2 to) {
+   #ifndef SVIGGY_HEADLESS
    this->geometry_sink->AddLine(to.D2Point());
+   #endif
+
+   this->commands.Push(kPathCommandLine);
+   this->commands.Push(to.x);
+   this->commands.Push(to.y);
 }
 
 void PathBuilder::Cubic(Vec2 c1, Vec2 c2, Vec2 end) {
+    #ifndef SVIGGY_HEADLESS
     D2D1_BEZIER_SEGMENT bezier = D2D1::BezierSegment(c1.D2Point(), c2.D2Point(), end.D2Point());
     geometry_sink->AddBezier(bezier);
+    #endif
+
+    this->commands.Push(kPathCommandCubic);
+    this->commands.Push(c1.x);
+    this->commands.Push(c1.y);
+    this->commands.Push(c2.x);
+    this->commands.Push(c2.y);
+    this->commands.Push(end.x);
+    this->commands.Push(end.y);
 }
 
-void PathBuilder::Arc(Vec2 end, Vec2 size, float rot, D2D1_SWEEP_DIRECTION direction) {
+void PathBuilder::Arc(Vec2 end, Vec2 size, float rot, float direction) {
+    #ifndef SVIGGY_HEADLESS
     D2D1_ARC_SEGMENT arc = D2D1_ARC_SEGMENT {
         end.D2Point(),
         size.Size(),
         rot,
-        direction,
+        direction == kClockwise ? D2D1_SWEEP_DIRECTION_CLOCKWISE : D2D1_SWEEP_DIRECTION_COUNTER_CLOCKWISE,
         D2D1_ARC_SIZE_LARGE,
     };
     this->geometry_sink->AddArc(arc);
+    #endif
+
+    this->commands.Push(kPathCommandArc);
+    this->commands.Push(end.x);
+    this->commands.Push(end.y);
+    this->commands.Push(size.x);
+    this->commands.Push(size.y);
+    this->commands.Push(rot);
+    this->commands.Push(direction);
 }
 
 void PathBuilder::Close() {
     if (this->has_open_figure) {
+        #ifndef SVIGGY_HEADLESS
         this->geometry_sink->EndFigure(D2D1_FIGURE_END_CLOSED);
+        #endif
         this->has_open_figure = false;
+
+        this->commands.Push(kPathCommandClose);
     }
 }
 
 ShapeData PathBuilder::BuildPath(DXState *dx) {
+    #ifndef SVIGGY_HEADLESS
     HRESULT hr;
 
     if (this->has_open_figure) {
@@ -165,23 +204,46 @@ ShapeData PathBuilder::BuildPath(DXState *dx) {
     hr = this->geometry_sink->Release();
     ExitOnFailure(hr);
 
-    return ShapeData(this->geometry);
+    return ShapeData(this->geometry, this->commands);
+    #else
+    return ShapeData(NULL, this->commands);
+    #endif
 }
 
-ShapeData::ShapeData(ID2D1Geometry* geometry) :
-    transform(Transformation()),
-    geometry(geometry)
-    {};
+LodSet::LodSet() {
+    for (auto i=0; i<kLodLevels; i++) {
+        this->levels[i] = NULL;
+    }
+}
 
-D2D1_MATRIX_3X2_F ShapeData::TransformMatrix() {
-    Vec2 center = GeometryCenter(this->geometry);
-    return this->transform.Matrix(center);
-};
+void LodSet::Release() {
+    #ifndef SVIGGY_HEADLESS
+    for (auto i=0; i<kLodLevels; i++) {
+        if (this->levels[i]) {
+            this->levels[i]->Release();
+            this->levels[i] = NULL;
+        }
+    }
+    #endif
+}
+
+ShapeData::ShapeData(ID2D1Geometry* geometry, DynamicArray<float> commands) :
+    geometry(geometry),
+    commands(commands)
+    {};
 
 Paths::Paths(size_t estimated_cap) :
     shapes(DynamicArray<ShapeData>(estimated_cap)),
     transformed_geometries(DynamicArray<ID2D1TransformedGeometry*>(estimated_cap)),
-    low_fidelities(DynamicArray<ID2D1GeometryRealization*>(estimated_cap)),
+    lods(DynamicArray<LodSet>(estimated_cap)),
+    original_bounds(BoundsStore(estimated_cap)),
+    centers(DynamicArray<Vec2>(estimated_cap)),
+    transforms(MatrixStore(estimated_cap)),
+    bounds(BoundsStore(estimated_cap)),
+    bounds_dirty(DynamicArray<bool>(estimated_cap)),
+    dirty_bounds(DynamicArray<PathId>(estimated_cap)),
+    spatial_index(SpatialIndex(estimated_cap)),
+    spatial_leaves(DynamicArray<size_t>(estimated_cap)),
     index(HashMap<PathId, size_t>(estimated_cap)),
     reverse_index(DynamicArray<PathId>(estimated_cap)),
     collections(Collections(estimated_cap)),
@@ -196,17 +258,30 @@ void Paths::FreeAndReleaseResources() {
 void Paths::Free() {
     this->shapes.Free();
     this->transformed_geometries.Free();
-    this->low_fidelities.Free();
+    this->lods.Free();
+    this->original_bounds.Free();
+    this->centers.Free();
+    this->transforms.Free();
+    this->bounds.Free();
+    this->bounds_dirty.Free();
+    this->dirty_bounds.Free();
+    this->spatial_index.Free();
+    this->spatial_leaves.Free();
     this->index.Free();
     this->reverse_index.Free();
-
-    // TODO: collections and tags need to be released, come back to this after the restructure
+    this->collections.Free();
+    this->tags.Free();
 }
 
 // TODO: release geometry
 void Paths::ReleaseResources() {
+    #ifndef SVIGGY_HEADLESS
     this->transformed_geometries.ReleaseAll();
-    this->low_fidelities.ReleaseAll();
+
+    for (auto &lod : this->lods) {
+        lod.Release();
+    }
+    #endif
 }
 
 PathId Paths::NextId() {
@@ -222,10 +297,25 @@ PathId Paths::AddPath(ShapeData path) {
     this->shapes.Push(path);
 
     this->transformed_geometries.Push(NULL);
-    this->low_fidelities.Push(NULL);
+    this->lods.Push(LodSet());
+
+    // New paths always start with the identity transformation so the transformed bounds start out
+    // equal to the original bounds
+    Rect original_bound = PathBounds(&path.commands, Mat3x2());
+    this->original_bounds.Push(original_bound);
+    this->centers.Push(original_bound.Center());
+    this->transforms.Push(Mat3x2());
+    this->bounds.Push(original_bound);
+    this->bounds_dirty.Push(false);
+
+    // Until the spatial index is built it gets bulk loaded with everything the first time it's needed
+    if (this->spatial_index.built) {
+        this->spatial_leaves.Push(this->spatial_index.Insert(index, original_bound));
+    }
 
     this->index.Set(id, index);
     this->reverse_index.Push(id);
+    this->revision++;
 
     return id;
 };
@@ -236,20 +326,33 @@ PathId Paths::AddPath(ShapeData path) {
 void Paths::DeletePath(PathId id) {
     size_t index = this->index[id];
     this->index.Remove(id);
+    this->revision++;
 
+    #ifndef SVIGGY_HEADLESS
     if (this->transformed_geometries[index]) {
         this->transformed_geometries[index]->Release();
     }
+    #endif
 
-    if (this->low_fidelities[index]) {
-        this->low_fidelities[index]->Release();
+    this->lods[index].Release();
+
+    if (this->spatial_index.built) {
+        this->spatial_index.Remove(this->spatial_leaves[index]);
+        this->spatial_leaves.RemoveIndex(index);
     }
 
     this->shapes                .array.length--;
     this->transformed_geometries.array.length--;
-    this->low_fidelities        .array.length--;
+    this->lods                  .array.length--;
+    this->centers               .array.length--;
+    this->bounds_dirty          .array.length--;
     this->reverse_index         .array.length--;
 
+    // The column stores remove the same way, moving the last item into the removed index
+    this->original_bounds.RemoveIndex(index);
+    this->transforms     .RemoveIndex(index);
+    this->bounds         .RemoveIndex(index);
+
     // If the arrays had more than one item and that was not the last item
     // we move the item that was at the end into the old paths position
     // and update the indexes for it
@@ -259,10 +362,16 @@ void Paths::DeletePath(PathId id) {
 
         this->shapes                .array.data[index] = this->shapes                .array.data[moved_item_index];
         this->transformed_geometries.array.data[index] = this->transformed_geometries.array.data[moved_item_index];
-        this->low_fidelities        .array.data[index] = this->low_fidelities        .array.data[moved_item_index];
+        this->lods                  .array.data[index] = this->lods                  .array.data[moved_item_index];
+        this->centers               .array.data[index] = this->centers               .array.data[moved_item_index];
+        this->bounds_dirty          .array.data[index] = this->bounds_dirty          .array.data[moved_item_index];
         this->reverse_index         .array.data[index] = this->reverse_index         .array.data[moved_item_index];
 
         this->index.Set(moved_item_id, index);
+
+        if (this->spatial_index.built) {
+            this->spatial_index.SetItem(this->spatial_leaves[index], index);
+        }
     }
 
     this->tags.RemovePath(id);
@@ -275,45 +384,45 @@ size_t Paths::Length() {
 }
 
 
-void Paths::RealizeGeometry(DXState *dx, PathId id) {
-    size_t index = this->index[id];
-
-    ShapeData* path                                 = &this->shapes[index];
+#ifndef SVIGGY_HEADLESS
+ID2D1TransformedGeometry* Paths::RealizedGeometry(DXState *dx, size_t index) {
     ID2D1TransformedGeometry** transformed_geometry = &this->transformed_geometries[index];
-    ID2D1GeometryRealization** low_fidelity         = &this->low_fidelities[index];
+    if (!(*transformed_geometry)) {
+        CreateTransformedGeometry(&this->shapes[index], this->transforms.Get(index), transformed_geometry, dx);
+    }
 
-    CreateGeometryRealizations(path, transformed_geometry, low_fidelity, dx);
+    return *transformed_geometry;
 }
+#endif
 
-// We provide a method to realize only the high fidelity geometry for the pipeline
-// shapes which get changed too often to do the more expensive low fidelity realization
-void Paths::RealizeHighFidelityGeometry(DXState *dx, PathId id) {
-    size_t index = this->index[id];
-
-    ShapeData* path                                 = &this->shapes[index];
-    ID2D1TransformedGeometry** transformed_geometry = &this->transformed_geometries[index];
+void Paths::ReleaseRealizations(size_t index) {
+    #ifndef SVIGGY_HEADLESS
+    if (this->transformed_geometries[index]) {
+        this->transformed_geometries[index]->Release();
+        this->transformed_geometries[index] = NULL;
+    }
+    #endif
 
-    CreateHighFidelityRealization(path, transformed_geometry, dx);
+    this->lods[index].Release();
 }
 
-void Paths::RealizeAllGeometry(DXState *dx) {
+void Paths::AdoptRealizations(Paths *from) {
     for (auto i=0; i<this->Length(); i++) {
-        ShapeData* path                                 = &this->shapes[i];
-        ID2D1TransformedGeometry** transformed_geometry = &this->transformed_geometries[i];
-        ID2D1GeometryRealization** low_fidelity         = &this->low_fidelities[i];
+        size_t *from_index = from->index.GetPtr(this->reverse_index[i]);
+        if (!from_index) continue;
 
-        CreateGeometryRealizations(path, transformed_geometry, low_fidelity, dx);
-    }
-}
+        size_t j = *from_index;
+        if (this->shapes[i].geometry != from->shapes[j].geometry || !(this->transforms.Get(i) == from->transforms.Get(j))) continue;
 
-// We provide a method to realize only the high fidelity geometry for the pipeline
-// shapes which get changed too often to do the more expensive low fidelity realization
-void Paths::RealizeAllHighFidelityGeometry(DXState *dx) {
-    for (auto i=0; i<this->Length(); i++) {
-        ShapeData* path                                 = &this->shapes[i];
-        ID2D1TransformedGeometry** transformed_geometry = &this->transformed_geometries[i];
+        // Anything these paths already had for the shape is replaced, and from gives up its references so
+        // releasing it later doesn't release what was taken
+        this->ReleaseRealizations(i);
+
+        this->transformed_geometries[i] = from->transformed_geometries[j];
+        this->lods[i]                   = from->lods[j];
 
-        CreateHighFidelityRealization(path, transformed_geometry, dx);
+        from->transformed_geometries[j] = NULL;
+        from->lods[j]                   = LodSet();
     }
 }
 
@@ -327,38 +436,150 @@ ID2D1TransformedGeometry** Paths::GetTransformedGeometry(PathId id) {
     return &this->transformed_geometries[index];
 }
 
-ID2D1GeometryRealization** Paths::GetLowFidelity(PathId id) {
+Mat3x2 Paths::GetTransformMatrix(PathId id) {
     size_t index = this->index[id];
-    return &this->low_fidelities[index];
+    return this->transforms.Get(index);
+}
+
+Transformation Paths::GetTransform(PathId id) {
+    size_t index = this->index[id];
+    return Transformation::FromMatrix(this->transforms.Get(index), this->centers[index]);
 }
 
 Rect Paths::GetBounds(PathId id) {
     size_t index = this->index[id];
+    return this->GetBoundsAtIndex(index);
+}
 
-    ID2D1TransformedGeometry* transformed_geo = this->transformed_geometries[index];
+// Transformed bounds are cached and only recomputed once a transform change has marked them as dirty
+Rect Paths::GetBoundsAtIndex(size_t index) {
+    if (this->bounds_dirty[index]) {
+        ShapeData* shape = &this->shapes[index];
 
-    D2D1_RECT_F bounds;
-    HRESULT hr = transformed_geo->GetBounds(NULL, &bounds);
-    ExitOnFailure(hr);
+        Rect bound = PathBounds(&shape->commands, this->transforms.Get(index));
+        this->bounds.Put(bound, index);
+        this->bounds_dirty[index] = false;
 
-    return Rect(&bounds);
+        if (this->spatial_index.built) {
+            this->spatial_index.Update(this->spatial_leaves[index], bound);
+        }
+    }
+
+    return this->bounds.Get(index);
+}
+
+void Paths::UpdateBounds() {
+    for (auto& id : this->dirty_bounds) {
+        // Paths can be deleted after being marked dirty
+        size_t* index = this->index.GetPtr(id);
+        if (index) {
+            this->GetBoundsAtIndex(*index);
+        }
+    }
+
+    this->dirty_bounds.Clear();
+}
+
+void Paths::BuildSpatialIndex() {
+    this->UpdateBounds();
+    this->spatial_index.Build(&this->bounds, &this->spatial_leaves);
+}
+
+void Paths::UpdateSpatialIndex() {
+    if (!this->spatial_index.built) {
+        this->BuildSpatialIndex();
+        return;
+    }
+
+    // Recomputing the dirty bounds moves their leaves in the index
+    this->UpdateBounds();
+}
+
+void Paths::QueryIntersecting(Rect area, DynamicArray<size_t>* out) {
+    this->UpdateSpatialIndex();
+    this->spatial_index.QueryIntersecting(area, out);
+}
+
+void Paths::QueryContainedBy(Rect area, DynamicArray<size_t>* out) {
+    this->UpdateSpatialIndex();
+    this->spatial_index.QueryContainedBy(area, out);
+}
+
+void Paths::QueryPoint(Vec2 point, float tolerance, DynamicArray<size_t>* out) {
+    this->UpdateSpatialIndex();
+    this->spatial_index.QueryPoint(point, tolerance, out);
 }
 
 void Paths::SetTransform(PathId id, Transformation transform) {
     size_t index = this->index[id];
-    this->shapes.Data()[index].transform = transform;
+    this->SetTransformMatrix(id, transform.Matrix(this->centers[index]));
+}
+
+void Paths::SetTransformMatrix(PathId id, Mat3x2 matrix) {
+    size_t index = this->index[id];
+    this->transforms.Put(matrix, index);
+    this->MarkBoundsDirty(index);
+    this->ReleaseRealizations(index);
+    this->revision++;
+}
+
+void Paths::ApplyMatrix(PathId* ids, size_t count, Mat3x2 matrix) {
+    auto indices = DynamicArray<size_t>(count);
+    for (auto i=0; i<count; i++) {
+        indices.Push(this->index[ids[i]]);
+    }
+
+    ApplyMatrixIndexed(&this->transforms, indices.Data(), count, matrix);
+    this->revision++;
+
+    for (auto &index : indices) {
+        this->ReleaseRealizations(index);
+
+        if (!matrix.IsTranslation() || this->bounds_dirty[index]) {
+            this->MarkBoundsDirty(index);
+            continue;
+        }
+
+        Rect bound = this->bounds.Get(index);
+        bound.pos.x += matrix.dx;
+        bound.pos.y += matrix.dy;
+        this->bounds.Put(bound, index);
+    }
+
+    // Layouts move every path through here one collection at a time, so rather than moving a leaf for each path the
+    // index is dropped and bulk loaded again before the next query
+    if (count) {
+        this->spatial_index.built = false;
+    }
+
+    indices.Free();
+}
+
+void Paths::MarkBoundsDirty(size_t index) {
+    if (!this->bounds_dirty[index]) {
+        this->bounds_dirty[index] = true;
+        this->dirty_bounds.Push(this->reverse_index[index]);
+    }
 }
 
 Paths Paths::Clone() {
-    // Clone sets the transformed geometries and the low fidelities to null in order to detach
+    // Clone sets the transformed geometries and the levels of detail to null in order to detach
     // the new Paths from the original resources created with DXState
     auto transformed_geometries = DynamicArray<ID2D1TransformedGeometry*>::Zeroed(this->transformed_geometries.Length());
-    auto low_fidelities         = DynamicArray<ID2D1GeometryRealization*>::Zeroed(this->low_fidelities.Length());
+    auto lods                   = DynamicArray<LodSet>::Zeroed(this->lods.Length());
 
     Paths cloned = Paths (
         this->shapes.Clone(),
         transformed_geometries,
-        low_fidelities,
+        lods,
+        this->original_bounds.Clone(),
+        this->centers.Clone(),
+        this->transforms.Clone(),
+        this->bounds.Clone(),
+        this->bounds_dirty.Clone(),
+        this->dirty_bounds.Clone(),
+        this->spatial_index.Clone(),
+        this->spatial_leaves.Clone(),
         this->index.Clone(),
         this->reverse_index.Clone(),
         this->collections.Clone(),
@@ -369,6 +590,133 @@ Paths Paths::Clone() {
     return cloned;
 }
 
+Paths Paths::Compact(bool* keep) {
+    // Bring the bounds up to date first so they can be copied over as they are and nothing starts out dirty
+    this->UpdateBounds();
+
+    size_t length = this->Length();
+    size_t chunks = ParallelChunkCount(length, kDefaultParallelChunk);
+
+    // Every chunk counts what it keeps, then a prefix sum over the counts gives each chunk where its paths start
+    // in the compacted arrays so all of the chunks can copy at the same time without touching each other
+    size_t offsets[kMaxParallelThreads + 1] = {};
+    ParallelFor(length, kDefaultParallelChunk, [&](size_t chunk, size_t start, size_t end) {
+        size_t kept = 0;
+        for (size_t i=start; i<end; i++) {
+            kept += keep[i];
+        }
+
+        offsets[chunk + 1] = kept;
+    });
+
+    for (size_t chunk=0; chunk<chunks; chunk++) {
+        offsets[chunk + 1] += offsets[chunk];
+    }
+
+    size_t kept = offsets[chunks];
+
+    auto shapes          = DynamicArray<ShapeData>(kept);
+    auto original_bounds = BoundsStore(kept);
+    auto centers         = DynamicArray<Vec2>(kept);
+    auto transforms      = MatrixStore(kept);
+    auto bounds          = BoundsStore(kept);
+    auto reverse_index   = DynamicArray<PathId>(kept);
+
+    shapes.Resize(kept);
+    original_bounds.Resize(kept);
+    centers.Resize(kept);
+    transforms.Resize(kept);
+    bounds.Resize(kept);
+    reverse_index.Resize(kept);
+
+    ParallelFor(length, kDefaultParallelChunk, [&](size_t chunk, size_t start, size_t end) {
+        size_t to = offsets[chunk];
+        for (size_t from=start; from<end; from++) {
+            if (!keep[from]) continue;
+
+            shapes[to]        = this->shapes[from];
+            centers[to]       = this->centers[from];
+            reverse_index[to] = this->reverse_index[from];
+            original_bounds.Put(this->original_bounds.Get(from), to);
+            transforms     .Put(this->transforms.Get(from), to);
+            bounds         .Put(this->bounds.Get(from), to);
+            to++;
+        }
+    });
+
+    // The maps aren't safe to fill from more than one thread so they're rebuilt afterwards, which only costs
+    // as much as the paths that were kept
+    size_t map_capacity = std::max<size_t>(kept, 1);
+
+    auto index       = HashMap<PathId, size_t>(map_capacity);
+    auto collections = Collections(map_capacity);
+    auto tags        = Tags(map_capacity);
+    collections.next_id = this->collections.next_id;
+
+    for (size_t i=0; i<kept; i++) {
+        PathId id = reverse_index[i];
+        index.Set(id, i);
+
+        CollectionId* collection = this->collections.collections.GetPtr(id);
+        if (collection) {
+            collections.AddToCollection(id, *collection);
+        }
+
+        DynamicArray<TagId>* path_tags = this->tags.tags.GetPtr(id);
+        if (path_tags) {
+            for (auto &tag : *path_tags) {
+                tags.AssignTag(id, tag);
+            }
+        }
+    }
+
+    return Paths(
+        shapes,
+        DynamicArray<ID2D1TransformedGeometry*>::Zeroed(kept),
+        DynamicArray<LodSet>::Zeroed(kept),
+        original_bounds,
+        centers,
+        transforms,
+        bounds,
+        DynamicArray<bool>::Zeroed(kept),
+        DynamicArray<PathId>(10),
+        SpatialIndex(map_capacity),
+        DynamicArray<size_t>(kept),
+        index,
+        reverse_index,
+        collections,
+        tags,
+        this->next_id
+    );
+}
+
+void Paths::AutoCollect() {
+    this->UpdateBounds();
+
+    auto containers = DynamicArray<size_t>(this->Length());
+    FindContainers(&this->bounds, &containers);
+
+    // Every root gets a fresh collection id, then all of the shapes are added to their root's collection in one
+    // pass instead of moving them between collections one at a time
+    auto collection_ids = DynamicArray<CollectionId>(this->Length());
+    collection_ids.Resize(this->Length());
+
+    this->collections.Reset();
+    for (auto i=0; i<this->Length(); i++) {
+        if (containers[i] == i) {
+            collection_ids[i] = this->collections.NextId();
+        }
+    }
+
+    for (auto i=0; i<this->Length(); i++) {
+        this->collections.AddToCollection(this->reverse_index[i], collection_ids[containers[i]]);
+    }
+    this->revision++;
+
+    containers.Free();
+    collection_ids.Free();
+}
+
 Collections::Collections(size_t estimated_shapes) :
     collections(HashMap<PathId, CollectionId>(estimated_shapes)),
     reverse_collections_index(HashMap<CollectionId, DynamicArray<PathId>>(estimated_shapes)),
@@ -427,6 +775,20 @@ void Collections::SetCollection(PathId shape_id, CollectionId collection_id) {
     }
 }
 
+void Collections::Reset() {
+    this->collections.Clear();
+
+    this->reverse_collections_index.FreeValues();
+    this->reverse_collections_index.Clear();
+}
+
+void Collections::AddToCollection(PathId shape_id, CollectionId collection_id) {
+    this->collections.Set(shape_id, collection_id);
+
+    DynamicArray<PathId>* collection = this->reverse_collections_index.GetPtrOrDefault(collection_id);
+    collection->Push(shape_id);
+}
+
 void Collections::RemovePath(PathId id) {
     CollectionId collection = this->collections[id];
     this->collections.Remove(id);
@@ -532,128 +894,61 @@ void Tags::RemovePath(PathId id) {
 
 Shape::Shape(ID2D1TransformedGeometry* geometry, Transformation transform) : geometry(geometry), transform(transform) {};
 
-Rect::Rect(Vec2 pos, Vec2 size) : pos(pos), size(size) {};
-
-Rect::Rect(D2D1_RECT_F* rect) :
- pos(Vec2(rect->left, rect->top)),
- size(Vec2(rect->right - rect->left, rect->bottom - rect->top)) {};
-
-float Rect::Left() {
-    return this->pos.x;
-}
-
-float Rect::Top() {
-    return this->pos.y;
-}
-
-float Rect::Right() {
-    return this->pos.x + this->size.x;
-}
-
-float Rect::Bottom() {
-    return this->pos.y + this->size.y;
-}
-
-float Rect::Width() {
-    return this->size.x;
-}
-
-float Rect::Height() {
-    return this->size.y;
-}
-
-bool Rect::Contains(Rect *other) {
-    return this->Left()   <= other->Left()  &&
-           this->Top()    <= other->Top()   &&
-           this->Right()  >= other->Right() &&
-           this->Bottom() >= other->Bottom();
-}
-
-Rect Rect::Union(Rect* other) {
-    float left   = std::min<float>(this->Left(),   other->Left());
-    float top    = std::min<float>(this->Top(),    other->Top());
-    float right  = std::max<float>(this->Right(),  other->Right());
-    float bottom = std::max<float>(this->Bottom(), other->Bottom());
-
-    Vec2 pos  = Vec2(left, top);
-    Vec2 size = Vec2(right - left, bottom - top);
-
-    return Rect(pos, size);
-}
-
-D2D1_RECT_F Rect::D2Rect() {
-    return D2D1::RectF(this->Left(), this->Top(), this->Right(), this->Bottom());
-}
-
-RectNamed::RectNamed(Rect rect, size_t id) : rect(rect), id(id) {};
-
-float RectNamed::Left() {
-    return this->rect.Left();
-}
-
-float RectNamed::Top() {
-    return this->rect.Top();
-}
-
-float RectNamed::Right() {
-    return this->rect.Right();
-}
-
-float RectNamed::Bottom() {
-    return this->rect.Bottom();
-}
-
-Vec2 GeometryCenter(ID2D1Geometry* geometry) {
-   D2D1_RECT_F bound;
-   HRESULT hr = geometry->GetBounds(NULL, &bound);
-   ExitOnFailure(hr);
-
-   float x = (bound.left + bound.right ) / 2.0f;
-   float y = (bound.top  + bound.bottom) / 2.0f;
+#ifndef SVIGGY_HEADLESS
+void CreateTransformedGeometry(ShapeData* shape, Mat3x2 transform, ID2D1TransformedGeometry** transformed_geometry, DXState *dx) {
+    HRESULT hr;
 
-   return Vec2(x, y);
+    hr = dx->factory->CreateTransformedGeometry(shape->geometry, transform.D2Matrix(), transformed_geometry);
+    ExitOnFailure(hr);
 }
 
-Transformation GetTranslationTo(Vec2 to, Rect* from) {
-   Transformation transform = Transformation();
+// Flattens the shape at the level's tolerance and turns the polyline into a stroked realization. scratch is
+// only used to hold the polyline so callers can share one between shapes
+void CreateLodRealization(ShapeData* shape, Mat3x2 transform, size_t level, ID2D1GeometryRealization** realization, SegmentStore* scratch, DXState *dx) {
+    HRESULT hr;
 
-   Vec2 current_pos = Vec2(from->Left(), from->Top());
-   Vec2 diff        = to - current_pos;
+    float tolerance = LodTolerance(level);
 
-    transform.translation = diff;
-    return transform;
-}
+    scratch->Clear();
+    FlattenPath(&shape->commands, transform, tolerance, scratch);
 
-Rect GetBounds(ID2D1TransformedGeometry* geo) {
-    D2D1_RECT_F d2bound;
-    HRESULT hr = geo->GetBounds(NULL, &d2bound);
+    ID2D1PathGeometry* polyline;
+    hr = dx->factory->CreatePathGeometry(&polyline);
     ExitOnFailure(hr);
 
-    return Rect(&d2bound);
-}
+    ID2D1GeometrySink* sink;
+    hr = polyline->Open(&sink);
+    ExitOnFailure(hr);
 
-constexpr float kFloatLowFidelity = 1.0f;
-void CreateHighFidelityRealization(ShapeData* shape, ID2D1TransformedGeometry** transformed_geometry, DXState *dx) {
-    HRESULT hr;
+    // Segments only start a new figure when they don't continue from the end of the previous one
+    bool has_open_figure = false;
+    for (auto i=0; i<scratch->Length(); i++) {
+        Vec2 from = Vec2(scratch->x0[i], scratch->y0[i]);
+        Vec2 to   = Vec2(scratch->x1[i], scratch->y1[i]);
 
-    hr = dx->factory->CreateTransformedGeometry(shape->geometry, shape->TransformMatrix(), transformed_geometry);
-    ExitOnFailure(hr);
-}
+        if (!has_open_figure || from.x != scratch->x1[i-1] || from.y != scratch->y1[i-1]) {
+            if (has_open_figure) {
+                sink->EndFigure(D2D1_FIGURE_END_OPEN);
+            }
 
-void CreateGeometryRealizations(ShapeData* shape, ID2D1TransformedGeometry** transformed_geometry, ID2D1GeometryRealization** low_fidelity, DXState *dx) {
-    HRESULT hr;
+            sink->BeginFigure(from.D2Point(), D2D1_FIGURE_BEGIN_HOLLOW);
+            has_open_figure = true;
+        }
 
-    if((*transformed_geometry)) {
-        (*transformed_geometry)->Release();
+        sink->AddLine(to.D2Point());
     }
 
-    if ((*low_fidelity)) {
-        (*low_fidelity)->Release();
+    if (has_open_figure) {
+        sink->EndFigure(D2D1_FIGURE_END_OPEN);
     }
 
-    hr = dx->factory->CreateTransformedGeometry(shape->geometry, shape->TransformMatrix(), transformed_geometry);
+    hr = sink->Close();
     ExitOnFailure(hr);
+    sink->Release();
 
-    hr = dx->d2_device_context->CreateStrokedGeometryRealization(*transformed_geometry, kFloatLowFidelity, kHairline, NULL, low_fidelity);
+    hr = dx->d2_device_context->CreateStrokedGeometryRealization(polyline, tolerance, kHairline, NULL, realization);
     ExitOnFailure(hr);
-}
\ No newline at end of file
+
+    polyline->Release();
+}
+#endif
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <math.h>
+
+#include "bounds.hpp"
+#include "ds.hpp"
+#include "geometry.hpp"
+#include "spatial_index.hpp"
+
+// Leaves per tile when STR orders the leaves. This only affects how the leaves get grouped before
+// they're paired up into the binary tree.
+constexpr size_t kStrTileSize = 8;
+
+static inline float Perimeter(float minx, float miny, float maxx, float maxy) {
+    return 2.0f * ((maxx - minx) + (maxy - miny));
+}
+
+static inline float UnionPerimeter(SpatialNode* a, SpatialNode* b) {
+    return Perimeter(
+        std::min<float>(a->minx, b->minx),
+        std::min<float>(a->miny, b->miny),
+        std::max<float>(a->maxx, b->maxx),
+        std::max<float>(a->maxy, b->maxy)
+    );
+}
+
+static inline bool NodeIntersects(SpatialNode* node, Rect* area) {
+    return node->minx <= area->Right()  && area->Left() <= node->maxx &&
+           node->miny <= area->Bottom() && area->Top()  <= node->maxy;
+}
+
+static inline bool NodeContainedBy(SpatialNode* node, Rect* area) {
+    return area->Left()  <= node->minx && area->Top()    <= node->miny &&
+           area->Right() >= node->maxx && area->Bottom() >= node->maxy;
+}
+
+// Sets the bound and height of node from its two children
+static inline void SetNodeUnion(SpatialNode* node, SpatialNode* left, SpatialNode* right) {
+    node->minx   = std::min<float>(left->minx, right->minx);
+    node->miny   = std::min<float>(left->miny, right->miny);
+    node->maxx   = std::max<float>(left->maxx, right->maxx);
+    node->maxy   = std::max<float>(left->maxy, right->maxy);
+    node->height = 1 + std::max<size_t>(left->height, right->height);
+}
+
+static inline void SetNodeBound(SpatialNode* node, Rect bound) {
+    node->minx = bound.Left();
+    node->miny = bound.Top();
+    node->maxx = bound.Right();
+    node->maxy = bound.Bottom();
+}
+
+SpatialIndex::SpatialIndex(size_t estimated_items) :
+    // A binary tree with n leaves has n - 1 internal nodes
+    nodes(DynamicArray<SpatialNode>(estimated_items * 2)),
+    free_nodes(DynamicArray<size_t>(10)),
+    root(kNullNode),
+    built(false) {};
+
+void SpatialIndex::Free() {
+    this->nodes.Free();
+    this->free_nodes.Free();
+}
+
+size_t SpatialIndex::AllocNode() {
+    size_t node;
+    if (this->free_nodes.Length()) {
+        node = this->free_nodes.Last();
+        this->free_nodes.RemoveIndex(this->free_nodes.Length() - 1);
+    } else {
+        node = this->nodes.Length();
+        this->nodes.Push(SpatialNode {});
+    }
+
+    SpatialNode* n = &this->nodes[node];
+    n->parent = kNullNode;
+    n->left   = kNullNode;
+    n->right  = kNullNode;
+    n->item   = kNullNode;
+    n->height = 0;
+
+    return node;
+}
+
+void SpatialIndex::FreeNode(size_t node) {
+    this->free_nodes.Push(node);
+}
+
+// Recomputes the bounds of node and every one of its ancestors from their children, balancing each one on the way
+void SpatialIndex::Refit(size_t node) {
+    while (node != kNullNode) {
+        SpatialNode* n = &this->nodes[node];
+        SetNodeUnion(n, &this->nodes[n->left], &this->nodes[n->right]);
+
+        node = this->nodes[this->Balance(node)].parent;
+    }
+}
+
+// Same rotation as b2DynamicTree::Balance. When one child of node is more than a level taller than the other, the
+// taller child takes node's place and node takes the shorter of the taller child's children. Returns the node that's
+// now where node was
+size_t SpatialIndex::Balance(size_t node) {
+    SpatialNode* a = &this->nodes[node];
+    if (a->IsLeaf() || a->height < 2) return node;
+
+    size_t b_id = a->left;
+    size_t c_id = a->right;
+    SpatialNode* b = &this->nodes[b_id];
+    SpatialNode* c = &this->nodes[c_id];
+
+    // Rotating is the same either way round, with taller the child that moves up and shorter the one that stays
+    size_t taller_id, shorter_id;
+    if (c->height > b->height + 1) {
+        taller_id  = c_id;
+        shorter_id = b_id;
+    } else if (b->height > c->height + 1) {
+        taller_id  = b_id;
+        shorter_id = c_id;
+    } else {
+        return node;
+    }
+
+    SpatialNode* taller  = &this->nodes[taller_id];
+    SpatialNode* shorter = &this->nodes[shorter_id];
+    size_t f_id = taller->left;
+    size_t g_id = taller->right;
+
+    // The taller child replaces node under node's parent
+    taller->left   = node;
+    taller->parent = a->parent;
+    a->parent      = taller_id;
+
+    if (taller->parent == kNullNode) {
+        this->root = taller_id;
+    } else if (this->nodes[taller->parent].left == node) {
+        this->nodes[taller->parent].left = taller_id;
+    } else {
+        this->nodes[taller->parent].right = taller_id;
+    }
+
+    // Node keeps the shorter grandchild and the taller one stays with the node that moved up
+    size_t keep_id  = this->nodes[f_id].height > this->nodes[g_id].height ? f_id : g_id;
+    size_t moved_id = keep_id == f_id ? g_id : f_id;
+
+    taller->right = keep_id;
+    a->left       = shorter_id;
+    a->right      = moved_id;
+    this->nodes[moved_id].parent = node;
+
+    SetNodeUnion(a, shorter, &this->nodes[moved_id]);
+    SetNodeUnion(taller, a, &this->nodes[keep_id]);
+
+    return taller_id;
+}
+
+void SpatialIndex::Build(BoundsStore* bounds, DynamicArray<size_t>* leaves) {
+    this->nodes.Clear();
+    this->free_nodes.Clear();
+    this->root  = kNullNode;
+    this->built = true;
+
+    size_t count = bounds->Length();
+    leaves->Clear();
+    if (!count) return;
+
+    auto order = DynamicArray<size_t>(count);
+    for (size_t i=0; i<count; i++) {
+        order.Push(i);
+    }
+
+    float* minx = bounds->minx.Data();
+    float* miny = bounds->miny.Data();
+    float* maxx = bounds->maxx.Data();
+    float* maxy = bounds->maxy.Data();
+
+    // STR: sort everything by center x, cut the result into vertical slabs of roughly sqrt(tiles) tiles
+    // each and then sort every slab by center y. Leaves that end up next to each other are close together.
+    std::sort(order.Data(), order.End(), [&](size_t a, size_t b) {
+        return (minx[a] + maxx[a]) < (minx[b] + maxx[b]);
+    });
+
+    size_t tiles      = (count + kStrTileSize - 1) / kStrTileSize;
+    size_t slabs      = (size_t)ceil(sqrt((double)tiles));
+    size_t slab_items = ((tiles + slabs - 1) / slabs) * kStrTileSize;
+
+    for (size_t start=0; start<count; start+=slab_items) {
+        size_t* slab_start = order.Data() + start;
+        size_t* slab_end   = order.Data() + std::min<size_t>(start + slab_items, count);
+        std::sort(slab_start, slab_end, [&](size_t a, size_t b) {
+            return (miny[a] + maxy[a]) < (miny[b] + maxy[b]);
+        });
+    }
+
+    // leaves is indexed by item so fill it out before creating the leaves in STR order
+    for (size_t i=0; i<count; i++) {
+        leaves->Push(kNullNode);
+    }
+
+    auto level = DynamicArray<size_t>(count);
+    for (auto& item : order) {
+        size_t leaf   = this->AllocNode();
+        SpatialNode* n = &this->nodes[leaf];
+        n->item = item;
+        n->minx = minx[item];
+        n->miny = miny[item];
+        n->maxx = maxx[item];
+        n->maxy = maxy[item];
+
+        leaves->Put(leaf, item);
+        level.Push(leaf);
+    }
+
+    // Pair up neighbouring nodes one level at a time until only the root is left. An odd node at the end
+    // of a level gets carried up to the next one as is.
+    auto next_level = DynamicArray<size_t>(count / 2 + 1);
+    while (level.Length() > 1) {
+        next_level.Clear();
+
+        for (size_t i=0; i+1<level.Length(); i+=2) {
+            size_t parent = this->AllocNode();
+            SpatialNode* p = &this->nodes[parent];
+            p->left  = level[i];
+            p->right = level[i + 1];
+
+            this->nodes[level[i]].parent     = parent;
+            this->nodes[level[i + 1]].parent = parent;
+
+            SetNodeUnion(p, &this->nodes[p->left], &this->nodes[p->right]);
+
+            next_level.Push(parent);
+        }
+
+        if (level.Length() % 2) {
+            next_level.Push(level.Last());
+        }
+
+        DynamicArray<size_t> swap = level;
+        level      = next_level;
+        next_level = swap;
+    }
+
+    this->root = level[0];
+
+    order.Free();
+    level.Free();
+    next_level.Free();
+}
+
+size_t SpatialIndex::Insert(size_t item, Rect bound) {
+    size_t leaf = this->AllocNode();
+    SpatialNode* n = &this->nodes[leaf];
+    n->item = item;
+    SetNodeBound(n, bound);
+
+    this->InsertLeaf(leaf);
+    return leaf;
+}
+
+// Finds the best sibling for the leaf by walking down from the root and following whichever child grows
+// the least by adding the leaf. This is the same cost function Box2D uses for its dynamic tree.
+void SpatialIndex::InsertLeaf(size_t leaf) {
+    if (this->root == kNullNode) {
+        this->root = leaf;
+        this->nodes[leaf].parent = kNullNode;
+        return;
+    }
+
+    SpatialNode* leaf_node = &this->nodes[leaf];
+
+    size_t sibling = this->root;
+    while (!this->nodes[sibling].IsLeaf()) {
+        SpatialNode* node = &this->nodes[sibling];
+
+        float perimeter = Perimeter(node->minx, node->miny, node->maxx, node->maxy);
+        float combined  = UnionPerimeter(node, leaf_node);
+
+        // Cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combined;
+
+        // Minimum cost of pushing the leaf further down the tree
+        float inheritance = 2.0f * (combined - perimeter);
+
+        SpatialNode* left  = &this->nodes[node->left];
+        SpatialNode* right = &this->nodes[node->right];
+
+        float left_cost = UnionPerimeter(left, leaf_node) + inheritance;
+        if (!left->IsLeaf()) {
+            left_cost -= Perimeter(left->minx, left->miny, left->maxx, left->maxy);
+        }
+
+        float right_cost = UnionPerimeter(right, leaf_node) + inheritance;
+        if (!right->IsLeaf()) {
+            right_cost -= Perimeter(right->minx, right->miny, right->maxx, right->maxy);
+        }
+
+        if (cost < left_cost && cost < right_cost) break;
+
+        sibling = left_cost < right_cost ? node->left : node->right;
+    }
+
+    size_t old_parent = this->nodes[sibling].parent;
+    size_t new_parent = this->AllocNode();
+
+    SpatialNode* parent = &this->nodes[new_parent];
+    parent->parent = old_parent;
+    parent->left   = sibling;
+    parent->right  = leaf;
+
+    this->nodes[sibling].parent = new_parent;
+    this->nodes[leaf].parent    = new_parent;
+
+    if (old_parent == kNullNode) {
+        this->root = new_parent;
+    } else if (this->nodes[old_parent].left == sibling) {
+        this->nodes[old_parent].left = new_parent;
+    } else {
+        this->nodes[old_parent].right = new_parent;
+    }
+
+    this->Refit(new_parent);
+}
+
+// Unlinks the leaf from the tree without freeing it. The leaf's parent is replaced by the leaf's sibling.
+void SpatialIndex::DetachLeaf(size_t leaf) {
+    if (leaf == this->root) {
+        this->root = kNullNode;
+        return;
+    }
+
+    size_t parent      = this->nodes[leaf].parent;
+    size_t grandparent = this->nodes[parent].parent;
+    size_t sibling     = this->nodes[parent].left == leaf ? this->nodes[parent].right : this->nodes[parent].left;
+
+    if (grandparent == kNullNode) {
+        this->root = sibling;
+        this->nodes[sibling].parent = kNullNode;
+    } else {
+        if (this->nodes[grandparent].left == parent) {
+            this->nodes[grandparent].left = sibling;
+        } else {
+            this->nodes[grandparent].right = sibling;
+        }
+
+        this->nodes[sibling].parent = grandparent;
+        this->Refit(grandparent);
+    }
+
+    this->FreeNode(parent);
+    this->nodes[leaf].parent = kNullNode;
+}
+
+void SpatialIndex::Remove(size_t leaf) {
+    this->DetachLeaf(leaf);
+    this->FreeNode(leaf);
+}
+
+void SpatialIndex::Update(size_t leaf, Rect bound) {
+    SpatialNode* n = &this->nodes[leaf];
+    SetNodeBound(n, bound);
+
+    // If the new bound still fits inside of the parent the leaf is most likely still in a good spot so only
+    // the ancestors need to shrink. Otherwise the leaf gets moved to wherever it fits best now.
+    size_t parent = n->parent;
+    if (parent == kNullNode) return;
+
+    SpatialNode* p = &this->nodes[parent];
+    if (p->minx <= n->minx && p->miny <= n->miny && p->maxx >= n->maxx && p->maxy >= n->maxy) {
+        this->Refit(parent);
+        return;
+    }
+
+    this->DetachLeaf(leaf);
+    this->InsertLeaf(leaf);
+}
+
+void SpatialIndex::SetItem(size_t leaf, size_t item) {
+    this->nodes[leaf].item = item;
+}
+
+void SpatialIndex::QueryIntersecting(Rect area, DynamicArray<size_t>* out) {
+    if (this->root == kNullNode) return;
+
+    auto stack = DynamicArray<size_t>(64);
+    stack.Push(this->root);
+
+    while (stack.Length()) {
+        SpatialNode* node = &this->nodes[stack.Last()];
+        stack.RemoveIndex(stack.Length() - 1);
+
+        if (!NodeIntersects(node, &area)) continue;
+
+        if (node->IsLeaf()) {
+            out->Push(node->item);
+        } else {
+            stack.Push(node->left);
+            stack.Push(node->right);
+        }
+    }
+
+    stack.Free();
+}
+
+void SpatialIndex::QueryContainedBy(Rect area, DynamicArray<size_t>* out) {
+    if (this->root == kNullNode) return;
+
+    auto stack = DynamicArray<size_t>(64);
+    stack.Push(this->root);
+
+    while (stack.Length()) {
+        SpatialNode* node = &this->nodes[stack.Last()];
+        stack.RemoveIndex(stack.Length() - 1);
+
+        if (!NodeIntersects(node, &area)) continue;
+
+        if (node->IsLeaf()) {
+            if (NodeContainedBy(node, &area)) {
+                out->Push(node->item);
+            }
+        } else {
+            stack.Push(node->left);
+            stack.Push(node->right);
+        }
+    }
+
+    stack.Free();
+}
+
+void SpatialIndex::QueryPoint(Vec2 point, float tolerance, DynamicArray<size_t>* out) {
+    Rect area = Rect::FromEdges(point.x - tolerance, point.y - tolerance, point.x + tolerance, point.y + tolerance);
+    this->QueryIntersecting(area, out);
+}
+
+SpatialIndex SpatialIndex::Clone() {
+    return SpatialIndex(
+        this->nodes.Clone(),
+        this->free_nodes.Clone(),
+        this->root,
+        this->built
+    );
+}
@@ -1,17 +1,24 @@
+#include <algorithm>
+#include <stdio.h>
+
 #include "pugixml.hpp"
 
+#include "batch.hpp"
 #include "svg.hpp"
 #include "sviggy.hpp"
 
 #include "ds.hpp"
+#include "trace.hpp"
 
 #define TAGCMP(node, type) strcmp(node->name(), type) == 0
 
-void LoadSVGFile(char *file, Document *doc, DXState *dx) {
-    pugi::xml_document xml;
-    pugi::xml_parse_result result = xml.load_file(file);
+static bool LoadSVGTree(pugi::xml_document *xml, char *file, Document *doc, DXState *dx) {
+    pugi::xml_node svg_tree = xml->child("svg");
+    if (!svg_tree || !*svg_tree.attribute("width").value() || !*svg_tree.attribute("height").value() || !*svg_tree.attribute("viewBox").value()) {
+        printf("Couldn't load %s: expected an svg element with a width, height and viewBox\n", file);
+        return false;
+    }
 
-    pugi::xml_node svg_tree = xml.child("svg");
     ViewPort viewport = ViewPort(&svg_tree);
 
     // TODO: make sure that this node actually exists
@@ -25,11 +32,59 @@ void LoadSVGFile(char *file, Document *doc, DXState *dx) {
     pugi::xml_object_range<pugi::xml_node_iterator> nodes = svg_tree.children();
 
     AddNodesToDocument(&viewport, nodes, doc, dx);
-    doc->paths.RealizeAllGeometry(dx);
+    doc->paths.BuildSpatialIndex();
+
+    return true;
+}
+
+bool LoadSVGFile(char *file, Document *doc, DXState *dx) {
+    TRACE_FUNCTION();
+
+    pugi::xml_document xml;
+    pugi::xml_parse_result result = xml.load_file(file);
+    if (!result) {
+        printf("Couldn't load %s: %s\n", file, result.description());
+        return false;
+    }
+
+    return LoadSVGTree(&xml, file, doc, dx);
+}
+
+bool LoadSVGBuffer(char *data, size_t length, char *name, Document *doc, DXState *dx) {
+    TRACE_FUNCTION();
+
+    pugi::xml_document xml;
+    pugi::xml_parse_result result = xml.load_buffer(data, length);
+    if (!result) {
+        printf("Couldn't load %s: %s\n", name, result.description());
+        return false;
+    }
+
+    return LoadSVGTree(&xml, name, doc, dx);
+}
+
+// Every class on the node becomes a tag on the path so filters can pick shapes out by their style
+void AssignClassTags(pugi::xml_node_iterator node, Document *doc, PathId id) {
+    char *iter = (char *)node->attribute("class").value();
+
+    while (*iter) {
+        while (IsWhitespace(*iter)) iter++;
+        if (!*iter) break;
+
+        String tag = String();
+        while (*iter && !IsWhitespace(*iter)) {
+            tag.strex.chars.Push(*iter, &global_allocator);
+            iter++;
+        }
+
+        doc->AssignTag(id, tag);
+    }
 }
 
 // TODO: just let this accept a node and go through its children
 void AddNodesToDocument(ViewPort *viewport, pugi::xml_object_range<pugi::xml_node_iterator> nodes, Document *doc, DXState *dx) {
+    TRACE_FUNCTION();
+
     for (pugi::xml_node_iterator node : nodes) {
 
         if (TAGCMP(node, "g")) {
@@ -38,39 +93,43 @@ void AddNodesToDocument(ViewPort *viewport, pugi::xml_object_range<pugi::xml_nod
         }
 
         if (TAGCMP(node, "rect")) {
-            doc->AddNewPath(ParseTagRect(node, viewport, dx));
+            AssignClassTags(node, doc, doc->AddNewPath(ParseTagRect(node, viewport, dx)));
             continue;
         }
 
+        #ifndef SVIGGY_HEADLESS
         if (TAGCMP(node, "text")) {
             Text text = ParseTagText(node, viewport, dx);
             doc->texts.Push(text);
             continue;
         }
+        #endif
 
         if (TAGCMP(node, "line")) {
-            doc->AddNewPath(ParseTagLine(node, viewport, dx));
+            AssignClassTags(node, doc, doc->AddNewPath(ParseTagLine(node, viewport, dx)));
             continue;
         }
 
         if (TAGCMP(node, "polygon")) {
-            doc->AddNewPath(ParseTagPolygon(node, viewport, dx));
+            AssignClassTags(node, doc, doc->AddNewPath(ParseTagPolygon(node, viewport, dx)));
             continue;
         }
 
         if (TAGCMP(node, "circle")) {
-            doc->AddNewPath(ParseTagCircle(node, viewport, dx));
+            AssignClassTags(node, doc, doc->AddNewPath(ParseTagCircle(node, viewport, dx)));
             continue;
         }
 
         if (TAGCMP(node, "path")) {
-            doc->AddNewPath(ParseTagPath(node, viewport, dx));
+            AssignClassTags(node, doc, doc->AddNewPath(ParseTagPath(node, viewport, dx)));
             continue;
         }
     }
 }
 
 ShapeData ParseTagRect(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     float x = RoundFloatingInput(node->attribute("x"     ).as_float() / viewport->uupix);
     float y = RoundFloatingInput(node->attribute("y"     ).as_float() / viewport->uupiy);
     float w = RoundFloatingInput(node->attribute("width" ).as_float() / viewport->uupix);
@@ -79,14 +138,20 @@ ShapeData ParseTagRect(pugi::xml_node_iterator node, ViewPort *viewport, DXState
     return PathBuilder::CreateRect(Vec2(x, y), Vec2(w, h), dx);
 }
 
+#ifndef SVIGGY_HEADLESS
 Text ParseTagText(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     float x = RoundFloatingInput(node->attribute("x").as_float() / viewport->uupix);
     float y = RoundFloatingInput(node->attribute("y").as_float() / viewport->uupiy);
 
     return Text(Vec2(x, y), String((char *)node->text().get()), dx);
 }
+#endif
 
 ShapeData ParseTagLine(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     float x1 = RoundFloatingInput(node->attribute("x1").as_float() / viewport->uupix);
     float y1 = RoundFloatingInput(node->attribute("y1").as_float() / viewport->uupiy);
     float x2 = RoundFloatingInput(node->attribute("x2").as_float() / viewport->uupix);
@@ -96,6 +161,8 @@ ShapeData ParseTagLine(pugi::xml_node_iterator node, ViewPort *viewport, DXState
 }
 
 ShapeData ParseTagPolygon(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     PathBuilder builder = PathBuilder(dx);
     char *iter = (char *)node->attribute("points").value();
 
@@ -115,6 +182,8 @@ ShapeData ParseTagPolygon(pugi::xml_node_iterator node, ViewPort *viewport, DXSt
 }
 
 ShapeData ParseTagPath(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     PathBuilder builder = PathBuilder(dx);
 
     char *path = (char *) node->attribute("d").value();
@@ -166,6 +235,8 @@ ShapeData ParseTagPath(pugi::xml_node_iterator node, ViewPort *viewport, DXState
 }
 
 ShapeData ParseTagCircle(pugi::xml_node_iterator node, ViewPort *viewport, DXState *dx) {
+    TRACE_FUNCTION();
+
     float x = RoundFloatingInput(node->attribute("cx").as_float() / viewport->uupix);
     float y = RoundFloatingInput(node->attribute("cy").as_float() / viewport->uupiy);
     float r = RoundFloatingInput(node->attribute("r" ).as_float() / viewport->uupix);
@@ -298,4 +369,150 @@ ViewPort::ViewPort(pugi::xml_node *node) {
 
     this->uupix = width_user_units / width_inches;
     this->uupiy = height_user_units / height_inches;
+}
+
+static void AppendChars(String *out, char *chars) {
+    while (*chars) {
+        out->strex.chars.Push(*chars, &global_allocator);
+        chars++;
+    }
+}
+
+static void AppendFloats(String *out, float *values, size_t count) {
+    char buf[32];
+    for (auto i=0; i<count; i++) {
+        snprintf(buf, sizeof(buf), " %.7g", values[i]);
+        AppendChars(out, buf);
+    }
+}
+
+// Turns the recorded commands back into path data. Arcs are always recorded as the large arc, see path.hpp
+String PathData(DynamicArray<float> *commands) {
+    String d = String();
+    float *at  = commands->Data();
+    float *end = commands->End();
+
+    while (at < end) {
+        float command = *at++;
+
+        if (command == kPathCommandMove) {
+            AppendChars(&d, (char *)"M");
+            AppendFloats(&d, at, 2);
+            at += 2;
+        } else if (command == kPathCommandLine) {
+            AppendChars(&d, (char *)"L");
+            AppendFloats(&d, at, 2);
+            at += 2;
+        } else if (command == kPathCommandCubic) {
+            AppendChars(&d, (char *)"C");
+            AppendFloats(&d, at, 6);
+            at += 6;
+        } else if (command == kPathCommandArc) {
+            // Recorded as x y rx ry rotation direction, svg wants rx ry rotation large-arc sweep x y
+            float arc[7] = { at[2], at[3], at[4], 1.0f, at[5] == kClockwise ? 1.0f : 0.0f, at[0], at[1] };
+            AppendChars(&d, (char *)"A");
+            AppendFloats(&d, arc, 7);
+            at += 6;
+        } else if (command == kPathCommandClose) {
+            AppendChars(&d, (char *)"Z");
+        }
+    }
+
+    return d;
+}
+
+// Starts an svg of size inches with the view box in document units. Returns the group the paths go in
+static pugi::xml_node AppendSVGSheet(pugi::xml_document *xml, Vec2 size) {
+    pugi::xml_node svg = xml->append_child("svg");
+
+    char buf[128];
+    svg.append_attribute("xmlns") = "http://www.w3.org/2000/svg";
+
+    snprintf(buf, sizeof(buf), "%.7gin", size.x);
+    svg.append_attribute("width") = buf;
+
+    snprintf(buf, sizeof(buf), "%.7gin", size.y);
+    svg.append_attribute("height") = buf;
+
+    snprintf(buf, sizeof(buf), "0 0 %.7g %.7g", size.x, size.y);
+    svg.append_attribute("viewBox") = buf;
+
+    pugi::xml_node group = svg.append_child("g");
+    group.append_attribute("fill") = "none";
+    group.append_attribute("stroke") = "black";
+    group.append_attribute("stroke-width") = kHairline;
+
+    return group;
+}
+
+static void AppendSVGPath(pugi::xml_node parent, DynamicArray<float> *commands, Mat3x2 m) {
+    pugi::xml_node path = parent.append_child("path");
+
+    String d = PathData(commands);
+    path.append_attribute("d") = d.CStr();
+    d.Free();
+
+    if (m.m11 != 1.0f || m.m12 != 0.0f || m.m21 != 0.0f || m.m22 != 1.0f || m.dx != 0.0f || m.dy != 0.0f) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "matrix(%.7g %.7g %.7g %.7g %.7g %.7g)", m.m11, m.m12, m.m21, m.m22, m.dx, m.dy);
+        path.append_attribute("transform") = buf;
+    }
+}
+
+static bool SaveSVG(pugi::xml_document *xml, char *file) {
+    if (!xml->save_file(file)) {
+        printf("Couldn't write %s\n", file);
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteSVGFile(char *file, Paths *paths) {
+    pugi::xml_document xml;
+
+    // Everything is written out in document units, which are inches, so the viewBox lines up with the size
+    Rect area = Rect(Vec2(0.0f, 0.0f), Vec2(0.0f, 0.0f));
+    if (paths->Length()) {
+        paths->UpdateBounds();
+        area = UnionBoundsRange(&paths->bounds, 0, paths->Length());
+    }
+
+    pugi::xml_node group = AppendSVGSheet(&xml, Vec2(std::max<float>(area.Right(), 0.0f), std::max<float>(area.Bottom(), 0.0f)));
+    for (auto i=0; i<paths->Length(); i++) {
+        AppendSVGPath(group, &paths->shapes[i].commands, paths->transforms.Get(i));
+    }
+
+    return SaveSVG(&xml, file);
+}
+
+bool WriteSVGSheet(char *file, BatchLayout *batch, size_t sheet, Paths **documents, char **names) {
+    pugi::xml_document xml;
+
+    Vec2 offset = batch->sheet_offsets[sheet];
+    pugi::xml_node group = AppendSVGSheet(&xml, batch->sheets[sheet]);
+
+    char buf[32];
+    for (size_t i=batch->sheet_starts[sheet]; i<batch->sheet_starts[sheet + 1]; i++) {
+        BatchPlacement *placement = &batch->placements[i];
+        Paths *paths = documents[placement->document];
+
+        pugi::xml_node collection = group.append_child("g");
+        collection.append_attribute("data-document") = names[placement->document];
+
+        snprintf(buf, sizeof(buf), "%zu", placement->collection);
+        collection.append_attribute("data-collection") = buf;
+
+        // The batch moved the shapes to where the sheet is in the document, so the sheet's offset comes back off
+        for (auto &id : paths->collections.reverse_collections_index[placement->collection]) {
+            size_t index = paths->index[id];
+
+            Mat3x2 m = paths->transforms.Get(index);
+            m.dx -= offset.x;
+            m.dy -= offset.y;
+            AppendSVGPath(collection, &paths->shapes[index].commands, m);
+        }
+    }
+
+    return SaveSVG(&xml, file);
 }
\ No newline at end of file
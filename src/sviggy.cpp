@@ -18,9 +18,11 @@
 #include "imgui_impl_win32.h"
 #include "pugixml.hpp"
 
+#include "batch.hpp"
 #include "pipeline.hpp"
 #include "svg.hpp"
 #include "sviggy.hpp"
+#include "trace.hpp"
 
 DXState dxstate;
 Application app;
@@ -256,33 +258,48 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                             app.documents.Push(Document(100));
                         }
 
-                        PipelineActions p;
-
-                        size_t memory_estimation = app.ActiveDoc()->paths.Length() * 100;
+                        Document *doc = app.ActiveDoc();
+                        size_t memory_estimation = doc->paths.Length() * 100;
                         LinearAllocatorPool allocator = LinearAllocatorPool(memory_estimation);
 
-                        // Right now these are strings because we can't compare a String to a StringEx currently but hopefully
-                        // we come up with something better in the future
-                        String bound_tag = String((char*) "Bound");
-                        String text_tag  = String((char*) "Text");
+                        if (!doc->pipeline) {
+                            PipelineActions *pipeline = new PipelineActions();
+
+                            FilterProgram filter;
+                            if (CompileFilter((char*) "Bound or Text", &pipeline->allocator, &filter)) {
+                                pipeline->Push(PipelineAction::Filter(filter));
+                            }
+
+                            auto bins = DynamicArrayEx<Vec2Many, LinearAllocatorPool>();
+                            bins.Push(Vec2Many(Vec2(48, 24), kInfinity), &pipeline->allocator);
 
-                        TagId bound_id = app.ActiveDoc()->tag_god.GetTagId(bound_tag);
-                        TagId text_id  = app.ActiveDoc()->tag_god.GetTagId(text_tag);
+                            pipeline->Push(PipelineAction::Layout(bins));
+                            doc->pipeline = pipeline;
+                        }
+
+                        doc->pipeline->Run(doc, &allocator);
 
-                        bound_tag.Free();
-                        text_tag.Free();
+                        allocator.FreeAllocator();
+                        break;
+                    }
 
-                        DynamicArrayEx<TagId, LinearAllocatorPool> filter_tags;
-                        filter_tags.Push(bound_id, &allocator);
-                        filter_tags.Push(text_id, &allocator);
-                        p.actions.Push(PipelineAction::Filter(filter_tags), &allocator);
+                    case 'B': {
+                        size_t memory_estimation = 0;
+                        for (auto &doc : app.documents) {
+                            memory_estimation += doc.paths.Length() * 100;
+                        }
+                        LinearAllocatorPool allocator = LinearAllocatorPool(std::max<size_t>(4096, memory_estimation));
 
                         auto bins = DynamicArrayEx<Vec2Many, LinearAllocatorPool>();
                         bins.Push(Vec2Many(Vec2(48, 24), kInfinity), &allocator);
 
-                        p.actions.Push(PipelineAction::Layout(bins), &allocator);
+                        PipelineLayout layout = { bins, 0.0f };
+                        app.LayoutDocuments(&layout, NULL, &allocator);
 
-                        p.Run(app.ActiveDoc(), &dxstate, &allocator);
+                        // Every document's pipeline shapes were replaced so the next pipeline run has to show its own again
+                        for (auto &doc : app.documents) {
+                            if (doc.pipeline) doc.pipeline->shown_key = 0;
+                        }
 
                         allocator.FreeAllocator();
                         break;
@@ -296,6 +313,10 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                         app.ActiveDoc()->AutoCollect();
                         break;
 
+                    case 'T':
+                        WriteTraceFile((char *)"sviggy-trace.json");
+                        break;
+
                     default:
                         if (wParam >= '0' && wParam <= '9') {
                             app.ActivateDoc(wParam - '0');
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+
+#include "ds.hpp"
+#include "files.hpp"
+#include "trace.hpp"
+
+// Every buffer ever made, plus the ones whose thread exited and can be handed out again. Only touched when a
+// thread records its first zone, when it exits and when the trace is written
+static std::mutex                 trace_lock;
+static DynamicArray<TraceBuffer*> *trace_buffers;
+static DynamicArray<TraceBuffer*> *trace_free_buffers;
+
+static std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+
+uint64_t TraceNow() {
+    auto elapsed = std::chrono::steady_clock::now() - trace_epoch;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void TraceBuffer::Push(const char *name, uint64_t start, uint64_t duration) {
+    uint64_t head = this->head.load(std::memory_order_relaxed);
+
+    TraceEvent *event = &this->events[head % kTraceBufferEvents];
+    event->name     = name;
+    event->start    = start;
+    event->duration = duration;
+
+    this->head.store(head + 1, std::memory_order_release);
+}
+
+// Owns the current thread's buffer and gives it back when the thread exits
+class TraceThread {
+    public:
+    TraceBuffer *buffer;
+
+    TraceThread() {
+        std::lock_guard<std::mutex> guard(trace_lock);
+
+        if (!trace_buffers) {
+            trace_buffers      = new DynamicArray<TraceBuffer*>(16);
+            trace_free_buffers = new DynamicArray<TraceBuffer*>(16);
+        }
+
+        if (trace_free_buffers->Length()) {
+            this->buffer = *trace_free_buffers->LastPtr();
+            trace_free_buffers->RemoveIndex(trace_free_buffers->Length() - 1);
+        } else {
+            this->buffer = new TraceBuffer(trace_buffers->Length() + 1);
+            trace_buffers->Push(this->buffer);
+        }
+    }
+
+    ~TraceThread() {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        trace_free_buffers->Push(this->buffer);
+    }
+};
+
+TraceBuffer* ThreadTraceBuffer() {
+    thread_local TraceThread thread;
+    return thread.buffer;
+}
+
+bool WriteTraceFile(char *file) {
+    FILE *f = fopen(file, "wb");
+    if (!f) {
+        printf("Couldn't write the trace to %s\n", file);
+        return false;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+
+    size_t written = 0;
+    TraceEvent *copy = global_allocator.Alloc<TraceEvent>(kTraceBufferEvents);
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    size_t buffers = trace_buffers ? trace_buffers->Length() : 0;
+
+    for (size_t i=0; i<buffers; i++) {
+        TraceBuffer *buffer = (*trace_buffers)[i];
+
+        // Copy first and check afterwards which of the copied events the owner could have overwritten meanwhile
+        uint64_t head  = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > kTraceBufferEvents ? head - kTraceBufferEvents : 0;
+        for (uint64_t at=first; at<head; at++) {
+            copy[at - first] = buffer->events[at % kTraceBufferEvents];
+        }
+
+        // The fence keeps the copy from moving past the second load. The owner may be halfway through writing the
+        // slot after head_after - 1, which is the oldest one, so that one is dropped too
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t head_after = buffer->head.load(std::memory_order_relaxed);
+        uint64_t valid      = head_after >= kTraceBufferEvents ? head_after - kTraceBufferEvents + 1 : 0;
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"Thread %zu\"}}", written ? ",\n" : "", buffer->id, buffer->id);
+        written++;
+
+        for (uint64_t at=std::max(first, valid); at<head; at++) {
+            TraceEvent *event = &copy[at - first];
+
+            fprintf(f, ",\n{\"name\":");
+            WriteJsonString(f, event->name);
+            fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}", buffer->id, event->start / 1000.0, event->duration / 1000.0);
+            written++;
+        }
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    global_allocator.Free(copy);
+
+    printf("Wrote %zu trace events from %zu threads to %s\n", written - buffers, buffers, file);
+    return true;
+}
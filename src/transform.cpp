@@ -0,0 +1,213 @@
+#include <math.h>
+
+#include "ds.hpp"
+#include "geometry.hpp"
+#include "lanes.hpp"
+#include "transform.hpp"
+
+Transformation::Transformation() : translation(Vec2(0.0f, 0.0f)), scale(Vec2(1.0, 1.0)), rotation(0.0f) {};
+
+Mat3x2 Transformation::Matrix(Vec2 center) {
+    return Mat3x2::Scale(this->scale, center) * Mat3x2::Rotation(this->rotation, center) * Mat3x2::Translation(this->translation);
+}
+
+Transformation Transformation::FromMatrix(Mat3x2 matrix, Vec2 center) {
+    Transformation transform = Transformation();
+
+    // The linear part is the scale times the rotation, so the first row is scale.x * (cos, sin) and the
+    // second is scale.y * (-sin, cos)
+    float radians = atan2f(matrix.m12, matrix.m11);
+    float c = cosf(radians);
+    float s = sinf(radians);
+
+    transform.scale    = Vec2(sqrtf(matrix.m11 * matrix.m11 + matrix.m12 * matrix.m12), matrix.m22 * c - matrix.m21 * s);
+    transform.rotation = radians * 180.0f / 3.14159265358979323846f;
+    if (transform.rotation < 0.0f) transform.rotation += 360.0f;
+
+    // Scaling and rotating around the center moves the origin by center - center * linear part. Whatever
+    // translation is left over is the translation parameter
+    Vec2 around_center = Vec2(
+        center.x - (center.x * matrix.m11 + center.y * matrix.m21),
+        center.y - (center.x * matrix.m12 + center.y * matrix.m22)
+    );
+    transform.translation = Vec2(matrix.dx - around_center.x, matrix.dy - around_center.y);
+
+    return transform;
+}
+
+MatrixStore::MatrixStore(size_t capacity) :
+    m11(DynamicArray<float>(capacity)),
+    m12(DynamicArray<float>(capacity)),
+    m21(DynamicArray<float>(capacity)),
+    m22(DynamicArray<float>(capacity)),
+    dx(DynamicArray<float>(capacity)),
+    dy(DynamicArray<float>(capacity)) {};
+
+void MatrixStore::Free() {
+    this->m11.Free();
+    this->m12.Free();
+    this->m21.Free();
+    this->m22.Free();
+    this->dx.Free();
+    this->dy.Free();
+}
+
+void MatrixStore::Push(Mat3x2 matrix) {
+    this->m11.Push(matrix.m11);
+    this->m12.Push(matrix.m12);
+    this->m21.Push(matrix.m21);
+    this->m22.Push(matrix.m22);
+    this->dx.Push(matrix.dx);
+    this->dy.Push(matrix.dy);
+}
+
+void MatrixStore::Put(Mat3x2 matrix, size_t index) {
+    this->m11.Put(matrix.m11, index);
+    this->m12.Put(matrix.m12, index);
+    this->m21.Put(matrix.m21, index);
+    this->m22.Put(matrix.m22, index);
+    this->dx.Put(matrix.dx, index);
+    this->dy.Put(matrix.dy, index);
+}
+
+Mat3x2 MatrixStore::Get(size_t index) {
+    return Mat3x2(this->m11[index], this->m12[index], this->m21[index], this->m22[index], this->dx[index], this->dy[index]);
+}
+
+void MatrixStore::RemoveIndex(size_t index) {
+    this->m11.RemoveIndex(index);
+    this->m12.RemoveIndex(index);
+    this->m21.RemoveIndex(index);
+    this->m22.RemoveIndex(index);
+    this->dx.RemoveIndex(index);
+    this->dy.RemoveIndex(index);
+}
+
+size_t MatrixStore::Length() {
+    // All of the columns are the same length so arbitrarily pick one of them
+    return this->m11.Length();
+}
+
+void MatrixStore::Clear() {
+    this->m11.Clear();
+    this->m12.Clear();
+    this->m21.Clear();
+    this->m22.Clear();
+    this->dx.Clear();
+    this->dy.Clear();
+}
+
+void MatrixStore::Resize(size_t length) {
+    this->m11.Resize(length);
+    this->m12.Resize(length);
+    this->m21.Resize(length);
+    this->m22.Resize(length);
+    this->dx.Resize(length);
+    this->dy.Resize(length);
+}
+
+MatrixStore MatrixStore::Clone() {
+    return MatrixStore(
+        this->m11.Clone(),
+        this->m12.Clone(),
+        this->m21.Clone(),
+        this->m22.Clone(),
+        this->dx.Clone(),
+        this->dy.Clone()
+    );
+}
+
+#ifdef LANES_SIMD
+// Composes matrix onto kLanes matrices whose columns start at the given pointers, in place
+static inline void ComposeLanes(float *m11, float *m12, float *m21, float *m22, float *dx, float *dy, Mat3x2 matrix) {
+    Lanes b11 = SplatLanes(matrix.m11);
+    Lanes b12 = SplatLanes(matrix.m12);
+    Lanes b21 = SplatLanes(matrix.m21);
+    Lanes b22 = SplatLanes(matrix.m22);
+    Lanes bdx = SplatLanes(matrix.dx);
+    Lanes bdy = SplatLanes(matrix.dy);
+
+    Lanes a11 = LoadLanes(m11);
+    Lanes a12 = LoadLanes(m12);
+    Lanes a21 = LoadLanes(m21);
+    Lanes a22 = LoadLanes(m22);
+    Lanes adx = LoadLanes(dx);
+    Lanes ady = LoadLanes(dy);
+
+    StoreLanes(m11, AddLanes(MulLanes(a11, b11), MulLanes(a12, b21)));
+    StoreLanes(m12, AddLanes(MulLanes(a11, b12), MulLanes(a12, b22)));
+    StoreLanes(m21, AddLanes(MulLanes(a21, b11), MulLanes(a22, b21)));
+    StoreLanes(m22, AddLanes(MulLanes(a21, b12), MulLanes(a22, b22)));
+    StoreLanes(dx,  AddLanes(AddLanes(MulLanes(adx, b11), MulLanes(ady, b21)), bdx));
+    StoreLanes(dy,  AddLanes(AddLanes(MulLanes(adx, b12), MulLanes(ady, b22)), bdy));
+}
+#endif
+
+void ApplyMatrixRange(MatrixStore* store, size_t start, size_t count, Mat3x2 matrix) {
+    size_t i = 0;
+
+    #ifdef LANES_SIMD
+    for (; i + kLanes <= count; i += kLanes) {
+        size_t at = start + i;
+        ComposeLanes(
+            store->m11.Data() + at, store->m12.Data() + at,
+            store->m21.Data() + at, store->m22.Data() + at,
+            store->dx.Data()  + at, store->dy.Data()  + at,
+            matrix
+        );
+    }
+    #endif
+
+    for (; i < count; i++) {
+        store->Put(store->Get(start + i) * matrix, start + i);
+    }
+}
+
+void ApplyMatrixIndexed(MatrixStore* store, size_t* indices, size_t count, Mat3x2 matrix) {
+    size_t i = 0;
+
+    // There's no scatter before AVX-512 so the matrices are gathered into a full set of lanes,
+    // composed together and written back one at a time. An index that shows up twice in a set would only get
+    // composed once that way, so those sets go one at a time instead
+    #ifdef LANES_SIMD
+    float gathered[6][kLanes];
+    float *columns[6] = {
+        store->m11.Data(), store->m12.Data(), store->m21.Data(),
+        store->m22.Data(), store->dx.Data(),  store->dy.Data(),
+    };
+
+    for (; i + kLanes <= count; i += kLanes) {
+        bool unique = true;
+        for (size_t a=0; a<kLanes && unique; a++) {
+            for (size_t b=a+1; b<kLanes && unique; b++) {
+                unique = indices[i + a] != indices[i + b];
+            }
+        }
+
+        if (!unique) {
+            for (size_t lane=0; lane<kLanes; lane++) {
+                store->Put(store->Get(indices[i + lane]) * matrix, indices[i + lane]);
+            }
+            continue;
+        }
+
+        for (size_t column=0; column<6; column++) {
+            for (size_t lane=0; lane<kLanes; lane++) {
+                gathered[column][lane] = columns[column][indices[i + lane]];
+            }
+        }
+
+        ComposeLanes(gathered[0], gathered[1], gathered[2], gathered[3], gathered[4], gathered[5], matrix);
+
+        for (size_t column=0; column<6; column++) {
+            for (size_t lane=0; lane<kLanes; lane++) {
+                columns[column][indices[i + lane]] = gathered[column][lane];
+            }
+        }
+    }
+    #endif
+
+    for (; i < count; i++) {
+        store->Put(store->Get(indices[i]) * matrix, indices[i]);
+    }
+}